@@ -0,0 +1,426 @@
+/*****************************************************************************
+ * bench.c - Microbenchmark for the PDU framing layer in pdu.c
+ *
+ * Drives sendPDU()/recvPDU() and the batched framing APIs (sendPDUs(),
+ * fillPDUReader()/nextPDU()) over a Unix socketpair and loopback TCP, for
+ * the payload sizes the game actually sends:
+ *
+ *     1 B    Flag 2 (connection accepted)
+ *     14 B   Flag 31 (board update)
+ *     102 B  Flag 12 (list entry with a 100-character username)
+ *
+ * For every combination it reports:
+ *   - PDUs/sec and payload bytes/sec, streaming one way as fast as possible
+ *   - system calls per PDU on both ends of that stream
+ *   - p50/p99/p999 round-trip latency of one PDU echoed back
+ *
+ * System calls are counted by wrapping send/recv/writev/poll below; the
+ * framing code in pdu.c links against these wrappers unchanged.
+ *
+ * Usage: ttt-bench [-n stream_pdus] [-r round_trips]
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "pdu.h"
+
+#define DEFAULT_STREAM_PDUS 200000
+#define DEFAULT_ROUND_TRIPS 20000
+
+/* Receive buffer for the PDUReader API (fits many small PDUs per recv) */
+#define READER_SIZE 65536
+
+/* Framing APIs under test */
+typedef enum {
+    API_SINGLE,   /* sendPDU() + recvPDU(): one PDU per call */
+    API_BATCH     /* sendPDUs() + fillPDUReader()/nextPDU() */
+} BenchAPI;
+
+typedef struct {
+    int sender;
+    int receiver;
+    BenchAPI api;
+    int size;
+    int count;
+} StreamJob;
+
+static const int payload_sizes[] = {1, 14, 102};
+static const char *api_names[] = {"sendPDU/recvPDU", "sendPDUs/PDUReader"};
+
+/* System calls made by the framing layer, across all threads */
+static unsigned long syscall_count = 0;
+
+/*****************************************************************************
+ * Counting wrappers - forward to the C library and count the call
+ *****************************************************************************/
+#define REAL(name) static __typeof__(name) *real_##name; \
+    if (real_##name == NULL) real_##name = (__typeof__(name) *)dlsym(RTLD_NEXT, #name)
+
+ssize_t send(int socket, const void *buffer, size_t length, int flags) {
+    REAL(send);
+    __atomic_add_fetch(&syscall_count, 1, __ATOMIC_RELAXED);
+    return real_send(socket, buffer, length, flags);
+}
+
+ssize_t recv(int socket, void *buffer, size_t length, int flags) {
+    REAL(recv);
+    __atomic_add_fetch(&syscall_count, 1, __ATOMIC_RELAXED);
+    return real_recv(socket, buffer, length, flags);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    REAL(writev);
+    __atomic_add_fetch(&syscall_count, 1, __ATOMIC_RELAXED);
+    return real_writev(fd, iov, iovcnt);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    REAL(poll);
+    __atomic_add_fetch(&syscall_count, 1, __ATOMIC_RELAXED);
+    return real_poll(fds, nfds, timeout);
+}
+
+/*****************************************************************************
+ * now_ns - Monotonic clock in nanoseconds
+ *****************************************************************************/
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*****************************************************************************
+ * make_pair - Connect two sockets over a socketpair or loopback TCP
+ *****************************************************************************/
+static int make_pair(int tcp, int fds[2]) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listener;
+    int one = 1;
+
+    if (!tcp) {
+        return socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    }
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0 ||
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) < 0 ||
+        listen(listener, 1) < 0) {
+        perror("listen");
+        return -1;
+    }
+
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (fds[0] < 0 || connect(fds[0], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        close(listener);
+        return -1;
+    }
+    fds[1] = accept(listener, NULL, NULL);
+    close(listener);
+    if (fds[1] < 0) {
+        perror("accept");
+        return -1;
+    }
+
+    /* The server's PDUs are small and latency bound, like these */
+    setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 0;
+}
+
+/*****************************************************************************
+ * send_all - Send count PDUs of size bytes with the chosen API
+ *****************************************************************************/
+static int send_all(int socket, BenchAPI api, int size, int count) {
+    uint8_t payload[PDU_BATCH_MAX][256];
+    PDUSpan pdus[PDU_BATCH_MAX];
+    int batch;
+    int i;
+
+    for (i = 0; i < PDU_BATCH_MAX; i++) {
+        memset(payload[i], i, size);
+        pdus[i].buffer = payload[i];
+        pdus[i].length = size;
+    }
+
+    while (count > 0) {
+        if (api == API_SINGLE) {
+            if (sendPDU(socket, payload[0], size) < 0) {
+                return -1;
+            }
+            count--;
+        } else {
+            batch = count < PDU_BATCH_MAX ? count : PDU_BATCH_MAX;
+            if (sendPDUs(socket, pdus, batch) < 0) {
+                return -1;
+            }
+            count -= batch;
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * next_pdu - Receive one PDU with the chosen API, waiting as needed
+ *
+ * Returns the data length, or -1 on error/disconnect.
+ *****************************************************************************/
+static int next_pdu(int socket, BenchAPI api, PDUReader *reader, uint8_t **data) {
+    static __thread uint8_t buffer[READER_SIZE];
+    struct pollfd pfd;
+    int length;
+    int filled;
+
+    if (api == API_SINGLE) {
+        *data = buffer;
+        length = recvPDU(socket, buffer, sizeof(buffer));
+        return length > 0 ? length : -1;
+    }
+
+    for (;;) {
+        length = nextPDU(reader, data);
+        if (length != PDU_INCOMPLETE) {
+            return length;
+        }
+
+        filled = fillPDUReader(socket, reader);
+        if (filled == PDU_INCOMPLETE) {
+            pfd.fd = socket;
+            pfd.events = POLLIN;
+            poll(&pfd, 1, -1);
+        } else if (filled <= 0) {
+            return -1;
+        }
+    }
+}
+
+/*****************************************************************************
+ * stream_sender - Thread body: stream a job's PDUs
+ *****************************************************************************/
+static void *stream_sender(void *arg) {
+    StreamJob *job = arg;
+
+    if (send_all(job->sender, job->api, job->size, job->count) < 0) {
+        fprintf(stderr, "bench: send failed\n");
+    }
+    return NULL;
+}
+
+/*****************************************************************************
+ * echo_server - Thread body: send back every PDU until the peer closes
+ *****************************************************************************/
+static void *echo_server(void *arg) {
+    StreamJob *job = arg;
+    static __thread uint8_t reader_buffer[READER_SIZE];
+    PDUReader reader;
+    uint8_t *data;
+    int length;
+
+    initPDUReader(&reader, reader_buffer, sizeof(reader_buffer));
+    while ((length = next_pdu(job->receiver, job->api, &reader, &data)) > 0) {
+        if (sendPDU(job->receiver, data, length) < 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*****************************************************************************
+ * compare_doubles - qsort comparator
+ *****************************************************************************/
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*****************************************************************************
+ * run_stream - One-way throughput and system calls per PDU
+ *****************************************************************************/
+static int run_stream(int tcp, BenchAPI api, int size, int count,
+                      double *pdus_per_sec, double *syscalls_per_pdu) {
+    static uint8_t reader_buffer[READER_SIZE];
+    StreamJob job;
+    PDUReader reader;
+    pthread_t thread;
+    unsigned long start_syscalls;
+    uint8_t *data;
+    double start;
+    int fds[2];
+    int i;
+
+    if (make_pair(tcp, fds) < 0) {
+        return -1;
+    }
+
+    job.sender = fds[0];
+    job.receiver = fds[1];
+    job.api = api;
+    job.size = size;
+    job.count = count;
+    initPDUReader(&reader, reader_buffer, sizeof(reader_buffer));
+
+    start_syscalls = syscall_count;
+    start = now_ns();
+    pthread_create(&thread, NULL, stream_sender, &job);
+
+    for (i = 0; i < count; i++) {
+        if (next_pdu(fds[1], api, &reader, &data) != size) {
+            fprintf(stderr, "bench: stream broke after %d PDUs\n", i);
+            break;
+        }
+    }
+
+    pthread_join(thread, NULL);
+    *pdus_per_sec = i / ((now_ns() - start) / 1e9);
+    *syscalls_per_pdu = (double)(syscall_count - start_syscalls) / count;
+
+    close(fds[0]);
+    close(fds[1]);
+    return i == count ? 0 : -1;
+}
+
+/*****************************************************************************
+ * run_round_trips - Latency percentiles of PDUs echoed one at a time
+ *****************************************************************************/
+static int run_round_trips(int tcp, BenchAPI api, int size, int count, double *percentiles) {
+    static uint8_t reader_buffer[READER_SIZE];
+    uint8_t payload[256];
+    StreamJob job;
+    PDUReader reader;
+    pthread_t thread;
+    double *samples;
+    double start;
+    uint8_t *data;
+    int fds[2];
+    int i;
+
+    samples = malloc(count * sizeof(double));
+    if (samples == NULL || make_pair(tcp, fds) < 0) {
+        free(samples);
+        return -1;
+    }
+
+    job.receiver = fds[1];
+    job.api = api;
+    pthread_create(&thread, NULL, echo_server, &job);
+
+    memset(payload, 0x5a, size);
+    initPDUReader(&reader, reader_buffer, sizeof(reader_buffer));
+    for (i = 0; i < count; i++) {
+        start = now_ns();
+        if (sendPDU(fds[0], payload, size) < 0 ||
+            next_pdu(fds[0], api, &reader, &data) != size) {
+            fprintf(stderr, "bench: echo broke after %d round trips\n", i);
+            break;
+        }
+        samples[i] = now_ns() - start;
+    }
+
+    shutdown(fds[0], SHUT_WR);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    close(fds[1]);
+
+    if (i == 0) {
+        free(samples);
+        return -1;
+    }
+
+    qsort(samples, i, sizeof(double), compare_doubles);
+    percentiles[0] = samples[(int)(i * 0.50)];
+    percentiles[1] = samples[(int)(i * 0.99)];
+    percentiles[2] = samples[(int)(i * 0.999)];
+    free(samples);
+    return 0;
+}
+
+/*****************************************************************************
+ * usage - Print command line help and exit
+ *****************************************************************************/
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-n stream_pdus] [-r round_trips]\n", program);
+    fprintf(stderr, "  -n n  PDUs per throughput run (default %d)\n", DEFAULT_STREAM_PDUS);
+    fprintf(stderr, "  -r n  Round trips per latency run (default %d)\n", DEFAULT_ROUND_TRIPS);
+    exit(1);
+}
+
+/*****************************************************************************
+ * main - Run every transport x API x payload size combination
+ *****************************************************************************/
+int main(int argc, char *argv[]) {
+    int stream_pdus = DEFAULT_STREAM_PDUS;
+    int round_trips = DEFAULT_ROUND_TRIPS;
+    double pdus_per_sec;
+    double syscalls_per_pdu;
+    double latency[3];
+    int tcp;
+    int api;
+    int s;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                stream_pdus = atoi(optarg);
+                if (stream_pdus < 1) usage(argv[0]);
+                break;
+            case 'r':
+                round_trips = atoi(optarg);
+                if (round_trips < 1) usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    printf("%-10s %-20s %5s %12s %12s %9s %9s %9s %9s\n",
+           "transport", "api", "bytes", "PDUs/s", "MB/s", "sys/PDU",
+           "p50 us", "p99 us", "p999 us");
+
+    for (tcp = 0; tcp <= 1; tcp++) {
+        for (api = API_SINGLE; api <= API_BATCH; api++) {
+            for (s = 0; s < (int)(sizeof(payload_sizes) / sizeof(payload_sizes[0])); s++) {
+                int size = payload_sizes[s];
+
+                if (run_stream(tcp, api, size, stream_pdus, &pdus_per_sec, &syscalls_per_pdu) < 0 ||
+                    run_round_trips(tcp, api, size, round_trips, latency) < 0) {
+                    return 1;
+                }
+
+                printf("%-10s %-20s %5d %12.0f %12.2f %9.3f %9.1f %9.1f %9.1f\n",
+                       tcp ? "tcp" : "socketpair", api_names[api], size,
+                       pdus_per_sec, pdus_per_sec * size / 1e6, syscalls_per_pdu,
+                       latency[0] / 1e3, latency[1] / 1e3, latency[2] / 1e3);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
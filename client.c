@@ -32,6 +32,10 @@
 #define FLAG_LIST_COUNT        11
 #define FLAG_LIST_USER         12
 #define FLAG_LIST_DONE         13
+#define FLAG_LIST_PAGE_REQ     14
+#define FLAG_LIST_PAGE         15
+#define FLAG_LIST_SEARCH_REQ   16
+#define FLAG_LIST_SEARCH       17
 #define FLAG_GAME_START_REQ    20
 #define FLAG_GAME_STARTED      21
 #define FLAG_GAME_START_ERR    22
@@ -62,6 +66,9 @@ static char my_username[101];
 static int current_game_id = -1;
 static int my_symbol = -1;  /* 0=O, 1=X */
 static uint8_t board[9];
+static uint32_t list_cursor = 0;  /* Cursor of the list page last requested */
+static char list_prefix[101];     /* Prefix the list command is showing */
+static int list_first_page = 0;   /* The sorted page last requested is the first */
 
 /* Function prototypes */
 int connect_to_server(const char *hostname, uint16_t port);
@@ -71,11 +78,15 @@ void handle_stdin(int socket);
 void handle_server_data(int socket);
 void process_command(int socket, const char *input);
 void send_list_request(int socket);
+void send_list_page_request(int socket, uint32_t cursor);
+void send_list_search_request(int socket, const char *prefix, const char *after, int after_len);
 void send_game_start_request(int socket, const char *opponent);
 void send_move(int socket, int position);
 void handle_conn_accept(void);
 void handle_conn_reject(uint8_t *buffer, int len);
 void handle_list_response(int socket, uint8_t *initial_buffer, int initial_len);
+void handle_list_page(int socket, uint8_t *buffer, int len);
+void handle_list_search(int socket, uint8_t *buffer, int len);
 void handle_game_started(uint8_t *buffer, int len);
 void handle_game_start_error(uint8_t *buffer, int len);
 void handle_board_update(uint8_t *buffer, int len);
@@ -328,7 +339,8 @@ void handle_stdin(int socket) {
  * Receive and dispatch packets from the server.
  *
  * Steps:
- *   1. Receive a packet using recvPDU(socket, buffer, BUFFER_SIZE)
+ *   1. Receive a packet using recvPDU(socket, buffer, PDU_MAX_DATA)
+ *      (list pages can be up to PDU_MAX_DATA bytes)
  *
  *   2. Check for errors:
  *      - If bytes_received == 0: server disconnected, exit(0)
@@ -338,6 +350,8 @@ void handle_stdin(int socket) {
  *
  *   4. Use a switch statement to dispatch based on flag:
  *      - FLAG_LIST_COUNT (11): call handle_list_response()
+ *      - FLAG_LIST_PAGE (15): call handle_list_page()
+ *      - FLAG_LIST_SEARCH (17): call handle_list_search()
  *      - FLAG_GAME_STARTED (21): call handle_game_started()
  *      - FLAG_GAME_START_ERR (22): call handle_game_start_error()
  *      - FLAG_BOARD_UPDATE (31): call handle_board_update()
@@ -349,8 +363,8 @@ void handle_stdin(int socket) {
 void handle_server_data(int socket) {
     /* TODO: Implement receiving packets and dispatching to handlers */
 
-    uint8_t buffer[BUFFER_SIZE];
-    int bytes_recieved = recvPDU(socket, buffer, BUFFER_SIZE);
+    uint8_t buffer[PDU_MAX_DATA];
+    int bytes_recieved = recvPDU(socket, buffer, PDU_MAX_DATA);
 
     if (bytes_recieved == 0) exit(0);
     if (bytes_recieved < 0) exit(1);
@@ -360,6 +374,12 @@ void handle_server_data(int socket) {
         case 11:
             handle_list_response(socket, buffer, bytes_recieved);
             break;
+        case 15:
+            handle_list_page(socket, buffer, bytes_recieved);
+            break;
+        case 17:
+            handle_list_search(socket, buffer, bytes_recieved);
+            break;
         case 21:
             handle_game_started(buffer, bytes_recieved);
             break;
@@ -412,6 +432,7 @@ void process_command(int socket, const char *input) {
     if (strcasecmp(input, "help") == 0 || strcasecmp(input, "h") == 0 || strcmp(input, "?") == 0) {
         printf("\n%s=== Commands ===%s\n", COLOR_CYAN, COLOR_RESET);
         printf("  %slist%s or %sl%s              - List all online players\n", COLOR_CYAN, COLOR_RESET, COLOR_CYAN, COLOR_RESET);
+        printf("  %slist <prefix>%s          - List players whose names start with prefix\n", COLOR_CYAN, COLOR_RESET);
         printf("  %splay <name>%s or %sp <name>%s - Start a game with someone\n", COLOR_CYAN, COLOR_RESET, COLOR_CYAN, COLOR_RESET);
         if (client_state == STATE_IN_GAME) {
             printf("  %s1-9%s                   - Make a move (just type the number!)\n", COLOR_CYAN, COLOR_RESET);
@@ -425,7 +446,14 @@ void process_command(int socket, const char *input) {
 
     /* Shortcut: 'l' or 'list' for player list */
     if (strcasecmp(input, "l") == 0 || strcasecmp(input, "list") == 0) {
-        send_list_request(socket);
+        send_list_search_request(socket, "", NULL, 0);
+        return;
+    }
+
+    /* Shortcut: 'list prefix' or 'l prefix' for players by name */
+    if ((strncasecmp(input, "list ", 5) == 0 && sscanf(input + 5, "%100s", arg1) == 1) ||
+        (input[0] == 'l' && input[1] == ' ' && sscanf(input + 2, "%100s", arg1) == 1)) {
+        send_list_search_request(socket, arg1, NULL, 0);
         return;
     }
 
@@ -496,6 +524,65 @@ void send_list_request(int socket) {
 
 }
 
+/*****************************************************************************
+ * send_list_page_request - Send Flag 14 (COMPLETE)
+ *
+ * Asks for one page of the player list. The server answers with a single
+ * Flag 15 packet holding as many names as fit. The list command uses
+ * Flag 16 instead, which also sorts and filters.
+ *
+ * Flag 14 Packet Format:
+ *   +------+--------+
+ *   | Flag | Cursor |
+ *   +------+--------+
+ *   | 1 B  | 4 B    |
+ *   +------+--------+
+ *   Cursor is 0 for the first page, then whatever the previous Flag 15
+ *   returned (network byte order)
+ *****************************************************************************/
+void send_list_page_request(int socket, uint32_t cursor) {
+    uint8_t buffer[5];
+    uint32_t net_cursor = htonl(cursor);
+
+    buffer[0] = FLAG_LIST_PAGE_REQ;
+    memcpy(buffer + 1, &net_cursor, 4);
+    list_cursor = cursor;
+    sendPDU(socket, buffer, 5);
+}
+
+/*****************************************************************************
+ * send_list_search_request - Send Flag 16 (COMPLETE)
+ *
+ * Asks for the players whose names start with prefix ("" for everyone),
+ * in name order, from just after the name given. The server answers with
+ * one Flag 17 page; handle_list_search() asks for the next one after the
+ * last name it got.
+ *
+ * Flag 16 Packet Format:
+ *   +------+--------+--------+--------+-------+
+ *   | Flag | Length | Prefix | Length | After |
+ *   +------+--------+--------+--------+-------+
+ *   | 1 B  | 1 B    | N B    | 1 B    | M B   |
+ *   +------+--------+--------+--------+-------+
+ *   An After length of 0 asks for the first page
+ *****************************************************************************/
+void send_list_search_request(int socket, const char *prefix, const char *after, int after_len) {
+    uint8_t buffer[BUFFER_SIZE];
+    int prefix_len = strlen(prefix);
+
+    if (prefix != list_prefix) {
+        strcpy(list_prefix, prefix);
+    }
+    list_first_page = (after_len == 0);
+
+    buffer[0] = FLAG_LIST_SEARCH_REQ;
+    buffer[1] = prefix_len;
+    memcpy(buffer + 2, prefix, prefix_len);
+    buffer[2 + prefix_len] = after_len;
+    memcpy(buffer + 3 + prefix_len, after, after_len);
+    sendPDU(socket, buffer, 3 + prefix_len + after_len);
+}
+
 /*****************************************************************************
  * TODO: send_game_start_request - Send Flag 20
  *
@@ -743,6 +830,120 @@ void handle_list_response(int socket, uint8_t *initial_buffer, int initial_len)
     recvPDU(socket, buffer, BUFFER_SIZE);
 }
 
+/*****************************************************************************
+ * handle_list_page - Process Flag 15 (COMPLETE)
+ *
+ * One page of the player list. Unlike Flag 11-13 the names are packed
+ * into this single packet, and the next page is requested here, without
+ * blocking, so game packets arriving in between are still handled.
+ *
+ * Flag 15 Packet Format:
+ *   +------+-------+-------------+-------+---------------------------+
+ *   | Flag | Total | Next Cursor | Count | Count x (Length, Username) |
+ *   +------+-------+-------------+-------+---------------------------+
+ *   | 1 B  | 4 B   | 4 B         | 2 B   | variable                  |
+ *   +------+-------+-------------+-------+---------------------------+
+ *   Total, Next Cursor and Count are in network byte order. A next cursor
+ *   of 0 means this was the last page.
+ *****************************************************************************/
+void handle_list_page(int socket, uint8_t *buffer, int len) {
+    uint32_t total;
+    uint32_t next_cursor;
+    uint16_t count;
+    int offset = 11;
+    int i;
+
+    if (len < 11) {
+        return;
+    }
+
+    memcpy(&total, buffer + 1, 4);
+    memcpy(&next_cursor, buffer + 5, 4);
+    memcpy(&count, buffer + 9, 2);
+    total = ntohl(total);
+    next_cursor = ntohl(next_cursor);
+    count = ntohs(count);
+
+    if (list_cursor == 0) {
+        printf("Players online (%d):\n", total);
+    }
+
+    for (i = 0; i < count && offset < len; i++) {
+        uint8_t username_len = buffer[offset];
+        if (offset + 1 + username_len > len) {
+            break;
+        }
+
+        char username[256];
+        memcpy(username, buffer + offset + 1, username_len);
+        username[username_len] = '\0';
+        printf("  %s\n", username);
+        offset += 1 + username_len;
+    }
+
+    if (next_cursor != 0) {
+        send_list_page_request(socket, next_cursor);
+    }
+}
+
+/*****************************************************************************
+ * handle_list_search - Process Flag 17 (COMPLETE)
+ *
+ * One sorted page of the players matching the list command's prefix.
+ * While more match, the next page is requested after the last name here,
+ * the same non-blocking way as handle_list_page().
+ *
+ * Flag 17 Packet Format:
+ *   +------+-------+------+-------+---------------------------+
+ *   | Flag | Total | More | Count | Count x (Length, Username) |
+ *   +------+-------+------+-------+---------------------------+
+ *   | 1 B  | 4 B   | 1 B  | 2 B   | variable                  |
+ *   +------+-------+------+-------+---------------------------+
+ *   Total (players online) and Count are in network byte order. More is
+ *   0 on the last page.
+ *****************************************************************************/
+void handle_list_search(int socket, uint8_t *buffer, int len) {
+    char username[256];
+    uint32_t total;
+    uint16_t count;
+    uint8_t username_len = 0;
+    int offset = 8;
+    int i;
+
+    if (len < 8) {
+        return;
+    }
+
+    memcpy(&total, buffer + 1, 4);
+    memcpy(&count, buffer + 6, 2);
+    total = ntohl(total);
+    count = ntohs(count);
+
+    if (list_first_page) {
+        if (list_prefix[0] == '\0') {
+            printf("Players online (%d):\n", total);
+        } else {
+            printf("Players starting with \"%s\" (%d online):\n", list_prefix, total);
+        }
+    }
+
+    for (i = 0; i < count && offset < len; i++) {
+        username_len = buffer[offset];
+        if (offset + 1 + username_len > len) {
+            break;
+        }
+
+        memcpy(username, buffer + offset + 1, username_len);
+        username[username_len] = '\0';
+        printf("  %s\n", username);
+        offset += 1 + username_len;
+    }
+
+    if (buffer[5] != 0 && i > 0) {
+        send_list_search_request(socket, list_prefix, username, username_len);
+    }
+}
+
 /*****************************************************************************
  * TODO: handle_game_started - Process Flag 21
  *
@@ -1024,8 +1225,8 @@ void handle_move_invalid(uint8_t *buffer, int len) {
  *   0 = Draw
  *   1 = X won
  *   2 = O won
- *   3 = X disconnected before game started
- *   4 = O disconnected before game started
+ *   3 = X forfeited (ran out of time, or dropped for not reading)
+ *   4 = O forfeited
  *   5 = X disconnected during game
  *   6 = O disconnected during game
  *
@@ -1051,7 +1252,9 @@ void handle_move_invalid(uint8_t *buffer, int len) {
  *      case 0: "Draw game!"
  *      case 1: "You won!" if my_symbol==1, else "You lost!"
  *      case 2: "You won!" if my_symbol==0, else "You lost!"
- *      case 3-6: "Opponent disconnected" (check if you won by forfeit)
+ *      case 3: "You lost by forfeit!" if my_symbol==1, else "Opponent forfeited. You won!"
+ *      case 4: "You lost by forfeit!" if my_symbol==0, else "Opponent forfeited. You won!"
+ *      case 5-6: "Opponent disconnected" (you win by forfeit)
  *   5. Display final board: call display_board()
  *   6. Reset game state:
  *      - client_state = STATE_AVAILABLE
@@ -1077,10 +1280,10 @@ void handle_game_over(uint8_t *buffer, int len) {
             printf(my_symbol == 0 ? "You won!\n" : "You lost!\n");
             break;
         case 3:
-            printf("Opponent disconnected before game started. You win by forfeit!\n");
+            printf(my_symbol == 1 ? "You lost by forfeit!\n" : "Opponent forfeited. You won!\n");
             break;
         case 4:
-            printf("Opponent disconnected before game started. You win by forfeit!\n");
+            printf(my_symbol == 0 ? "You lost by forfeit!\n" : "Opponent forfeited. You won!\n");
             break;
         case 5:
             printf("Opponent disconnected during game. You win by forfeit!\n");
@@ -0,0 +1,815 @@
+/*****************************************************************************
+ * conn.c - Per-connection state implementation
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#include "conn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/* Everything below is per thread: each reactor has its own connections */
+
+/* Connections indexed directly by socket descriptor */
+static __thread Connection **conn_table = NULL;
+static __thread int conn_table_size = 0;
+
+/* Backend override for conn_flush() in conn_flush_pending() */
+static __thread ConnOutputHook output_hook = NULL;
+
+__thread unsigned long conn_io_syscalls = 0;
+
+/* Sockets that queued output since the last conn_flush_pending() */
+static __thread int *dirty_sockets = NULL;
+static __thread int dirty_count = 0;
+static __thread int dirty_capacity = 0;
+
+/* Sockets that failed and have not been collected by conn_next_failed() */
+static __thread int *failed_sockets = NULL;
+static __thread int failed_count = 0;
+static __thread int failed_capacity = 0;
+
+/* Connections whose socket is full while output waits, the only ones
+ * conn_shed_output() can evict: clients not in a game, then players */
+#define STALL_SPECTATORS 1
+#define STALL_PLAYERS    2
+static __thread Connection *stalled_lists[3] = {NULL, NULL, NULL};
+
+/* When this thread last asked the others to shed (timer_now) */
+static __thread uint64_t shed_requested_at = 0;
+
+/* Shared by all threads: where sends to sockets this thread lacks go */
+static ConnRemoteHook remote_hook = NULL;
+
+/* Shared by all threads: output limits (0 = none), and the output of every
+ * connection together (updated atomically) */
+static long output_limit_per_connection = 0;
+static long output_limit_total = 0;
+static ConnPlayingHook playing_hook = NULL;
+static ConnShedHook shed_hook = NULL;
+static long output_total = 0;
+static long output_peak = 0;
+static unsigned long output_evictions = 0;
+
+/* For the server-wide limit, a client being sent to is a slow consumer
+ * (and gives way) once it holds more than this fraction of the limit */
+#define OUTPUT_SHARE_DIVISOR 8
+
+/* Least time between two requests from one thread for the others to shed;
+ * the first request is still pending in their mailboxes until they drain */
+#define SHED_REQUEST_INTERVAL_MS 10
+
+/*****************************************************************************
+ * socket_list_push - Append a socket to a growable array of sockets
+ *****************************************************************************/
+static int socket_list_push(int **list, int *count, int *capacity, int socket) {
+    int *grown;
+    int new_capacity;
+
+    if (*count == *capacity) {
+        new_capacity = *capacity ? *capacity * 2 : 64;
+        grown = realloc(*list, new_capacity * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        *list = grown;
+        *capacity = new_capacity;
+    }
+
+    (*list)[(*count)++] = socket;
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_table_reserve - Make sure conn_table has a slot for socket
+ *****************************************************************************/
+static int conn_table_reserve(int socket) {
+    Connection **table;
+    int new_size;
+
+    if (socket < conn_table_size) {
+        return 0;
+    }
+
+    new_size = conn_table_size ? conn_table_size : 64;
+    while (new_size <= socket) {
+        new_size *= 2;
+    }
+
+    table = realloc(conn_table, new_size * sizeof(Connection *));
+    if (table == NULL) {
+        return -1;
+    }
+
+    memset(table + conn_table_size, 0,
+           (new_size - conn_table_size) * sizeof(Connection *));
+    conn_table = table;
+    conn_table_size = new_size;
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_write - Write without blocking
+ *
+ * Returns the number of bytes the kernel took (possibly 0), or -1 and marks
+ * the connection failed on a fatal error.
+ *****************************************************************************/
+static int conn_write(Connection *conn, const uint8_t *data, int length) {
+    int written;
+
+    for (;;) {
+        conn_io_syscalls++;
+        written = send(conn->socket, data, length, 0);
+        if (written >= 0) {
+            return written;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+
+        perror("conn_write");
+        conn_fail(conn);
+        return -1;
+    }
+}
+
+/*****************************************************************************
+ * conn_queue - Append bytes to the output queue
+ *****************************************************************************/
+static int conn_queue(Connection *conn, const uint8_t *data, int length) {
+    uint8_t *grown;
+    int needed;
+    int new_capacity;
+
+    /* Reclaim the space in front of the unwritten bytes first */
+    if (conn->send_offset > 0) {
+        memmove(conn->send_buffer, conn->send_buffer + conn->send_offset,
+                conn->send_length - conn->send_offset);
+        conn->send_length -= conn->send_offset;
+        conn->send_offset = 0;
+    }
+
+    needed = conn->send_length + length;
+    if (needed > conn->send_capacity) {
+        new_capacity = conn->send_capacity ? conn->send_capacity : 256;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+
+        grown = realloc(conn->send_buffer, new_capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        conn->send_buffer = grown;
+        conn->send_capacity = new_capacity;
+    }
+
+    memcpy(conn->send_buffer + conn->send_length, data, length);
+    conn->send_length += length;
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_stall_unlink - Take a connection off its stalled list
+ *****************************************************************************/
+static void conn_stall_unlink(Connection *conn) {
+    if (conn->stalled == 0) {
+        return;
+    }
+
+    if (conn->stall_prev != NULL) {
+        conn->stall_prev->stall_next = conn->stall_next;
+    } else {
+        stalled_lists[conn->stalled] = conn->stall_next;
+    }
+    if (conn->stall_next != NULL) {
+        conn->stall_next->stall_prev = conn->stall_prev;
+    }
+
+    conn->stall_prev = NULL;
+    conn->stall_next = NULL;
+    conn->stalled = 0;
+}
+
+/*****************************************************************************
+ * conn_stall_link - Put a connection on a stalled list
+ *****************************************************************************/
+static void conn_stall_link(Connection *conn, int list) {
+    conn->stall_prev = NULL;
+    conn->stall_next = stalled_lists[list];
+    if (conn->stall_next != NULL) {
+        conn->stall_next->stall_prev = conn;
+    }
+    stalled_lists[list] = conn;
+    conn->stalled = list;
+}
+
+/*****************************************************************************
+ * conn_update_stalled - Keep a connection's stalled list membership current
+ *
+ * Called whenever writable, output_bytes or failed changes.
+ *****************************************************************************/
+static void conn_update_stalled(Connection *conn) {
+    int stalled = !conn->failed && !conn->writable && conn->output_bytes > 0;
+
+    if (stalled && conn->stalled == 0) {
+        conn_stall_link(conn, playing_hook != NULL && playing_hook(conn->socket)
+                              ? STALL_PLAYERS : STALL_SPECTATORS);
+    } else if (!stalled) {
+        conn_stall_unlink(conn);
+    }
+}
+
+/*****************************************************************************
+ * conn_output_add - Count bytes against a connection's and the total output
+ *****************************************************************************/
+static void conn_output_add(Connection *conn, long length) {
+    long total;
+    long peak;
+
+    conn->output_bytes += length;
+    conn_update_stalled(conn);
+    total = __atomic_add_fetch(&output_total, length, __ATOMIC_RELAXED);
+
+    peak = __atomic_load_n(&output_peak, __ATOMIC_RELAXED);
+    while (total > peak &&
+           !__atomic_compare_exchange_n(&output_peak, &peak, total, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/*****************************************************************************
+ * conn_evict - Disconnect a slow consumer and drop its queued output
+ *****************************************************************************/
+static void conn_evict(Connection *conn) {
+    long queued = conn->send_length - conn->send_offset;
+
+    fprintf(stderr, "Evicting slow client on socket %d (%ld bytes unsent)\n",
+            conn->socket, conn->output_bytes);
+
+    free(conn->send_buffer);
+    conn->send_buffer = NULL;
+    conn->send_length = 0;
+    conn->send_offset = 0;
+    conn->send_capacity = 0;
+    conn_output_add(conn, -queued);
+
+    conn->evicted = 1;
+    conn_fail(conn);
+    __atomic_add_fetch(&output_evictions, 1, __ATOMIC_RELAXED);
+}
+
+/*****************************************************************************
+ * conn_shed_output - Evict the calling thread's stalled clients to make room
+ *****************************************************************************/
+void conn_shed_output(long needed) {
+    Connection *conn;
+    Connection *next;
+    int list;
+
+    for (list = STALL_SPECTATORS; list <= STALL_PLAYERS; list++) {
+        for (conn = stalled_lists[list]; conn != NULL; conn = next) {
+            if (__atomic_load_n(&output_total, __ATOMIC_RELAXED) + needed <= output_limit_total) {
+                return;
+            }
+
+            /* Eviction takes conn off the list, and joining a game moves
+             * it to the players, so next is read first */
+            next = conn->stall_next;
+            if (list == STALL_SPECTATORS && playing_hook != NULL && playing_hook(conn->socket)) {
+                conn_stall_unlink(conn);
+                conn_stall_link(conn, STALL_PLAYERS);
+                continue;
+            }
+            conn_evict(conn);
+        }
+    }
+}
+
+/*****************************************************************************
+ * conn_output_fits - Apply the output limits to length more bytes
+ *
+ * Returns 0 if they may be queued, or -1 after evicting conn.
+ *****************************************************************************/
+static int conn_output_fits(Connection *conn, int length) {
+    if (output_limit_per_connection > 0 &&
+        conn->output_bytes + length > output_limit_per_connection) {
+        conn_evict(conn);
+        return -1;
+    }
+
+    if (output_limit_total > 0 &&
+        __atomic_load_n(&output_total, __ATOMIC_RELAXED) + length > output_limit_total) {
+        conn_shed_output(length);
+
+        if (!conn->failed &&
+            __atomic_load_n(&output_total, __ATOMIC_RELAXED) + length > output_limit_total) {
+            /* The rest is queued on other threads: they shed their own.
+             * One request covers a burst of sends; asking again before
+             * they ran it would only repeat it */
+            if (shed_hook != NULL &&
+                timer_now() - shed_requested_at >= SHED_REQUEST_INTERVAL_MS) {
+                shed_requested_at = timer_now();
+                shed_hook(length);
+            }
+
+            /* The client being sent to only gives way if it is slow too;
+             * a healthy one goes over the limit until the others make room */
+            if (!conn->writable ||
+                conn->output_bytes + length > output_limit_total / OUTPUT_SHARE_DIVISOR) {
+                conn_evict(conn);
+            }
+        }
+        if (conn->failed) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_mark_dirty - Remember to flush a connection at the end of the pass
+ *****************************************************************************/
+static int conn_mark_dirty(Connection *conn) {
+    if (conn->dirty) {
+        return 0;
+    }
+
+    if (socket_list_push(&dirty_sockets, &dirty_count, &dirty_capacity, conn->socket) < 0) {
+        return -1;
+    }
+
+    conn->dirty = 1;
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_create - Create and register the state for a new client socket
+ *****************************************************************************/
+Connection *conn_create(int socket) {
+    Connection *conn;
+    int flags;
+
+    if (socket < 0 || conn_table_reserve(socket) < 0) {
+        return NULL;
+    }
+
+    flags = fcntl(socket, F_GETFL, 0);
+    if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("fcntl");
+        return NULL;
+    }
+
+    conn = calloc(1, sizeof(Connection));
+    if (conn == NULL) {
+        return NULL;
+    }
+
+    conn->socket = socket;
+    conn->writable = 1;
+    initPDUReader(&conn->reader, conn->recv_buffer, CONN_RECV_SIZE);
+
+    conn_table[socket] = conn;
+    return conn;
+}
+
+/*****************************************************************************
+ * conn_get - Look up the connection for a socket
+ *****************************************************************************/
+Connection *conn_get(int socket) {
+    if (socket < 0 || socket >= conn_table_size) {
+        return NULL;
+    }
+
+    return conn_table[socket];
+}
+
+/*****************************************************************************
+ * conn_send_pdu - Send a PDU to a client without ever blocking
+ *****************************************************************************/
+int conn_send_pdu(int socket, uint8_t *buffer, int length) {
+    PDUSpan pdu;
+
+    pdu.buffer = buffer;
+    pdu.length = length;
+    return conn_send_pdus(socket, &pdu, 1);
+}
+
+/*****************************************************************************
+ * conn_send_pdus - Queue several PDUs for a client
+ *****************************************************************************/
+int conn_send_pdus(int socket, PDUSpan *pdus, int count) {
+    Connection *conn = conn_get(socket);
+    uint16_t pdu_length;
+    uint8_t length_bytes[2];
+    int total = 0;
+    int i;
+
+    if (pdus == NULL || count < 0) {
+        return -1;
+    }
+
+    if (conn == NULL) {
+        /* Not one of ours: maybe another thread's (see conn_set_remote_hook) */
+        if (remote_hook == NULL) {
+            return -1;
+        }
+        return remote_hook(socket, pdus, count);
+    }
+
+    if (conn->failed) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (pdus[i].buffer == NULL || pdus[i].length < 0) {
+            return -1;
+        }
+        if (pdus[i].length > PDU_MAX_DATA) {  /* Max: 65535 - 2 bytes for length field */
+            fprintf(stderr, "conn_send_pdus: packet too large (%d bytes)\n", pdus[i].length);
+            return -1;
+        }
+        total += pdus[i].length + 2;
+    }
+
+    if (conn_output_fits(conn, total) < 0) {
+        return -1;
+    }
+
+    /* Frame everything into the output queue; the write happens once per
+     * connection per pass, in conn_flush_pending() */
+    for (i = 0; i < count; i++) {
+        pdu_length = htons(pdus[i].length + 2);
+        memcpy(length_bytes, &pdu_length, 2);
+
+        if (conn_queue(conn, length_bytes, 2) < 0 ||
+            conn_queue(conn, pdus[i].buffer, pdus[i].length) < 0) {
+            fprintf(stderr, "conn_send_pdus: out of memory queueing output\n");
+            conn_fail(conn);
+            return -1;
+        }
+        conn_output_add(conn, pdus[i].length + 2);
+    }
+
+    if (conn_mark_dirty(conn) < 0) {
+        fprintf(stderr, "conn_send_pdus: out of memory queueing output\n");
+        conn_fail(conn);
+        return -1;
+    }
+
+    return total;
+}
+
+/*****************************************************************************
+ * conn_send_framed - Queue PDUs that already carry their length prefixes
+ *****************************************************************************/
+int conn_send_framed(int socket, const uint8_t *data, int length) {
+    Connection *conn = conn_get(socket);
+
+    if (conn == NULL || conn->failed || data == NULL || length < 0) {
+        return -1;
+    }
+
+    if (conn_output_fits(conn, length) < 0) {
+        return -1;
+    }
+
+    if (conn_queue(conn, data, length) < 0) {
+        fprintf(stderr, "conn_send_framed: out of memory queueing output\n");
+        conn_fail(conn);
+        return -1;
+    }
+    conn_output_add(conn, length);
+
+    if (conn_mark_dirty(conn) < 0) {
+        fprintf(stderr, "conn_send_framed: out of memory queueing output\n");
+        conn_fail(conn);
+        return -1;
+    }
+
+    return length;
+}
+
+/*****************************************************************************
+ * conn_flush - Write as much queued output as the socket will take
+ *****************************************************************************/
+int conn_flush(Connection *conn) {
+    int written;
+
+    if (conn->failed) {
+        return -1;
+    }
+
+    conn_set_writable(conn, 1);
+    while (conn_has_pending_output(conn)) {
+        written = conn_write(conn, conn->send_buffer + conn->send_offset,
+                             conn->send_length - conn->send_offset);
+        if (written < 0) {
+            return -1;
+        }
+        if (written == 0) {
+            conn_set_writable(conn, 0);
+            return 0;  /* Socket full, wait for the next POLLOUT */
+        }
+        conn->send_offset += written;
+        conn_output_add(conn, -written);
+    }
+
+    /* Fully drained: idle connections keep no output buffer around */
+    free(conn->send_buffer);
+    conn->send_buffer = NULL;
+    conn->send_length = 0;
+    conn->send_offset = 0;
+    conn->send_capacity = 0;
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_mark_writable - Note that poll() reported POLLOUT for a connection
+ *****************************************************************************/
+void conn_mark_writable(Connection *conn) {
+    if (conn == NULL) {
+        return;
+    }
+
+    conn_set_writable(conn, 1);
+    if (conn_mark_dirty(conn) < 0) {
+        conn_flush(conn);
+    }
+}
+
+/*****************************************************************************
+ * conn_set_writable - Set conn->writable from an output hook
+ *****************************************************************************/
+void conn_set_writable(Connection *conn, int writable) {
+    conn->writable = writable;
+    conn_update_stalled(conn);
+}
+
+/*****************************************************************************
+ * conn_flush_pending - Flush every connection that queued output this pass
+ *****************************************************************************/
+void conn_flush_pending(void) {
+    Connection *conn;
+    int i;
+
+    for (i = 0; i < dirty_count; i++) {
+        conn = conn_get(dirty_sockets[i]);
+        if (conn == NULL || !conn->dirty) {
+            continue;  /* Disconnected since it queued output */
+        }
+
+        conn->dirty = 0;
+
+        /* A socket that was full stays full until POLLOUT says otherwise */
+        if (!conn->writable) {
+            continue;
+        }
+
+        if (output_hook != NULL) {
+            if (conn_has_pending_output(conn)) {
+                output_hook(conn);
+            }
+        } else {
+            conn_flush(conn);
+        }
+    }
+
+    dirty_count = 0;
+}
+
+/*****************************************************************************
+ * conn_fail - Mark a connection as failed
+ *****************************************************************************/
+void conn_fail(Connection *conn) {
+    if (conn->failed) {
+        return;
+    }
+
+    conn->failed = 1;
+    conn_stall_unlink(conn);
+
+    /* If this cannot be recorded, the backend finds it by other means */
+    socket_list_push(&failed_sockets, &failed_count, &failed_capacity, conn->socket);
+}
+
+/*****************************************************************************
+ * conn_next_failed - Collect a connection that failed since the last call
+ *****************************************************************************/
+int conn_next_failed(void) {
+    Connection *conn;
+    int socket;
+
+    while (failed_count > 0) {
+        socket = failed_sockets[--failed_count];
+        conn = conn_get(socket);
+        if (conn != NULL && conn->failed) {
+            return socket;
+        }
+    }
+
+    return -1;
+}
+
+/*****************************************************************************
+ * conn_set_output_hook - Let an I/O backend take over writing
+ *****************************************************************************/
+void conn_set_output_hook(ConnOutputHook hook) {
+    output_hook = hook;
+}
+
+/*****************************************************************************
+ * conn_set_remote_hook - Forward sends for sockets owned by other threads
+ *****************************************************************************/
+void conn_set_remote_hook(ConnRemoteHook hook) {
+    remote_hook = hook;
+}
+
+/*****************************************************************************
+ * conn_take_output - Detach a connection's queued output
+ *****************************************************************************/
+uint8_t *conn_take_output(Connection *conn, int *length) {
+    uint8_t *buffer;
+
+    if (!conn_has_pending_output(conn)) {
+        return NULL;
+    }
+
+    /* Move the unwritten bytes to the front so the caller can free() it */
+    buffer = conn->send_buffer;
+    *length = conn->send_length - conn->send_offset;
+    memmove(buffer, buffer + conn->send_offset, *length);
+
+    conn->send_buffer = NULL;
+    conn->send_length = 0;
+    conn->send_offset = 0;
+    conn->send_capacity = 0;
+    return buffer;
+}
+
+/*****************************************************************************
+ * conn_output_sent - Report output taken with conn_take_output() as written
+ *****************************************************************************/
+void conn_output_sent(Connection *conn, int length) {
+    if (conn != NULL) {
+        conn_output_add(conn, -(long)length);
+    }
+}
+
+/*****************************************************************************
+ * conn_return_output - Put back output taken with conn_take_output()
+ *****************************************************************************/
+int conn_return_output(Connection *conn, const uint8_t *data, int length) {
+    int queued = conn->send_length - conn->send_offset;
+    uint8_t *buffer;
+
+    if (length <= 0) {
+        return 0;
+    }
+
+    buffer = malloc(queued + length);
+    if (buffer == NULL) {
+        conn_fail(conn);
+        return -1;
+    }
+
+    /* Still counted in output_bytes: taken output stays counted until sent */
+    memcpy(buffer, data, length);
+    if (queued > 0) {
+        memcpy(buffer + length, conn->send_buffer + conn->send_offset, queued);
+    }
+    free(conn->send_buffer);
+    conn->send_buffer = buffer;
+    conn->send_length = queued + length;
+    conn->send_offset = 0;
+    conn->send_capacity = queued + length;
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_restore - Give a new connection the buffers of a handed-off one
+ *****************************************************************************/
+int conn_restore(Connection *conn, const uint8_t *unread, int unread_length,
+                 const uint8_t *unsent, int unsent_length) {
+    if (feedPDUReader(&conn->reader, unread, unread_length) != unread_length) {
+        return -1;
+    }
+
+    if (unsent_length > 0) {
+        if (conn_queue(conn, unsent, unsent_length) < 0) {
+            return -1;
+        }
+        conn_output_add(conn, unsent_length);
+        if (conn_mark_dirty(conn) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * conn_next - Walk the calling thread's connections
+ *****************************************************************************/
+Connection *conn_next(int *cursor) {
+    while (*cursor < conn_table_size) {
+        if (conn_table[(*cursor)++] != NULL) {
+            return conn_table[*cursor - 1];
+        }
+    }
+    return NULL;
+}
+
+/*****************************************************************************
+ * conn_set_output_limits - Bound the output queued for slow clients
+ *****************************************************************************/
+void conn_set_output_limits(long per_connection, long total, ConnPlayingHook playing) {
+    output_limit_per_connection = per_connection;
+    output_limit_total = total;
+    playing_hook = playing;
+}
+
+/*****************************************************************************
+ * conn_set_shed_hook - Reach the other threads when output is over the limit
+ *****************************************************************************/
+void conn_set_shed_hook(ConnShedHook hook) {
+    shed_hook = hook;
+}
+
+/*****************************************************************************
+ * conn_get_output_stats - Read the output statistics of all threads
+ *****************************************************************************/
+void conn_get_output_stats(ConnOutputStats *stats) {
+    stats->buffered = __atomic_load_n(&output_total, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&output_peak, __ATOMIC_RELAXED);
+    stats->evicted = __atomic_load_n(&output_evictions, __ATOMIC_RELAXED);
+}
+
+/*****************************************************************************
+ * conn_has_pending_output - Check whether output is waiting for POLLOUT
+ *****************************************************************************/
+int conn_has_pending_output(Connection *conn) {
+    return conn != NULL && conn->send_offset < conn->send_length;
+}
+
+/*****************************************************************************
+ * conn_has_buffered_pdu - Check whether a complete PDU is waiting
+ *****************************************************************************/
+int conn_has_buffered_pdu(Connection *conn) {
+    return conn != NULL && conn->reader.state == PDU_STATE_COMPLETE;
+}
+
+/*****************************************************************************
+ * conn_destroy - Unregister and free a connection
+ *****************************************************************************/
+void conn_destroy(Connection *conn) {
+    if (conn == NULL) {
+        return;
+    }
+
+    if (conn->socket >= 0 && conn->socket < conn_table_size &&
+        conn_table[conn->socket] == conn) {
+        conn_table[conn->socket] = NULL;
+    }
+
+    timer_cancel(&conn->idle_timer);
+    conn_output_add(conn, -conn->output_bytes);
+    conn_stall_unlink(conn);
+    free(conn->send_buffer);
+    free(conn);
+}
+
+/*****************************************************************************
+ * conn_cleanup - Free every connection and the lookup table
+ *****************************************************************************/
+void conn_cleanup(void) {
+    int i;
+
+    for (i = 0; i < conn_table_size; i++) {
+        conn_destroy(conn_table[i]);
+    }
+
+    free(conn_table);
+    conn_table = NULL;
+    conn_table_size = 0;
+
+    free(dirty_sockets);
+    dirty_sockets = NULL;
+    dirty_count = 0;
+    dirty_capacity = 0;
+
+    free(failed_sockets);
+    failed_sockets = NULL;
+    failed_count = 0;
+    failed_capacity = 0;
+}
@@ -0,0 +1,383 @@
+/*****************************************************************************
+ * conn.h - Per-connection state (server-side)
+ *
+ * Every accepted client socket gets a Connection that holds everything the
+ * event loop must remember between wakeups, such as a partially received
+ * PDU or output the kernel could not take yet. Client sockets are
+ * non-blocking; connections are looked up by socket descriptor in O(1).
+ *
+ * Output is coalesced: sending a PDU only frames it into the connection's
+ * output queue, and the event loop calls conn_flush_pending() once per
+ * pass, so everything produced for a client during one pass (a whole
+ * player list, or a board update plus game over) leaves in one write.
+ *
+ * Memory per connection is fixed while the client is idle: one Connection
+ * (sizeof(Connection), about 740 bytes on 64-bit builds, almost all of it
+ * the receive buffer) plus an 8-byte conn_table slot per event loop
+ * thread, plus 8 bytes of pollfd with the poll() backend or about 70
+ * bytes of session state with io_uring (epoll keeps its registrations in
+ * the kernel). Output buffers are allocated only while output is queued
+ * and freed as soon as it drains. 100,000 idle clients therefore cost
+ * about 76 MB in the server, on top of the kernel's own per-socket memory.
+ *
+ * Queued output is bounded too (conn_set_output_limits): a client whose
+ * queue passes the per-connection limit is evicted as a slow consumer,
+ * and when all queues together reach the server-wide limit, clients
+ * whose sockets are full are evicted to make room, those not in a game
+ * first. Each thread can only evict its own clients, so it asks the
+ * others to shed theirs too (conn_set_shed_hook). The client being sent
+ * to is only evicted for the server-wide limit if it is a slow consumer
+ * itself; a healthy one gets its output even while the others make room.
+ * An evicted connection drops its queued output at once and is
+ * disconnected like a failed one, with conn->evicted set.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef CONN_H
+#define CONN_H
+
+#include <stdint.h>
+
+#include "pdu.h"
+#include "timer.h"
+
+/* Receive buffer per connection; also the largest PDU accepted from a
+ * client. The largest legal client packet is a Flag 16 search: a flag and
+ * two strings with 1-byte lengths, 2 + 1 + 256 + 256 = 515 bytes framed.
+ * Rounded up to a multiple of 64, this takes any of them whole and still
+ * holds several pipelined game packets (the rest are at most 102 bytes). */
+#define CONN_RECV_SIZE 576
+
+/* State kept for one client connection */
+typedef struct Connection {
+    int socket;
+    PDUReader reader;                     /* Received bytes not yet dispatched */
+    uint8_t recv_buffer[CONN_RECV_SIZE];  /* Backing store for reader */
+    uint8_t *send_buffer;                 /* Output waiting for POLLOUT (NULL if none) */
+    int send_length;                      /* Bytes in send_buffer */
+    int send_offset;                      /* Bytes of send_buffer already written */
+    int send_capacity;                    /* Allocated size of send_buffer */
+    int dirty;                            /* Queued output since the last flush pass */
+    int writable;                         /* 0 after the socket filled up, until POLLOUT */
+    int readable;                         /* Edge-triggered: kernel may hold unread bytes */
+    int ready;                            /* Edge-triggered: on the ready list */
+    int failed;                           /* Set when a write hit a fatal error, or
+                                           * the server gave up on the client */
+    int evicted;                          /* Failed as a slow consumer (output limits) */
+    long output_bytes;                    /* Queued or handed to the output hook, unsent */
+    int stalled;                          /* On a stalled list: 0 = no, 1 = spectators,
+                                           * 2 = players (see conn_shed_output) */
+    struct Connection *stall_prev;        /* Neighbours on that list */
+    struct Connection *stall_next;
+    Timer idle_timer;                     /* Armed by the server for idle timeouts */
+    uint64_t last_input;                  /* When the last packet arrived (timer_now) */
+} Connection;
+
+/* Writes a connection's queued output in place of conn_flush() (see
+ * conn_set_output_hook) */
+typedef void (*ConnOutputHook)(Connection *conn);
+
+/* Takes PDUs for a socket that has no Connection in the calling thread
+ * (see conn_set_remote_hook); returns bytes accepted or -1 */
+typedef int (*ConnRemoteHook)(int socket, PDUSpan *pdus, int count);
+
+/* Says whether a socket's client is in a game, so slow consumers that are
+ * not get evicted first (see conn_set_output_limits); must not block */
+typedef int (*ConnPlayingHook)(int socket);
+
+/* Asks the other threads to run conn_shed_output(needed) on their own
+ * clients (see conn_set_shed_hook); must not block */
+typedef void (*ConnShedHook)(long needed);
+
+/* Output statistics for all threads together, see conn_get_output_stats */
+typedef struct {
+    long buffered;                /* Bytes queued or in flight now */
+    long peak;                    /* Most that were ever buffered at once */
+    unsigned long evicted;        /* Slow consumers evicted */
+} ConnOutputStats;
+
+/* I/O system calls (poll, accept, recv, send, io_uring_enter) made by the
+ * calling thread, for the -s statistics; each backend counts its own */
+extern __thread unsigned long conn_io_syscalls;
+
+/*****************************************************************************
+ * conn_create - Create and register the state for a new client socket
+ *
+ * Also switches the socket to non-blocking mode.
+ *
+ * Parameters:
+ *   socket - The accepted client socket
+ *
+ * Returns:
+ *   The new connection on success
+ *   NULL on memory allocation failure or invalid socket
+ *****************************************************************************/
+Connection *conn_create(int socket);
+
+/*****************************************************************************
+ * conn_get - Look up the connection for a socket
+ *
+ * Returns:
+ *   The connection, or NULL if the socket has none
+ *****************************************************************************/
+Connection *conn_get(int socket);
+
+/*****************************************************************************
+ * conn_send_pdu - Send a PDU to a client without ever blocking
+ *
+ * Works like sendPDU(), but the framed PDU is appended to the connection's
+ * output queue and written by conn_flush_pending() at the end of the
+ * current event loop pass, together with everything else queued for the
+ * same client. Whatever the socket cannot take then is written by
+ * conn_flush() once poll() reports POLLOUT.
+ *
+ * Parameters:
+ *   socket - The client socket to send to
+ *   buffer - Pointer to the data to send (does NOT include length prefix)
+ *   length - The length of the data in buffer
+ *
+ * Returns:
+ *   On success: length + 2 (sent or queued)
+ *   On error: -1 (unknown socket, bad length, out of memory, or the
+ *             connection failed; failed connections have conn->failed set)
+ *****************************************************************************/
+int conn_send_pdu(int socket, uint8_t *buffer, int length);
+
+/*****************************************************************************
+ * conn_send_pdus - Queue several PDUs for a client
+ *
+ * The non-blocking counterpart of sendPDUs(); same queueing as
+ * conn_send_pdu().
+ *
+ * Returns:
+ *   On success: Sum of length + 2 over all PDUs (queued)
+ *   On error: -1 (nothing is queued if any PDU is invalid or too large)
+ *****************************************************************************/
+int conn_send_pdus(int socket, PDUSpan *pdus, int count);
+
+/*****************************************************************************
+ * conn_send_framed - Queue PDUs that already carry their length prefixes
+ *
+ * For replies built once and sent many times (the player list): the bytes
+ * are copied into the output queue as they are. Only for clients of the
+ * calling thread.
+ *
+ * Returns:
+ *   On success: length (queued)
+ *   On error: -1 (unknown socket, out of memory, or the connection failed)
+ *****************************************************************************/
+int conn_send_framed(int socket, const uint8_t *data, int length);
+
+/*****************************************************************************
+ * conn_flush - Write as much queued output as the socket will take
+ *
+ * Returns:
+ *   0 on success (output may still be pending, see conn_has_pending_output)
+ *   -1 if the connection failed
+ *****************************************************************************/
+int conn_flush(Connection *conn);
+
+/*****************************************************************************
+ * conn_mark_writable - Note that poll() reported POLLOUT for a connection
+ *
+ * The queued output is written by the next conn_flush_pending(), together
+ * with anything else produced for the connection in the same pass.
+ *****************************************************************************/
+void conn_mark_writable(Connection *conn);
+
+/*****************************************************************************
+ * conn_set_writable - Set conn->writable from an output hook
+ *
+ * For hooks that clear it while a write is in flight and set it again when
+ * the write completes; keeps the connection on or off the stalled lists
+ * conn_shed_output() evicts from.
+ *****************************************************************************/
+void conn_set_writable(Connection *conn, int writable);
+
+/*****************************************************************************
+ * conn_flush_pending - Flush every connection that queued output this pass
+ *
+ * Call once at the end of each event loop pass. Each connection gets at
+ * most one write; connections whose socket was full are left for POLLOUT,
+ * and connections whose write fails get conn->failed set.
+ *****************************************************************************/
+void conn_flush_pending(void);
+
+/*****************************************************************************
+ * conn_fail - Mark a connection as failed
+ *
+ * Sets conn->failed; the event loop disconnects it after the current
+ * handlers return (see conn_next_failed).
+ *****************************************************************************/
+void conn_fail(Connection *conn);
+
+/*****************************************************************************
+ * conn_next_failed - Collect a connection that failed since the last call
+ *
+ * Lets event loops that only look at active sockets find failed ones
+ * without scanning every connection. Call until it returns -1.
+ *
+ * Returns:
+ *   The socket of a connection that is still registered and failed
+ *   -1 when there are no more
+ *****************************************************************************/
+int conn_next_failed(void);
+
+/*****************************************************************************
+ * conn_set_output_hook - Let an I/O backend take over writing
+ *
+ * With a hook installed, conn_flush_pending() calls hook(conn) for each
+ * writable connection with queued output instead of writing itself. The
+ * hook typically detaches the output with conn_take_output() and clears
+ * conn->writable until its write completes. Pass NULL to restore send().
+ *****************************************************************************/
+void conn_set_output_hook(ConnOutputHook hook);
+
+/*****************************************************************************
+ * conn_set_remote_hook - Forward sends for sockets owned by other threads
+ *
+ * Connections are per thread: conn_get() and conn_create() only see the
+ * calling thread's table, so each event loop thread owns the clients it
+ * accepted. With a hook installed, conn_send_pdu()/conn_send_pdus() to a
+ * socket the calling thread does not own calls hook(socket, pdus, count)
+ * instead of failing. Install it before starting the threads.
+ *****************************************************************************/
+void conn_set_remote_hook(ConnRemoteHook hook);
+
+/*****************************************************************************
+ * conn_take_output - Detach a connection's queued output
+ *
+ * Ownership of the buffer passes to the caller (free() it when done);
+ * output queued afterwards starts a new buffer. The bytes still count
+ * against the output limits until the caller reports them written with
+ * conn_output_sent().
+ *
+ * Parameters:
+ *   conn   - The connection
+ *   length - Set to the number of unwritten bytes
+ *
+ * Returns:
+ *   The buffer holding the unwritten bytes at its start, or NULL if
+ *   nothing is queued
+ *****************************************************************************/
+uint8_t *conn_take_output(Connection *conn, int *length);
+
+/*****************************************************************************
+ * conn_output_sent - Report output taken with conn_take_output() as written
+ *****************************************************************************/
+void conn_output_sent(Connection *conn, int length);
+
+/*****************************************************************************
+ * conn_return_output - Put back output taken with conn_take_output()
+ *
+ * For an output hook that gives up on a write it started: the unwritten
+ * bytes go back in front of whatever was queued since, so the byte stream
+ * stays in order.
+ *
+ * Returns:
+ *   0 on success, -1 if out of memory (the connection is failed)
+ *****************************************************************************/
+int conn_return_output(Connection *conn, const uint8_t *data, int length);
+
+/*****************************************************************************
+ * conn_restore - Give a new connection the buffers of a handed-off one
+ *
+ * Parameters:
+ *   conn          - A connection created with conn_create()
+ *   unread        - Input to dispatch before anything read from the socket
+ *   unread_length - At most CONN_RECV_SIZE
+ *   unsent        - Output to write before anything queued later
+ *   unsent_length - Its length
+ *
+ * Returns:
+ *   0 on success, -1 if the input does not fit or memory ran out
+ *****************************************************************************/
+int conn_restore(Connection *conn, const uint8_t *unread, int unread_length,
+                 const uint8_t *unsent, int unsent_length);
+
+/*****************************************************************************
+ * conn_next - Walk the calling thread's connections
+ *
+ * Start with *cursor = 0; each call returns the next connection, or NULL
+ * after the last one. Destroying the connection just returned is fine.
+ *****************************************************************************/
+Connection *conn_next(int *cursor);
+
+/*****************************************************************************
+ * conn_set_output_limits - Bound the output queued for slow clients
+ *
+ * Install before starting the threads.
+ *
+ * Parameters:
+ *   per_connection - Most bytes one client may have queued (0 = no limit)
+ *   total          - Most bytes all clients together may have queued
+ *                    (0 = no limit)
+ *   playing        - Tells players from other clients (may be NULL)
+ *****************************************************************************/
+void conn_set_output_limits(long per_connection, long total, ConnPlayingHook playing);
+
+/*****************************************************************************
+ * conn_set_shed_hook - Reach the other threads when output is over the limit
+ *
+ * A send that finds the server-wide limit reached evicts the calling
+ * thread's stalled clients first; if that is not enough, it calls
+ * hook(needed) so the threads owning the rest can shed theirs. Each
+ * thread calls it at most once every few milliseconds, not on every send
+ * made while over the limit. Install it before starting the threads.
+ *****************************************************************************/
+void conn_set_shed_hook(ConnShedHook hook);
+
+/*****************************************************************************
+ * conn_shed_output - Evict the calling thread's stalled clients to make room
+ *
+ * Stalled means the socket is full and output is waiting. Each thread
+ * keeps its stalled connections on two lists, clients not in a game and
+ * players, so this only looks at clients it can evict: those not in a
+ * game go first, players only if that was not enough. Stops as soon as
+ * needed more bytes fit under the server-wide limit.
+ *****************************************************************************/
+void conn_shed_output(long needed);
+
+/*****************************************************************************
+ * conn_get_output_stats - Read the output statistics of all threads
+ *****************************************************************************/
+void conn_get_output_stats(ConnOutputStats *stats);
+
+/*****************************************************************************
+ * conn_has_pending_output - Check whether output is waiting for POLLOUT
+ *
+ * Returns:
+ *   1 if bytes are queued
+ *   0 otherwise
+ *****************************************************************************/
+int conn_has_pending_output(Connection *conn);
+
+/*****************************************************************************
+ * conn_has_buffered_pdu - Check whether a complete PDU is waiting in the
+ *                         receive buffer
+ *
+ * This happens when a dispatch pass stopped at its per-wakeup limit; the
+ * kernel has nothing new for the socket, so poll() will not report it.
+ *
+ * Returns:
+ *   1 if at least one complete PDU is buffered
+ *   0 otherwise
+ *****************************************************************************/
+int conn_has_buffered_pdu(Connection *conn);
+
+/*****************************************************************************
+ * conn_destroy - Unregister and free a connection
+ *
+ * Any output still queued is dropped (and stops counting against the
+ * output limits). Does NOT close the socket; the caller still owns the
+ * descriptor.
+ *****************************************************************************/
+void conn_destroy(Connection *conn);
+
+/*****************************************************************************
+ * conn_cleanup - Free every connection and the lookup table
+ *****************************************************************************/
+void conn_cleanup(void);
+
+#endif /* CONN_H */
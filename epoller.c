@@ -0,0 +1,310 @@
+/*****************************************************************************
+ * epoller.c - Edge-triggered epoll backend for the server (Linux only)
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#include "epoller.h"
+#include <stdio.h>
+
+#ifdef __linux__
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "conn.h"
+
+/* Most readiness events taken per epoll_wait() */
+#define EPOLLER_EVENTS 256
+
+/* Per thread, so every reactor can run its own loop */
+static __thread int epoll_fd = -1;
+static __thread const ServerCallbacks *callbacks;
+
+/* The last accept pass stopped at the batch cap, not at EAGAIN */
+static __thread int accept_pending = 0;
+
+/* Clients that may have unread bytes or undispatched PDUs */
+static __thread int *ready = NULL;
+static __thread int ready_count = 0;
+static __thread int ready_capacity = 0;
+
+/* Event data for the wake descriptor (NULL is the listening socket) */
+static char wake_marker;
+
+/*****************************************************************************
+ * epoller_ready_add - Give a client a turn in the next ready pass
+ *****************************************************************************/
+static void epoller_ready_add(Connection *conn) {
+    int *grown;
+    int new_capacity;
+
+    if (conn->ready) {
+        return;
+    }
+
+    if (ready_count == ready_capacity) {
+        new_capacity = ready_capacity ? ready_capacity * 2 : 64;
+        grown = realloc(ready, new_capacity * sizeof(int));
+        if (grown == NULL) {
+            conn_fail(conn);  /* Its edge is consumed; it would hang forever */
+            return;
+        }
+        ready = grown;
+        ready_capacity = new_capacity;
+    }
+
+    ready[ready_count++] = conn->socket;
+    conn->ready = 1;
+}
+
+/*****************************************************************************
+ * epoller_watch - Register a client for both directions
+ *
+ * Returns:
+ *   0 on success, -1 if epoll refused it
+ *****************************************************************************/
+static int epoller_watch(Connection *conn) {
+    struct epoll_event event;
+
+    /* Registered once for both directions; edges say what changed */
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = conn;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->socket, &event) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * epoller_accept - Accept pending connections, up to the batch cap
+ *
+ * The edge fires once per burst, so a pass that stops at the cap leaves
+ * accept_pending set and the loop comes back without waiting.
+ *****************************************************************************/
+static void epoller_accept(int server_socket) {
+    int client_socket;
+    int accepted;
+
+    accept_pending = 0;
+    for (accepted = 0; accepted < callbacks->accept_batch; accepted++) {
+        conn_io_syscalls++;
+        client_socket = accept(server_socket, NULL, NULL);
+        if (client_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+
+        if (callbacks->open_session(client_socket) < 0) {
+            close(client_socket);
+            continue;
+        }
+
+        if (epoller_watch(conn_get(client_socket)) < 0) {
+            callbacks->close_session(client_socket);
+        }
+    }
+
+    accept_pending = 1;
+}
+
+/*****************************************************************************
+ * epoller_serve - Read and dispatch for one client on the ready list
+ *****************************************************************************/
+static void epoller_serve(Connection *conn) {
+    int socket = conn->socket;
+    int space;
+    int received;
+
+    if (conn->readable) {
+        space = conn->reader.size - (conn->reader.end - conn->reader.start);
+
+        conn_io_syscalls++;
+        received = fillPDUReader(socket, &conn->reader);
+        if (received == 0 || received == -1) {
+            callbacks->close_session(socket);
+            return;
+        }
+
+        /* A short read (or EAGAIN) drained the socket; the next byte to
+         * arrive raises a new edge. A full reader leaves it readable. */
+        if ((received == PDU_INCOMPLETE && space > 0) ||
+            (received > 0 && received < space)) {
+            conn->readable = 0;
+        }
+    }
+
+    if (callbacks->client_data(socket) < 0) {
+        callbacks->close_session(socket);
+        return;
+    }
+
+    if (conn->readable || conn_has_buffered_pdu(conn)) {
+        epoller_ready_add(conn);
+    }
+}
+
+/*****************************************************************************
+ * epoller_process_ready - Give every client on the ready list one turn
+ *****************************************************************************/
+static void epoller_process_ready(void) {
+    int count = ready_count;
+    Connection *conn;
+    int i;
+
+    /* Clients re-added during this pass land after count, for next pass */
+    for (i = 0; i < count; i++) {
+        conn = conn_get(ready[i]);
+        if (conn == NULL || !conn->ready) {
+            continue;  /* Disconnected since it was queued */
+        }
+
+        conn->ready = 0;
+        epoller_serve(conn);
+    }
+
+    ready_count -= count;
+    memmove(ready, ready + count, ready_count * sizeof(int));
+}
+
+/*****************************************************************************
+ * epoller_run_server - Serve clients with epoll until *keep_running is 0
+ *****************************************************************************/
+int epoller_run_server(int server_socket, const ServerCallbacks *server_callbacks,
+                       volatile int *keep_running) {
+    struct epoll_event events[EPOLLER_EVENTS];
+    struct epoll_event event;
+    Connection *conn;
+    int listener_ready;
+    int timeout = -1;
+    int cursor = 0;
+    int flags;
+    int count;
+    int socket;
+    int i;
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    callbacks = server_callbacks;
+
+    /* The listener's edge fires once per burst, so accept() must not block */
+    flags = fcntl(server_socket, F_GETFL, 0);
+    fcntl(server_socket, F_SETFL, flags | O_NONBLOCK);
+
+    /* NULL data marks the listening socket */
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &event) < 0) {
+        perror("epoll_ctl");
+        close(epoll_fd);
+        return -1;
+    }
+
+    if (callbacks->wake_fd >= 0) {
+        event.data.ptr = &wake_marker;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, callbacks->wake_fd, &event) < 0) {
+            perror("epoll_ctl");
+            close(epoll_fd);
+            return -1;
+        }
+    }
+
+    /* Clients taken over from another server may have input buffered
+     * already, so each gets a turn right away */
+    while ((conn = conn_next(&cursor)) != NULL) {
+        if (epoller_watch(conn) < 0) {
+            conn_fail(conn);
+            continue;
+        }
+        conn->readable = 1;
+        epoller_ready_add(conn);
+    }
+
+    while (*keep_running) {
+        conn_io_syscalls++;
+        count = epoll_wait(epoll_fd, events, EPOLLER_EVENTS,
+                           ready_count > 0 || accept_pending || callbacks->busy_poll ?
+                           0 : timeout);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        /* Only record what changed; nothing is closed until the ready
+         * pass, so every pointer in this batch stays valid */
+        listener_ready = accept_pending;
+        for (i = 0; i < count; i++) {
+            conn = events[i].data.ptr;
+            if (conn == NULL) {
+                listener_ready = 1;
+                continue;
+            }
+            if (events[i].data.ptr == &wake_marker) {
+                callbacks->wake();
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT) {
+                conn_mark_writable(conn);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                conn->readable = 1;
+                epoller_ready_add(conn);
+            }
+        }
+
+        if (listener_ready) {
+            epoller_accept(server_socket);
+        }
+
+        epoller_process_ready();
+        timeout = timer_run();
+        conn_flush_pending();
+
+        while ((socket = conn_next_failed()) >= 0) {
+            callbacks->close_session(socket);
+        }
+    }
+
+    close(epoll_fd);
+    epoll_fd = -1;
+    free(ready);
+    ready = NULL;
+    ready_count = 0;
+    ready_capacity = 0;
+    accept_pending = 0;
+    return 0;
+}
+
+#else
+
+/*****************************************************************************
+ * epoller_run_server - epoll is Linux only
+ *****************************************************************************/
+int epoller_run_server(int server_socket, const ServerCallbacks *callbacks,
+                       volatile int *keep_running) {
+    (void)server_socket;
+    (void)callbacks;
+    (void)keep_running;
+    return -1;
+}
+
+#endif /* __linux__ */
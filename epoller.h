@@ -0,0 +1,39 @@
+/*****************************************************************************
+ * epoller.h - Edge-triggered epoll backend for the server (Linux only)
+ *
+ * The default event loop on Linux. Every client is registered with epoll
+ * once, for input and output, edge-triggered, with its Connection pointer
+ * in the event's data field. A wakeup therefore reports exactly the
+ * clients that changed state and leads straight to their state, so the
+ * cost of a pass depends on how many clients are active, not on how many
+ * are connected (poll() has to pass and scan the whole array every time).
+ *
+ * Edge-triggered readiness is reported once per change, so the loop keeps
+ * its own ready list of clients that may still have unread bytes or
+ * undispatched PDUs; they get another turn on the next pass, which keeps
+ * the same per-wakeup fairness limit as the poll() loop.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef EPOLLER_H
+#define EPOLLER_H
+
+#include "server.h"
+
+/*****************************************************************************
+ * epoller_run_server - Serve clients with epoll until *keep_running is 0
+ *
+ * Parameters:
+ *   server_socket - The listening socket (switched to non-blocking)
+ *   callbacks     - Server hooks (see server.h)
+ *   keep_running  - Checked after every wakeup; signals interrupt the wait
+ *
+ * Returns:
+ *   0 after a clean shutdown
+ *   -1 if epoll is not available (not Linux), before any client was accepted
+ *****************************************************************************/
+int epoller_run_server(int server_socket, const ServerCallbacks *callbacks,
+                       volatile int *keep_running);
+
+#endif /* EPOLLER_H */
@@ -9,12 +9,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define MAX_GAMES 100
+#include <pthread.h>
 
 /* Game state structure */
 typedef struct {
+    pthread_mutex_t lock; /* Held by whoever is using the game (game_lock) */
     int active;           /* 1 if game is active, 0 if slot is free */
+    int over;             /* 1 once the result is decided (game_finish) */
+    unsigned generation;  /* Bumped every time the slot is reused */
     int x_socket;
     int o_socket;
     uint8_t board[9];     /* 0=empty, 1=X, 2=O */
@@ -40,7 +42,33 @@ static const int win_patterns[8][3] = {
  * game_init - Initialize the game management system
  *****************************************************************************/
 void game_init(void) {
+    int i;
+
     memset(games, 0, sizeof(games));
+    for (i = 0; i < MAX_GAMES; i++) {
+        pthread_mutex_init(&games[i].lock, NULL);
+    }
+}
+
+/*****************************************************************************
+ * game_lock - Take a game's lock
+ *****************************************************************************/
+int game_lock(int game_id) {
+    if (game_id < 0 || game_id >= MAX_GAMES) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&games[game_id].lock);
+    return 0;
+}
+
+/*****************************************************************************
+ * game_unlock - Release a game's lock
+ *****************************************************************************/
+void game_unlock(int game_id) {
+    if (game_id >= 0 && game_id < MAX_GAMES) {
+        pthread_mutex_unlock(&games[game_id].lock);
+    }
 }
 
 /*****************************************************************************
@@ -49,14 +77,19 @@ void game_init(void) {
 int game_create(int x_socket, int o_socket) {
     int i;
 
-    /* Find a free slot */
+    /* Find a free slot; slots only free up under the caller's lock, so
+     * one seen free here stays free */
     for (i = 0; i < MAX_GAMES; i++) {
         if (!games[i].active) {
+            pthread_mutex_lock(&games[i].lock);
             games[i].active = 1;
+            games[i].over = 0;
+            games[i].generation++;
             games[i].x_socket = x_socket;
             games[i].o_socket = o_socket;
             memset(games[i].board, CELL_EMPTY, 9);
             games[i].current_turn = SYMBOL_X;  /* X goes first */
+            pthread_mutex_unlock(&games[i].lock);
             return i;
         }
     }
@@ -64,6 +97,27 @@ int game_create(int x_socket, int o_socket) {
     return -1;  /* No free slots */
 }
 
+/*****************************************************************************
+ * game_restore - Recreate a game in progress in a given slot
+ *****************************************************************************/
+int game_restore(int game_id, int x_socket, int o_socket, const uint8_t *board,
+                 int current_turn) {
+    if (game_id < 0 || game_id >= MAX_GAMES || games[game_id].active) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&games[game_id].lock);
+    games[game_id].active = 1;
+    games[game_id].over = 0;
+    games[game_id].generation++;
+    games[game_id].x_socket = x_socket;
+    games[game_id].o_socket = o_socket;
+    memcpy(games[game_id].board, board, 9);
+    games[game_id].current_turn = current_turn;
+    pthread_mutex_unlock(&games[game_id].lock);
+    return 0;
+}
+
 /*****************************************************************************
  * game_get_by_socket - Get game ID for a player's socket
  *****************************************************************************/
@@ -139,8 +193,9 @@ int game_make_move(int game_id, int socket, int position) {
     int symbol;
     int board_index;
 
-    /* Validate game ID */
-    if (game_id < 0 || game_id >= MAX_GAMES || !games[game_id].active) {
+    /* Validate game ID; a decided game takes no more moves */
+    if (game_id < 0 || game_id >= MAX_GAMES || !games[game_id].active ||
+        games[game_id].over) {
         return -1;
     }
 
@@ -252,6 +307,40 @@ int game_is_draw(int game_id) {
     return 1;  /* Board full, no winner = draw */
 }
 
+/*****************************************************************************
+ * game_finish - Mark a game's result as decided
+ *****************************************************************************/
+int game_finish(int game_id) {
+    if (game_id < 0 || game_id >= MAX_GAMES || !games[game_id].active) {
+        return -1;
+    }
+
+    games[game_id].over = 1;
+    return 0;
+}
+
+/*****************************************************************************
+ * game_is_over - Check whether a game's result is decided
+ *****************************************************************************/
+int game_is_over(int game_id) {
+    if (game_id < 0 || game_id >= MAX_GAMES || !games[game_id].active) {
+        return 0;
+    }
+
+    return games[game_id].over;
+}
+
+/*****************************************************************************
+ * game_get_generation - Get the number that tells reuses of a slot apart
+ *****************************************************************************/
+unsigned game_get_generation(int game_id) {
+    if (game_id < 0 || game_id >= MAX_GAMES) {
+        return 0;
+    }
+
+    return games[game_id].generation;
+}
+
 /*****************************************************************************
  * game_destroy - Remove a game
  *****************************************************************************/
@@ -269,12 +358,16 @@ int game_destroy(int game_id) {
  *****************************************************************************/
 int game_destroy_by_socket(int socket) {
     int game_id = game_get_by_socket(socket);
+    int result;
 
     if (game_id < 0) {
         return -1;
     }
 
-    return game_destroy(game_id);
+    game_lock(game_id);
+    result = game_destroy(game_id);
+    game_unlock(game_id);
+    return result;
 }
 
 /*****************************************************************************
@@ -303,5 +396,10 @@ int game_get_o_socket(int game_id) {
  * game_cleanup - Free all memory used by game management
  *****************************************************************************/
 void game_cleanup(void) {
+    int i;
+
+    for (i = 0; i < MAX_GAMES; i++) {
+        pthread_mutex_destroy(&games[i].lock);
+    }
     memset(games, 0, sizeof(games));
 }
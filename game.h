@@ -4,6 +4,14 @@
  * This module manages active tic-tac-toe games, including board state,
  * turn tracking, move validation, and win/draw detection.
  *
+ * Locking: every game has its own lock, and a caller holds it (game_lock)
+ * around everything it does with that game, so moves in different games
+ * never wait for each other. Creating and destroying games must also be
+ * serialized by the caller (the server does it under its state lock);
+ * game_create() takes the new game's lock itself, game_destroy() expects
+ * the caller to hold it. Which sockets play in which game only changes
+ * then, so game_get_by_socket() is stable under the caller's lock.
+ *
  * Author: Paul Schmitt
  * CPE 464 - Assignment 2
  *****************************************************************************/
@@ -13,6 +21,9 @@
 
 #include <stdint.h>
 
+/* Games that can run at once; game IDs are 0 to MAX_GAMES - 1 */
+#define MAX_GAMES 100
+
 /* Board cell values */
 #define CELL_EMPTY  0
 #define CELL_X      1
@@ -22,7 +33,10 @@
 #define SYMBOL_O    0
 #define SYMBOL_X    1
 
-/* Game result codes */
+/* Game result codes. A forfeit means that player ran out of time on the
+ * move or game clock, or was dropped for not reading its output. A
+ * timeout goes to both players, so each compares it with its own symbol;
+ * a disconnect only goes to the player who is left. */
 #define RESULT_DRAW       0
 #define RESULT_X_WON      1
 #define RESULT_O_WON      2
@@ -36,6 +50,23 @@
  *****************************************************************************/
 void game_init(void);
 
+/*****************************************************************************
+ * game_lock - Take a game's lock
+ *
+ * Parameters:
+ *   game_id - The game ID (the game need not be active)
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if game_id is out of range (nothing was locked)
+ *****************************************************************************/
+int game_lock(int game_id);
+
+/*****************************************************************************
+ * game_unlock - Release a game's lock taken with game_lock()
+ *****************************************************************************/
+void game_unlock(int game_id);
+
 /*****************************************************************************
  * game_create - Create a new game between two players
  *
@@ -49,6 +80,26 @@ void game_init(void);
  *****************************************************************************/
 int game_create(int x_socket, int o_socket);
 
+/*****************************************************************************
+ * game_restore - Recreate a game in progress in a given slot
+ *
+ * Used when a server takes over from another (see handoff.h): game IDs
+ * are known to the clients, so the game keeps its slot.
+ *
+ * Parameters:
+ *   game_id      - The slot the game had
+ *   x_socket     - Socket of player X
+ *   o_socket     - Socket of player O
+ *   board        - The 9 cells
+ *   current_turn - SYMBOL_X or SYMBOL_O
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if game_id is out of range or the slot is taken
+ *****************************************************************************/
+int game_restore(int game_id, int x_socket, int o_socket, const uint8_t *board,
+                 int current_turn);
+
 /*****************************************************************************
  * game_get_by_socket - Get game ID for a player's socket
  *
@@ -110,7 +161,7 @@ int game_is_turn(int game_id, int socket);
  *
  * Returns:
  *   0 on success
- *   -1 if game not found
+ *   -1 if game not found (or already over)
  *   -2 if not player's turn
  *   -3 if position invalid (not 1-9)
  *   -4 if position already occupied
@@ -182,6 +233,40 @@ int game_is_draw(int game_id);
  *****************************************************************************/
 int game_destroy(int game_id);
 
+/*****************************************************************************
+ * game_finish - Mark a game's result as decided
+ *
+ * The game keeps its players and board until game_destroy(), but
+ * game_make_move() rejects any further move.
+ *
+ * Parameters:
+ *   game_id - The game ID
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if game not found
+ *****************************************************************************/
+int game_finish(int game_id);
+
+/*****************************************************************************
+ * game_is_over - Check whether game_finish() was called for a game
+ *
+ * Returns:
+ *   1 if the result is decided, 0 if not (or game not found)
+ *****************************************************************************/
+int game_is_over(int game_id);
+
+/*****************************************************************************
+ * game_get_generation - Get the number that tells reuses of a slot apart
+ *
+ * Game IDs are reused; a caller that lets go of a game's lock and takes
+ * it again compares generations to know it is still the same game.
+ *
+ * Returns:
+ *   The slot's generation (changes on every game_create() into it)
+ *****************************************************************************/
+unsigned game_get_generation(int game_id);
+
 /*****************************************************************************
  * game_destroy_by_socket - Remove any game involving a socket
  *
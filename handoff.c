@@ -0,0 +1,633 @@
+/*****************************************************************************
+ * handoff.c - Passing a running server's clients to its replacement
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#include "handoff.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* The snapshot starts with this, so a stray connection is not mistaken
+ * for a successor's */
+#define HANDOFF_MAGIC 0x54545431  /* "TTT1" */
+
+/* Snapshot bytes per message, and descriptors per message (the kernel
+ * takes at most 253 in one) */
+#define HANDOFF_CHUNK 32768
+#define HANDOFF_FDS_PER_MESSAGE 250
+
+/* Messages on the handoff socket (SOCK_SEQPACKET keeps them apart) */
+typedef enum {
+    HANDOFF_DATA = 1,             /* Next part of the snapshot */
+    HANDOFF_FDS,                  /* Next descriptors, in SCM_RIGHTS */
+    HANDOFF_END                   /* Totals, to check nothing went missing */
+} HandoffMessageType;
+
+typedef struct {
+    uint32_t type;
+    uint32_t count;               /* Snapshot bytes or descriptors that follow */
+} HandoffHeader;
+
+/* Growable buffer the snapshot is written into */
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} HandoffWriter;
+
+/* Cursor over a received snapshot */
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t offset;
+    int failed;
+} HandoffReader;
+
+/*****************************************************************************
+ * handoff_address - Fill in a Unix socket address for path
+ *****************************************************************************/
+static int handoff_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Handoff socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/*****************************************************************************
+ * handoff_listen - Wait for a successor on a Unix socket at path
+ *****************************************************************************/
+int handoff_listen(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (handoff_address(path, &addr) < 0) {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        perror("handoff socket");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*****************************************************************************
+ * handoff_connect - Ask the server listening at path to hand off
+ *****************************************************************************/
+int handoff_connect(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (handoff_address(path, &addr) < 0) {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);  /* Nobody there: start from scratch */
+        return -1;
+    }
+
+    return fd;
+}
+
+/*****************************************************************************
+ * handoff_add_client - Append a client to a state being built
+ *****************************************************************************/
+int handoff_add_client(HandoffState *state, int socket,
+                       const uint8_t *unread, int unread_length,
+                       const uint8_t *unsent, int unsent_length) {
+    HandoffClient *grown;
+    HandoffClient *client;
+    int new_capacity;
+
+    if (state->client_count == state->client_capacity) {
+        new_capacity = state->client_capacity ? state->client_capacity * 2 : 64;
+        grown = realloc(state->clients, new_capacity * sizeof(HandoffClient));
+        if (grown == NULL) {
+            return -1;
+        }
+        state->clients = grown;
+        state->client_capacity = new_capacity;
+    }
+
+    client = &state->clients[state->client_count];
+    client->socket = socket;
+    client->unread_length = unread_length;
+    client->unsent_length = unsent_length;
+    client->unread = malloc(unread_length + 1);
+    client->unsent = malloc(unsent_length + 1);
+    if (client->unread == NULL || client->unsent == NULL) {
+        free(client->unread);
+        free(client->unsent);
+        return -1;
+    }
+    memcpy(client->unread, unread, unread_length);
+    memcpy(client->unsent, unsent, unsent_length);
+
+    state->client_count++;
+    return 0;
+}
+
+/*****************************************************************************
+ * handoff_put - Append bytes to the snapshot
+ *****************************************************************************/
+static void handoff_put(HandoffWriter *writer, const void *data, size_t length) {
+    uint8_t *grown;
+    size_t new_capacity;
+
+    if (writer->failed) {
+        return;
+    }
+
+    if (writer->length + length > writer->capacity) {
+        new_capacity = writer->capacity ? writer->capacity : 4096;
+        while (new_capacity < writer->length + length) {
+            new_capacity *= 2;
+        }
+        grown = realloc(writer->data, new_capacity);
+        if (grown == NULL) {
+            writer->failed = 1;
+            return;
+        }
+        writer->data = grown;
+        writer->capacity = new_capacity;
+    }
+
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+}
+
+/*****************************************************************************
+ * handoff_put_u32 / handoff_put_u64 - Append an integer (host byte order)
+ *****************************************************************************/
+static void handoff_put_u32(HandoffWriter *writer, uint32_t value) {
+    handoff_put(writer, &value, sizeof(value));
+}
+
+static void handoff_put_u64(HandoffWriter *writer, uint64_t value) {
+    handoff_put(writer, &value, sizeof(value));
+}
+
+/*****************************************************************************
+ * handoff_get - Take bytes from the snapshot (zeroes once it ran short)
+ *****************************************************************************/
+static void handoff_get(HandoffReader *reader, void *data, size_t length) {
+    if (reader->failed || reader->length - reader->offset < length) {
+        reader->failed = 1;
+        memset(data, 0, length);
+        return;
+    }
+
+    memcpy(data, reader->data + reader->offset, length);
+    reader->offset += length;
+}
+
+/*****************************************************************************
+ * handoff_get_u32 / handoff_get_u64 - Take an integer from the snapshot
+ *****************************************************************************/
+static uint32_t handoff_get_u32(HandoffReader *reader) {
+    uint32_t value;
+
+    handoff_get(reader, &value, sizeof(value));
+    return value;
+}
+
+static uint64_t handoff_get_u64(HandoffReader *reader) {
+    uint64_t value;
+
+    handoff_get(reader, &value, sizeof(value));
+    return value;
+}
+
+/*****************************************************************************
+ * handoff_encode - Write everything but the descriptors into a snapshot
+ *
+ * Sockets are written as this process's numbers; the receiver matches
+ * them to the descriptors it got by position (listeners, then clients).
+ *****************************************************************************/
+static void handoff_encode(HandoffWriter *writer, const HandoffState *state) {
+    const HandoffClient *client;
+    const HandoffUser *user;
+    const HandoffGame *game;
+    uint8_t length;
+    int i;
+
+    handoff_put_u32(writer, HANDOFF_MAGIC);
+    handoff_put_u32(writer, state->listener_count);
+
+    handoff_put_u32(writer, state->client_count);
+    for (i = 0; i < state->client_count; i++) {
+        client = &state->clients[i];
+        handoff_put_u32(writer, client->socket);
+        handoff_put_u32(writer, client->unread_length);
+        handoff_put(writer, client->unread, client->unread_length);
+        handoff_put_u32(writer, client->unsent_length);
+        handoff_put(writer, client->unsent, client->unsent_length);
+    }
+
+    handoff_put_u32(writer, state->user_count);
+    for (i = 0; i < state->user_count; i++) {
+        user = &state->users[i];
+        length = (uint8_t)strlen(user->username);
+        handoff_put(writer, &length, 1);
+        handoff_put(writer, user->username, length);
+        handoff_put_u32(writer, user->socket);
+        handoff_put_u32(writer, user->state);
+    }
+
+    handoff_put_u32(writer, state->game_count);
+    for (i = 0; i < state->game_count; i++) {
+        game = &state->games[i];
+        handoff_put_u32(writer, game->game_id);
+        handoff_put_u32(writer, game->x_socket);
+        handoff_put_u32(writer, game->o_socket);
+        handoff_put(writer, game->board, 9);
+        handoff_put_u32(writer, game->current_turn);
+        handoff_put_u64(writer, game->move_deadline);
+        handoff_put_u64(writer, game->game_deadline);
+    }
+}
+
+/*****************************************************************************
+ * handoff_send_message - Send one message: a payload, or fd_count fds
+ *****************************************************************************/
+static int handoff_send_message(int channel, uint32_t type, const void *payload,
+                                size_t length, const int *fds, int fd_count) {
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)];
+    HandoffHeader header;
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    header.type = type;
+    header.count = fds != NULL ? (uint32_t)fd_count : (uint32_t)length;
+
+    memset(&msg, 0, sizeof(msg));
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = length;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    if (fds != NULL) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fd_count);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fd_count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fd_count);
+    }
+
+    while (sendmsg(channel, &msg, 0) < 0) {
+        if (errno != EINTR) {
+            perror("handoff sendmsg");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * handoff_send - Send a state and its descriptors to the successor
+ *****************************************************************************/
+int handoff_send(int channel, const HandoffState *state) {
+    HandoffWriter writer = {NULL, 0, 0, 0};
+    uint32_t totals[2];
+    size_t offset;
+    size_t chunk;
+    int *fds;
+    int fd_count = state->listener_count + state->client_count;
+    int count;
+    int i;
+    int result = -1;
+
+    handoff_encode(&writer, state);
+    fds = malloc((fd_count + 1) * sizeof(int));
+    if (writer.failed || fds == NULL) {
+        fprintf(stderr, "handoff: out of memory for the snapshot\n");
+        goto done;
+    }
+
+    for (i = 0; i < state->listener_count; i++) {
+        fds[i] = state->listeners[i];
+    }
+    for (i = 0; i < state->client_count; i++) {
+        fds[state->listener_count + i] = state->clients[i].socket;
+    }
+
+    for (offset = 0; offset < writer.length; offset += chunk) {
+        chunk = writer.length - offset;
+        if (chunk > HANDOFF_CHUNK) {
+            chunk = HANDOFF_CHUNK;
+        }
+        if (handoff_send_message(channel, HANDOFF_DATA, writer.data + offset,
+                                 chunk, NULL, 0) < 0) {
+            goto done;
+        }
+    }
+
+    for (i = 0; i < fd_count; i += count) {
+        count = fd_count - i;
+        if (count > HANDOFF_FDS_PER_MESSAGE) {
+            count = HANDOFF_FDS_PER_MESSAGE;
+        }
+        if (handoff_send_message(channel, HANDOFF_FDS, NULL, 0, fds + i, count) < 0) {
+            goto done;
+        }
+    }
+
+    totals[0] = (uint32_t)writer.length;
+    totals[1] = (uint32_t)fd_count;
+    if (handoff_send_message(channel, HANDOFF_END, totals, sizeof(totals), NULL, 0) < 0) {
+        goto done;
+    }
+    result = 0;
+
+done:
+    free(writer.data);
+    free(fds);
+    return result;
+}
+
+/*****************************************************************************
+ * handoff_decode - Read a snapshot, matching sockets to received fds
+ *****************************************************************************/
+static int handoff_decode(HandoffReader *reader, const int *fds, int fd_count,
+                          HandoffState *state) {
+    int *map = NULL;
+    int map_size = 0;
+    int *grown;
+    uint32_t socket;
+    uint32_t length;
+    uint8_t name_length;
+    HandoffClient *client;
+    HandoffUser *user;
+    HandoffGame *game;
+    int count;
+    int i;
+
+    if (handoff_get_u32(reader) != HANDOFF_MAGIC) {
+        fprintf(stderr, "handoff: not a snapshot from this server\n");
+        return -1;
+    }
+
+    state->listener_count = (int)handoff_get_u32(reader);
+    count = (int)handoff_get_u32(reader);
+    if (reader->failed || state->listener_count < 1 || count < 0 ||
+        state->listener_count + count != fd_count) {
+        fprintf(stderr, "handoff: snapshot does not match the descriptors\n");
+        return -1;
+    }
+
+    state->listeners = malloc(state->listener_count * sizeof(int));
+    state->clients = calloc(count + 1, sizeof(HandoffClient));
+    if (state->listeners == NULL || state->clients == NULL) {
+        return -1;
+    }
+    memcpy(state->listeners, fds, state->listener_count * sizeof(int));
+    state->client_capacity = count + 1;
+
+    /* map[old socket] = the descriptor that arrived for it, or -1 */
+    for (i = 0; i < count && !reader->failed; i++) {
+        client = &state->clients[i];
+        socket = handoff_get_u32(reader);
+        client->socket = fds[state->listener_count + i];
+
+        length = handoff_get_u32(reader);
+        client->unread = malloc(length + 1);
+        client->unread_length = (int)length;
+        if (client->unread != NULL) {
+            handoff_get(reader, client->unread, length);
+        }
+        length = handoff_get_u32(reader);
+        client->unsent = malloc(length + 1);
+        client->unsent_length = (int)length;
+        if (client->unsent != NULL) {
+            handoff_get(reader, client->unsent, length);
+        }
+        state->client_count = i + 1;
+        if (client->unread == NULL || client->unsent == NULL) {
+            reader->failed = 1;
+            break;
+        }
+
+        if ((int)socket >= map_size) {
+            grown = realloc(map, (socket + 1) * sizeof(int));
+            if (grown == NULL) {
+                reader->failed = 1;
+                break;
+            }
+            map = grown;
+            memset(map + map_size, 0xff, (socket + 1 - map_size) * sizeof(int));
+            map_size = socket + 1;
+        }
+        map[socket] = client->socket;
+    }
+
+    count = (int)handoff_get_u32(reader);
+    state->users = calloc(count + 1, sizeof(HandoffUser));
+    if (state->users == NULL) {
+        reader->failed = 1;
+    }
+    for (i = 0; i < count && !reader->failed; i++) {
+        user = &state->users[state->user_count];
+        handoff_get(reader, &name_length, 1);
+        if (name_length > 100) {
+            reader->failed = 1;
+            break;
+        }
+        handoff_get(reader, user->username, name_length);
+        user->username[name_length] = '\0';
+        socket = handoff_get_u32(reader);
+        user->state = (int)handoff_get_u32(reader);
+
+        /* Keep only users whose connection came across */
+        if ((int)socket >= 0 && (int)socket < map_size && map[socket] >= 0) {
+            user->socket = map[socket];
+            state->user_count++;
+        }
+    }
+
+    count = (int)handoff_get_u32(reader);
+    state->games = calloc(count + 1, sizeof(HandoffGame));
+    if (state->games == NULL) {
+        reader->failed = 1;
+    }
+    for (i = 0; i < count && !reader->failed; i++) {
+        game = &state->games[state->game_count];
+        game->game_id = (int)handoff_get_u32(reader);
+        game->x_socket = (int)handoff_get_u32(reader);
+        game->o_socket = (int)handoff_get_u32(reader);
+        handoff_get(reader, game->board, 9);
+        game->current_turn = (int)handoff_get_u32(reader);
+        game->move_deadline = handoff_get_u64(reader);
+        game->game_deadline = handoff_get_u64(reader);
+
+        if (game->x_socket >= 0 && game->x_socket < map_size && map[game->x_socket] >= 0 &&
+            game->o_socket >= 0 && game->o_socket < map_size && map[game->o_socket] >= 0) {
+            game->x_socket = map[game->x_socket];
+            game->o_socket = map[game->o_socket];
+            state->game_count++;
+        }
+    }
+
+    free(map);
+    if (reader->failed) {
+        fprintf(stderr, "handoff: snapshot is truncated\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * handoff_receive - Receive the state sent by handoff_send()
+ *****************************************************************************/
+int handoff_receive(int channel, HandoffState *state) {
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)];
+    uint8_t message[sizeof(HandoffHeader) + HANDOFF_CHUNK];
+    HandoffWriter snapshot = {NULL, 0, 0, 0};
+    HandoffReader reader;
+    HandoffHeader header;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    uint32_t totals[2];
+    int *fds = NULL;
+    int *grown;
+    int fd_count = 0;
+    int received;
+    int count;
+    int done = 0;
+    int i;
+    int result = -1;
+
+    memset(state, 0, sizeof(*state));
+
+    while (!done) {
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = message;
+        iov.iov_len = sizeof(message);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        received = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < (int)sizeof(header)) {
+            fprintf(stderr, "handoff: connection to the old server lost\n");
+            goto done;
+        }
+        memcpy(&header, message, sizeof(header));
+
+        /* Descriptors first, so none leaks whatever the message is */
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            grown = realloc(fds, (fd_count + count) * sizeof(int));
+            if (grown == NULL) {
+                goto done;
+            }
+            fds = grown;
+            memcpy(fds + fd_count, CMSG_DATA(cmsg), count * sizeof(int));
+            fd_count += count;
+        }
+        if (msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) {
+            fprintf(stderr, "handoff: descriptors lost (open file limit too low?)\n");
+            goto done;
+        }
+
+        switch (header.type) {
+            case HANDOFF_DATA:
+                handoff_put(&snapshot, message + sizeof(header), received - sizeof(header));
+                break;
+            case HANDOFF_FDS:
+                break;
+            case HANDOFF_END:
+                if (received < (int)(sizeof(header) + sizeof(totals))) {
+                    goto done;
+                }
+                memcpy(totals, message + sizeof(header), sizeof(totals));
+                if (totals[0] != snapshot.length || (int)totals[1] != fd_count) {
+                    fprintf(stderr, "handoff: snapshot incomplete\n");
+                    goto done;
+                }
+                done = 1;
+                break;
+            default:
+                fprintf(stderr, "handoff: unexpected message %u\n", header.type);
+                goto done;
+        }
+    }
+
+    if (snapshot.failed) {
+        goto done;
+    }
+
+    reader.data = snapshot.data;
+    reader.length = snapshot.length;
+    reader.offset = 0;
+    reader.failed = 0;
+    result = handoff_decode(&reader, fds, fd_count, state);
+
+done:
+    if (result < 0) {
+        for (i = 0; i < fd_count; i++) {
+            close(fds[i]);
+        }
+        handoff_free(state);
+    }
+    free(snapshot.data);
+    free(fds);
+    return result;
+}
+
+/*****************************************************************************
+ * handoff_free - Free a state's arrays (does not close any descriptor)
+ *****************************************************************************/
+void handoff_free(HandoffState *state) {
+    int i;
+
+    for (i = 0; i < state->client_count; i++) {
+        free(state->clients[i].unread);
+        free(state->clients[i].unsent);
+    }
+    free(state->listeners);
+    free(state->clients);
+    free(state->users);
+    free(state->games);
+    memset(state, 0, sizeof(*state));
+}
@@ -0,0 +1,123 @@
+/*****************************************************************************
+ * handoff.h - Passing a running server's clients to its replacement
+ *
+ * A server started with -H path listens for its successor on a Unix
+ * socket at path. A new server started with the same -H connects there
+ * first; the old one stops its event loops, sends the listening sockets
+ * and every client socket across with SCM_RIGHTS, together with a
+ * snapshot of what the clients cannot resend: their unread input and
+ * unsent output, the users table, and the games in progress. Then it
+ * exits without touching the clients, and the new server carries on
+ * where it stopped; clients see a short pause at most.
+ *
+ * The snapshot is only meant for a binary built from the same sources on
+ * the same host (integers go in host byte order, deadlines stay on the
+ * shared monotonic clock).
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+
+/* A client's connection: its socket, and the bytes in flight either way */
+typedef struct {
+    int socket;
+    uint8_t *unread;              /* Received but not yet dispatched */
+    int unread_length;
+    uint8_t *unsent;              /* Queued for the client but not written */
+    int unsent_length;
+} HandoffClient;
+
+/* A logged-in user */
+typedef struct {
+    char username[101];
+    int socket;
+    int state;                    /* A UserState */
+} HandoffUser;
+
+/* A game in progress */
+typedef struct {
+    int game_id;
+    int x_socket;
+    int o_socket;
+    uint8_t board[9];
+    int current_turn;             /* SYMBOL_X or SYMBOL_O */
+    uint64_t move_deadline;       /* timer_now() times, 0 when off */
+    uint64_t game_deadline;
+} HandoffGame;
+
+/* Everything one server hands the next; the arrays are malloc()ed */
+typedef struct {
+    int *listeners;
+    int listener_count;
+    HandoffClient *clients;
+    int client_count;
+    int client_capacity;
+    HandoffUser *users;
+    int user_count;
+    HandoffGame *games;
+    int game_count;
+} HandoffState;
+
+/*****************************************************************************
+ * handoff_listen - Wait for a successor on a Unix socket at path
+ *
+ * Replaces whatever is at path (a socket nobody listens on any more).
+ *
+ * Returns:
+ *   The listening socket, or -1 on failure
+ *****************************************************************************/
+int handoff_listen(const char *path);
+
+/*****************************************************************************
+ * handoff_connect - Ask the server listening at path to hand off
+ *
+ * Returns:
+ *   The connected socket, or -1 if no server is listening there
+ *****************************************************************************/
+int handoff_connect(const char *path);
+
+/*****************************************************************************
+ * handoff_add_client - Append a client to a state being built
+ *
+ * The client's buffers are copied.
+ *
+ * Returns:
+ *   0 on success, -1 if out of memory
+ *****************************************************************************/
+int handoff_add_client(HandoffState *state, int socket,
+                       const uint8_t *unread, int unread_length,
+                       const uint8_t *unsent, int unsent_length);
+
+/*****************************************************************************
+ * handoff_send - Send a state and its descriptors to the successor
+ *
+ * Parameters:
+ *   channel - The accepted handoff connection
+ *   state   - Listeners, clients, users and games to hand over
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *****************************************************************************/
+int handoff_send(int channel, const HandoffState *state);
+
+/*****************************************************************************
+ * handoff_receive - Receive the state sent by handoff_send()
+ *
+ * Every socket number in the result (listeners, clients, users, games)
+ * is already the descriptor this process received for it.
+ *
+ * Returns:
+ *   0 on success, -1 on failure (received descriptors are closed)
+ *****************************************************************************/
+int handoff_receive(int channel, HandoffState *state);
+
+/*****************************************************************************
+ * handoff_free - Free a state's arrays (does not close any descriptor)
+ *****************************************************************************/
+void handoff_free(HandoffState *state);
+
+#endif /* HANDOFF_H */
@@ -0,0 +1,342 @@
+/*****************************************************************************
+ * names.c - Interned username store implementation
+ *
+ * Names live in an array indexed by NameId, each text in its own exact
+ * size allocation so it never moves. An open-addressing hash table with
+ * linear probing finds a name's id from its bytes; a released name leaves
+ * a tombstone so probes for later names keep going.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#include "names.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* One interned name; text is NULL while the id is free */
+typedef struct {
+    char *text;
+    uint32_t hash;
+    uint32_t refs;
+    uint32_t next_free;           /* Next free id, while this one is free */
+    uint8_t length;
+} NameEntry;
+
+/* Hash table of ids (0 = never used) */
+typedef struct {
+    NameId *slots;
+    int capacity;                 /* Power of two, 0 when not allocated */
+    int used;                     /* Live entries plus tombstones */
+} NameTable;
+
+#define NAMES_MIN_CAPACITY 64
+
+/* Slots moved out of old_table per lookup while a resize runs, so no
+ * single login pays for rehashing every name */
+#define NAMES_MIGRATE_STEP 16
+
+#define TOMBSTONE 0xffffffffu
+
+/* Entry 0 is never used, so 0 can mean no name */
+static NameEntry *entries = NULL;
+static uint32_t entry_count = 0;
+static uint32_t entry_capacity = 0;
+static uint32_t free_ids = 0;
+static int live_names = 0;
+
+/* New ids go in table. After a resize, old_table holds the ids not moved
+ * over yet (from slot migrate_next on) and is searched too. */
+static NameTable table;
+static NameTable old_table;
+static int migrate_next = 0;
+
+/*****************************************************************************
+ * names_hash - FNV-1a hash of a name
+ *****************************************************************************/
+static uint32_t names_hash(const char *name, int length) {
+    uint32_t hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*****************************************************************************
+ * names_slot - Find a name's slot in a table
+ *
+ * Returns:
+ *   The slot index, or -1 if the table does not hold the name
+ *****************************************************************************/
+static int names_slot(const NameTable *t, const char *name, int length, uint32_t hash) {
+    int mask = t->capacity - 1;
+    NameEntry *entry;
+    int i;
+
+    if (t->capacity == 0) {
+        return -1;
+    }
+
+    for (i = hash & mask; t->slots[i] != 0; i = (i + 1) & mask) {
+        if (t->slots[i] == TOMBSTONE) {
+            continue;
+        }
+        entry = &entries[t->slots[i]];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->text, name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*****************************************************************************
+ * names_place - Put an id in the first free slot of its probe sequence
+ *
+ * The caller made sure the name is not in the table and there is room.
+ *****************************************************************************/
+static void names_place(NameTable *t, NameId id) {
+    int mask = t->capacity - 1;
+    int i = entries[id].hash & mask;
+
+    while (t->slots[i] != 0 && t->slots[i] != TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (t->slots[i] == 0) {
+        t->used++;
+    }
+    t->slots[i] = id;
+}
+
+/*****************************************************************************
+ * names_migrate - Move up to count slots of old_table into table
+ *****************************************************************************/
+static void names_migrate(int count) {
+    NameId id;
+
+    /* A moved slot becomes a tombstone, so old_table only ever holds ids
+     * that are not in table and releasing a name clears its one slot */
+    while (count-- > 0 && migrate_next < old_table.capacity) {
+        id = old_table.slots[migrate_next++];
+        if (id != 0 && id != TOMBSTONE) {
+            names_place(&table, id);
+            old_table.slots[migrate_next - 1] = TOMBSTONE;
+        }
+    }
+
+    if (old_table.capacity > 0 && migrate_next == old_table.capacity) {
+        free(old_table.slots);
+        memset(&old_table, 0, sizeof(old_table));
+        migrate_next = 0;
+    }
+}
+
+/*****************************************************************************
+ * names_reserve - Make room in table for one more name
+ *
+ * At 3/4 full (tombstones included), ids start moving to a new table:
+ * twice the size if at least half the names are live, else the same size
+ * (which only clears tombstones). Returns -1 if out of memory.
+ *****************************************************************************/
+static int names_reserve(void) {
+    NameId *slots;
+    int capacity;
+
+    if (table.capacity > 0 && (table.used + 1) * 4 <= table.capacity * 3) {
+        return 0;
+    }
+
+    /* The previous resize is always done long before this, but finish it
+     * rather than juggle three tables */
+    names_migrate(old_table.capacity);
+
+    capacity = table.capacity ? table.capacity : NAMES_MIN_CAPACITY;
+    if (live_names * 2 >= capacity) {
+        capacity *= 2;
+    }
+    slots = calloc(capacity, sizeof(NameId));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    old_table = table;
+    migrate_next = 0;
+    table.slots = slots;
+    table.capacity = capacity;
+    table.used = 0;
+    return 0;
+}
+
+/*****************************************************************************
+ * names_lookup - Find a name's id, moving a few slots if a resize runs
+ *****************************************************************************/
+static NameId names_lookup(const char *name, int length, uint32_t hash) {
+    int slot;
+
+    names_migrate(NAMES_MIGRATE_STEP);
+
+    slot = names_slot(&table, name, length, hash);
+    if (slot >= 0) {
+        return table.slots[slot];
+    }
+    slot = names_slot(&old_table, name, length, hash);
+    return slot >= 0 ? old_table.slots[slot] : 0;
+}
+
+/*****************************************************************************
+ * names_new_id - Take a free id, growing the entry array if there is none
+ *
+ * Returns 0 if out of memory.
+ *****************************************************************************/
+static NameId names_new_id(void) {
+    NameEntry *grown;
+    uint32_t capacity;
+    NameId id;
+
+    if (free_ids != 0) {
+        id = free_ids;
+        free_ids = entries[id].next_free;
+        return id;
+    }
+
+    if (entry_count == entry_capacity) {
+        capacity = entry_capacity ? entry_capacity * 2 : NAMES_MIN_CAPACITY;
+        grown = realloc(entries, capacity * sizeof(NameEntry));
+        if (grown == NULL) {
+            return 0;
+        }
+        entries = grown;
+        entry_capacity = capacity;
+        if (entry_count == 0) {
+            memset(&entries[0], 0, sizeof(NameEntry));
+            entry_count = 1;  /* Id 0 means no name */
+        }
+    }
+    return entry_count++;
+}
+
+/*****************************************************************************
+ * names_intern - Get the handle for a name, adding it if needed
+ *****************************************************************************/
+NameId names_intern(const char *name, int length) {
+    uint32_t hash;
+    NameId id;
+    char *text;
+
+    if (name == NULL || length < 1 || length > 255) {
+        return 0;
+    }
+
+    hash = names_hash(name, length);
+    id = names_lookup(name, length, hash);
+    if (id != 0) {
+        entries[id].refs++;
+        return id;
+    }
+
+    text = malloc(length + 1);
+    if (text == NULL || names_reserve() < 0) {
+        free(text);
+        return 0;
+    }
+    id = names_new_id();
+    if (id == 0) {
+        free(text);
+        return 0;
+    }
+
+    memcpy(text, name, length);
+    text[length] = '\0';
+    entries[id].text = text;
+    entries[id].hash = hash;
+    entries[id].length = length;
+    entries[id].refs = 1;
+    names_place(&table, id);
+    live_names++;
+    return id;
+}
+
+/*****************************************************************************
+ * names_find - Get the handle for a name without adding it
+ *****************************************************************************/
+NameId names_find(const char *name, int length) {
+    if (name == NULL || length < 1 || length > 255) {
+        return 0;
+    }
+    return names_lookup(name, length, names_hash(name, length));
+}
+
+/*****************************************************************************
+ * names_release - Drop a reference taken by names_intern()
+ *****************************************************************************/
+void names_release(NameId id) {
+    NameEntry *entry;
+    int slot;
+
+    if (id == 0 || id >= entry_count || entries[id].text == NULL) {
+        return;
+    }
+
+    entry = &entries[id];
+    if (--entry->refs > 0) {
+        return;
+    }
+
+    slot = names_slot(&table, entry->text, entry->length, entry->hash);
+    if (slot >= 0) {
+        table.slots[slot] = TOMBSTONE;
+    } else {
+        slot = names_slot(&old_table, entry->text, entry->length, entry->hash);
+        if (slot >= 0) {
+            old_table.slots[slot] = TOMBSTONE;
+        }
+    }
+
+    /* No name has length 0, so a free entry can never match a probe */
+    free(entry->text);
+    entry->text = NULL;
+    entry->hash = 0;
+    entry->length = 0;
+    entry->next_free = free_ids;
+    free_ids = id;
+    live_names--;
+}
+
+/*****************************************************************************
+ * names_string - The name's text, null-terminated
+ *****************************************************************************/
+const char *names_string(NameId id) {
+    return id != 0 && id < entry_count && entries[id].text ? entries[id].text : "";
+}
+
+/*****************************************************************************
+ * names_length - The name's length in bytes
+ *****************************************************************************/
+int names_length(NameId id) {
+    return id != 0 && id < entry_count && entries[id].text ? entries[id].length : 0;
+}
+
+/*****************************************************************************
+ * names_cleanup - Free the store
+ *****************************************************************************/
+void names_cleanup(void) {
+    uint32_t i;
+
+    for (i = 1; i < entry_count; i++) {
+        free(entries[i].text);
+    }
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+    entry_capacity = 0;
+    free_ids = 0;
+    live_names = 0;
+
+    free(table.slots);
+    free(old_table.slots);
+    memset(&table, 0, sizeof(table));
+    memset(&old_table, 0, sizeof(old_table));
+    migrate_next = 0;
+}
@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * names.h - Interned username store (server-side)
+ *
+ * Every name a user logs in with is stored once, together with its length
+ * and hash, and is referred to everywhere else by a NameId. Two handles
+ * name the same user exactly when they are equal, so comparing names is
+ * an integer compare, and a name is hashed once, when it is looked up
+ * from a packet.
+ *
+ * Names are reference counted: names_intern() takes a reference and
+ * names_release() drops it; the name and its id are reused once the last
+ * reference is gone. Not thread safe: the server calls it under the lock
+ * that guards the users table.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <stdint.h>
+
+/* A handle to an interned name; 0 is no name */
+typedef uint32_t NameId;
+
+/*****************************************************************************
+ * names_intern - Get the handle for a name, adding it if needed
+ *
+ * Parameters:
+ *   name   - The name's bytes (need not be null-terminated)
+ *   length - Its length, 1 to 255
+ *
+ * Returns:
+ *   The name's handle, with one more reference, or 0 if out of memory
+ *****************************************************************************/
+NameId names_intern(const char *name, int length);
+
+/*****************************************************************************
+ * names_find - Get the handle for a name without adding it
+ *
+ * Returns:
+ *   The name's handle, or 0 if it is not interned (no reference is taken)
+ *****************************************************************************/
+NameId names_find(const char *name, int length);
+
+/*****************************************************************************
+ * names_release - Drop a reference taken by names_intern()
+ *****************************************************************************/
+void names_release(NameId id);
+
+/*****************************************************************************
+ * names_string - The name's text, null-terminated
+ *
+ * Valid for as long as the name has a reference.
+ *****************************************************************************/
+const char *names_string(NameId id);
+
+/*****************************************************************************
+ * names_length - The name's length in bytes
+ *****************************************************************************/
+int names_length(NameId id);
+
+/*****************************************************************************
+ * names_cleanup - Free the store (every handle becomes invalid)
+ *****************************************************************************/
+void names_cleanup(void);
+
+#endif /* NAMES_H */
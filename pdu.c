@@ -13,66 +13,107 @@
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/uio.h>
+
+/*****************************************************************************
+ * writevAll - Write every byte described by iov, looping on partial writes
+ *
+ * Modifies iov as it goes. Returns 0 on success, -1 on error.
+ *****************************************************************************/
+static int writevAll(int socket, struct iovec *iov, int iovcnt) {
+    ssize_t bytes_sent;
+
+    while (iovcnt > 0) {
+        bytes_sent = writev(socket, iov, iovcnt);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) continue;
+            perror("sendPDU: error sending");
+            return -1;
+        }
+        if (bytes_sent == 0) {
+            /* Connection closed */
+            return -1;
+        }
+
+        /* Skip past everything that was written */
+        while (iovcnt > 0 && (size_t)bytes_sent >= iov->iov_len) {
+            bytes_sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + bytes_sent;
+            iov->iov_len -= bytes_sent;
+        }
+    }
+
+    return 0;
+}
 
 /*****************************************************************************
  * sendPDU - Send a Protocol Data Unit with length prefix
  *****************************************************************************/
 int sendPDU(int socket, uint8_t *buffer, int length) {
+    PDUSpan pdu;
+
+    pdu.buffer = buffer;
+    pdu.length = length;
+    return sendPDUs(socket, &pdu, 1);
+}
+
+/*****************************************************************************
+ * sendPDUs - Send several PDUs with as few system calls as possible
+ *****************************************************************************/
+int sendPDUs(int socket, PDUSpan *pdus, int count) {
+    uint8_t length_bytes[PDU_BATCH_MAX][2];
+    struct iovec iov[2 * PDU_BATCH_MAX];
     uint16_t pdu_length;
-    uint8_t length_bytes[2];
-    int sent = 0;
-    int bytes_sent;
+    int total = 0;
+    int batch;
+    int i;
 
     /* Validate parameters */
-    if (buffer == NULL || length < 0) {
+    if (pdus == NULL || count < 0) {
         return -1;
     }
 
-    /* Check if length would overflow uint16_t */
-    if (length > 65533) {  /* Max: 65535 - 2 bytes for length field */
-        fprintf(stderr, "sendPDU: packet too large (%d bytes)\n", length);
-        return -1;
-    }
-
-    /* Calculate total PDU length (data + 2-byte length field) */
-    pdu_length = length + 2;
-
-    /* Convert length to network byte order */
-    pdu_length = htons(pdu_length);
-    memcpy(length_bytes, &pdu_length, 2);
-
-    /* Send the 2-byte length field first */
-    sent = 0;
-    while (sent < 2) {
-        bytes_sent = send(socket, length_bytes + sent, 2 - sent, 0);
-        if (bytes_sent < 0) {
-            perror("sendPDU: error sending length");
+    for (i = 0; i < count; i++) {
+        if (pdus[i].buffer == NULL || pdus[i].length < 0) {
             return -1;
         }
-        if (bytes_sent == 0) {
-            /* Connection closed */
+
+        /* Check if length would overflow uint16_t */
+        if (pdus[i].length > PDU_MAX_DATA) {  /* Max: 65535 - 2 bytes for length field */
+            fprintf(stderr, "sendPDU: packet too large (%d bytes)\n", pdus[i].length);
             return -1;
         }
-        sent += bytes_sent;
     }
 
-    /* Send the actual data */
-    sent = 0;
-    while (sent < length) {
-        bytes_sent = send(socket, buffer + sent, length - sent, 0);
-        if (bytes_sent < 0) {
-            perror("sendPDU: error sending data");
-            return -1;
+    while (count > 0) {
+        batch = count < PDU_BATCH_MAX ? count : PDU_BATCH_MAX;
+
+        /* Length field (data + 2-byte length field, network order), then data */
+        for (i = 0; i < batch; i++) {
+            pdu_length = htons(pdus[i].length + 2);
+            memcpy(length_bytes[i], &pdu_length, 2);
+
+            iov[2 * i].iov_base = length_bytes[i];
+            iov[2 * i].iov_len = 2;
+            iov[2 * i + 1].iov_base = pdus[i].buffer;
+            iov[2 * i + 1].iov_len = pdus[i].length;
+            total += pdus[i].length + 2;
         }
-        if (bytes_sent == 0) {
-            /* Connection closed */
+
+        if (writevAll(socket, iov, 2 * batch) < 0) {
             return -1;
         }
-        sent += bytes_sent;
+
+        pdus += batch;
+        count -= batch;
     }
 
-    /* Return total bytes sent (length field + data) */
-    return length + 2;
+    /* Return total bytes sent (length fields + data) */
+    return total;
 }
 
 /*****************************************************************************
@@ -150,3 +191,228 @@ int recvPDU(int socket, uint8_t *buffer, int max_length) {
     /* Return number of data bytes received (NOT including length field) */
     return data_length;
 }
+
+/*****************************************************************************
+ * initPDUReader - Prepare a PDUReader for a new connection
+ *****************************************************************************/
+void initPDUReader(PDUReader *reader, uint8_t *buffer, int size) {
+    reader->state = PDU_STATE_HEADER;
+    reader->buffer = buffer;
+    reader->size = size;
+    reader->start = 0;
+    reader->end = 0;
+}
+
+/*****************************************************************************
+ * bufferedState - Classify the unconsumed bytes of a reader
+ *****************************************************************************/
+static PDUState bufferedState(PDUReader *reader) {
+    uint16_t pdu_length;
+    int available = reader->end - reader->start;
+
+    if (available < 2) {
+        return PDU_STATE_HEADER;
+    }
+
+    memcpy(&pdu_length, reader->buffer + reader->start, 2);
+    return available >= ntohs(pdu_length) ? PDU_STATE_COMPLETE : PDU_STATE_BODY;
+}
+
+/*****************************************************************************
+ * fillPDUReader - Read whatever the kernel has for a socket, without blocking
+ *****************************************************************************/
+int fillPDUReader(int socket, PDUReader *reader) {
+    int bytes_received;
+
+    if (reader == NULL || reader->buffer == NULL) {
+        return -1;
+    }
+
+    /* Slide the unconsumed tail to the front to make room */
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start,
+                reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    if (reader->end == reader->size) {
+        return PDU_INCOMPLETE;
+    }
+
+    for (;;) {
+        bytes_received = recv(socket, reader->buffer + reader->end,
+                              reader->size - reader->end, MSG_DONTWAIT);
+        if (bytes_received >= 0) {
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return PDU_INCOMPLETE;
+        }
+        perror("fillPDUReader: error receiving");
+        return -1;
+    }
+
+    if (bytes_received == 0) {
+        /* Connection closed by remote side */
+        return 0;
+    }
+
+    reader->end += bytes_received;
+    reader->state = bufferedState(reader);
+    return bytes_received;
+}
+
+/*****************************************************************************
+ * feedPDUReader - Append bytes that were received some other way
+ *****************************************************************************/
+int feedPDUReader(PDUReader *reader, const uint8_t *data, int length) {
+    int copied;
+
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start,
+                reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    copied = reader->size - reader->end;
+    if (copied > length) {
+        copied = length;
+    }
+
+    memcpy(reader->buffer + reader->end, data, copied);
+    reader->end += copied;
+    reader->state = bufferedState(reader);
+    return copied;
+}
+
+/*****************************************************************************
+ * nextPDU - Take the next complete PDU out of a reader
+ *****************************************************************************/
+int nextPDU(PDUReader *reader, uint8_t **data) {
+    uint16_t pdu_length;
+    int available = reader->end - reader->start;
+
+    if (available < 2) {
+        reader->state = PDU_STATE_HEADER;
+        return PDU_INCOMPLETE;
+    }
+
+    /* Convert length from network byte order to host byte order */
+    memcpy(&pdu_length, reader->buffer + reader->start, 2);
+    pdu_length = ntohs(pdu_length);
+
+    /* An empty PDU carries no flag, so nothing can use it */
+    if (pdu_length <= 2) {
+        fprintf(stderr, "nextPDU: invalid PDU length (%d)\n", pdu_length);
+        return -1;
+    }
+
+    if (pdu_length > reader->size) {
+        fprintf(stderr, "nextPDU: PDU too large (%d bytes, buffer is %d)\n",
+                pdu_length, reader->size);
+        return -1;
+    }
+
+    if (available < pdu_length) {
+        reader->state = PDU_STATE_BODY;
+        return PDU_INCOMPLETE;
+    }
+
+    *data = reader->buffer + reader->start + 2;
+    reader->start += pdu_length;
+    if (reader->start == reader->end) {
+        reader->start = 0;
+        reader->end = 0;
+    }
+
+    reader->state = bufferedState(reader);
+    return pdu_length - 2;
+}
+
+/*****************************************************************************
+ * initPDUView - Point a view at a received PDU
+ *****************************************************************************/
+void initPDUView(PDUView *view, const uint8_t *data, int length) {
+    view->data = data;
+    view->length = length;
+}
+
+/*****************************************************************************
+ * pduFlag - Get the flag (first byte) of a PDU
+ *****************************************************************************/
+int pduFlag(const PDUView *view) {
+    if (view->length < 1) {
+        return -1;
+    }
+
+    return view->data[0];
+}
+
+/*****************************************************************************
+ * pduByte - Read a 1-byte field
+ *****************************************************************************/
+int pduByte(const PDUView *view, int offset, uint8_t *value) {
+    if (offset < 0 || offset >= view->length) {
+        return -1;
+    }
+
+    *value = view->data[offset];
+    return 0;
+}
+
+/*****************************************************************************
+ * pduUint32 - Read a 4-byte integer field sent in network byte order
+ *****************************************************************************/
+int pduUint32(const PDUView *view, int offset, uint32_t *value) {
+    uint32_t net_value;
+
+    if (offset < 0 || offset + 4 > view->length) {
+        return -1;
+    }
+
+    memcpy(&net_value, view->data + offset, 4);
+    *value = ntohl(net_value);
+    return 0;
+}
+
+/*****************************************************************************
+ * pduString - Locate a length-prefixed string without copying it
+ *****************************************************************************/
+int pduString(const PDUView *view, int offset, const char **str, int *len) {
+    uint8_t str_len;
+
+    if (pduByte(view, offset, &str_len) < 0) {
+        return -1;
+    }
+
+    /* Validate the PDU is large enough for the claimed string length */
+    if (offset + 1 + str_len > view->length) {
+        return -1;
+    }
+
+    *str = (const char *)view->data + offset + 1;
+    *len = str_len;
+    return offset + 1 + str_len;
+}
+
+/*****************************************************************************
+ * pduStringCopy - Copy a length-prefixed string out and null-terminate it
+ *****************************************************************************/
+int pduStringCopy(const PDUView *view, int offset, char *dest, int dest_size) {
+    const char *str;
+    int len;
+    int next = pduString(view, offset, &str, &len);
+
+    if (next < 0 || len + 1 > dest_size) {
+        return -1;
+    }
+
+    memcpy(dest, str, len);
+    dest[len] = '\0';
+    return next;
+}
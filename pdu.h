@@ -17,6 +17,57 @@
 
 #include <stdint.h>
 
+/* Largest data length a PDU can carry (65535 minus the 2-byte length field) */
+#define PDU_MAX_DATA 65533
+
+/* Most PDUs sendPDUs() puts into a single gathered write */
+#define PDU_BATCH_MAX 64
+
+/* Returned by fillPDUReader()/nextPDU() when there is nothing to hand out yet */
+#define PDU_INCOMPLETE -2
+
+/* Reassembly states for a PDUReader (what the unconsumed bytes hold) */
+typedef enum {
+    PDU_STATE_HEADER,     /* Waiting for (the rest of) the 2-byte length field */
+    PDU_STATE_BODY,       /* Waiting for (the rest of) the data */
+    PDU_STATE_COMPLETE    /* At least one whole PDU is buffered */
+} PDUState;
+
+/* One PDU's data for sendPDUs() (does NOT include the length prefix) */
+typedef struct {
+    uint8_t *buffer;
+    int length;
+} PDUSpan;
+
+/*
+ * Read-only window onto one received PDU's data (no length prefix).
+ *
+ * A view points straight into the receive buffer it came from, so it is
+ * only valid until that buffer is refilled. All field access goes through
+ * the bounds-checked pdu* accessors below; nothing is copied unless the
+ * caller asks for a copy.
+ */
+typedef struct {
+    const uint8_t *data;
+    int length;
+} PDUView;
+
+/*
+ * Receive buffer and reassembly state for one connection.
+ *
+ * Bytes are read in bulk into buffer[end..size) and PDUs are handed out
+ * from buffer[start..end). Consumed space is reclaimed by sliding the
+ * (at most one partial PDU's worth of) unconsumed bytes back to the front
+ * before the next read, so every PDU is contiguous in the buffer.
+ */
+typedef struct {
+    PDUState state;
+    uint8_t *buffer;      /* Backing store (owned by caller) */
+    int size;             /* Size of buffer; PDUs up to size bytes are accepted */
+    int start;            /* First unconsumed byte */
+    int end;              /* One past the last received byte */
+} PDUReader;
+
 /*****************************************************************************
  * sendPDU - Send a Protocol Data Unit with length prefix
  *
@@ -35,6 +86,8 @@
  * Notes:
  *   - The 2-byte length field contains: length + 2 (includes itself)
  *   - The length is converted to network byte order before sending
+ *   - Length field and data go out in one gathered write (writev), so the
+ *     PDU costs one system call and leaves in one TCP segment
  *   - This function handles partial sends by looping until all data is sent
  *
  * Example:
@@ -45,6 +98,31 @@
  *****************************************************************************/
 int sendPDU(int socket, uint8_t *buffer, int length);
 
+/*****************************************************************************
+ * sendPDUs - Send several PDUs with as few system calls as possible
+ *
+ * Frames every entry of pdus exactly like sendPDU() would and hands them to
+ * the kernel together with gathered writes (one writev per PDU_BATCH_MAX
+ * PDUs), instead of one write per length field and one per data buffer.
+ *
+ * Parameters:
+ *   socket - The socket descriptor to send on
+ *   pdus   - Array of PDUs to send, in order
+ *   count  - Number of entries in pdus
+ *
+ * Returns:
+ *   On success: Total bytes sent (sum of length + 2 over all PDUs)
+ *   On error: -1 (nothing is sent if any PDU is invalid or too large)
+ *
+ * Example:
+ *   uint8_t accept[1] = {2};
+ *   uint8_t done[1] = {13};
+ *   PDUSpan pdus[2] = {{accept, 1}, {done, 1}};
+ *   sendPDUs(socket_fd, pdus, 2);
+ *   // Sends: [0x00, 0x03, 2, 0x00, 0x03, 13] with a single writev()
+ *****************************************************************************/
+int sendPDUs(int socket, PDUSpan *pdus, int count);
+
 /*****************************************************************************
  * recvPDU - Receive a Protocol Data Unit with length prefix
  *
@@ -78,4 +156,168 @@ int sendPDU(int socket, uint8_t *buffer, int length);
  *****************************************************************************/
 int recvPDU(int socket, uint8_t *buffer, int max_length);
 
+/*****************************************************************************
+ * initPDUReader - Prepare a PDUReader for a new connection
+ *
+ * Parameters:
+ *   reader - The reader to initialize
+ *   buffer - Receive buffer (owned by caller)
+ *   size   - Size of buffer, which is also the largest PDU (including the
+ *            2-byte length field) the reader accepts
+ *****************************************************************************/
+void initPDUReader(PDUReader *reader, uint8_t *buffer, int size);
+
+/*****************************************************************************
+ * fillPDUReader - Read whatever the kernel has for a socket, without blocking
+ *
+ * Pulls as many bytes as fit in the reader's free space with one recv(),
+ * so a peer that pipelines many PDUs costs one system call per wakeup
+ * instead of two per PDU. Use nextPDU() to take the complete PDUs out.
+ *
+ * Parameters:
+ *   socket - The socket descriptor to receive from
+ *   reader - Receive state for this socket (see initPDUReader)
+ *
+ * Returns:
+ *   Number of bytes read (> 0)
+ *   PDU_INCOMPLETE if nothing was available or the buffer is full
+ *   0 on disconnect
+ *   -1 on error
+ *
+ * Notes:
+ *   - Uses MSG_DONTWAIT, so it works on blocking and non-blocking sockets
+ *   - Pointers returned by nextPDU() are invalidated by the next fill
+ *****************************************************************************/
+int fillPDUReader(int socket, PDUReader *reader);
+
+/*****************************************************************************
+ * feedPDUReader - Append bytes that were received some other way
+ *
+ * For I/O backends that receive into their own buffers (such as io_uring's
+ * provided buffers): copies as much of data as fits into the reader, after
+ * reclaiming consumed space, exactly as if fillPDUReader() had read it.
+ *
+ * Parameters:
+ *   reader - Receive state for the connection
+ *   data   - Received bytes
+ *   length - Number of received bytes
+ *
+ * Returns:
+ *   Number of bytes copied (less than length if the reader is full; take
+ *   PDUs out with nextPDU() and feed the rest again)
+ *****************************************************************************/
+int feedPDUReader(PDUReader *reader, const uint8_t *data, int length);
+
+/*****************************************************************************
+ * nextPDU - Take the next complete PDU out of a reader
+ *
+ * Parameters:
+ *   reader - Receive state filled by fillPDUReader()
+ *   data   - Set to the first data byte of the PDU (inside reader->buffer)
+ *
+ * Returns:
+ *   Number of data bytes (> 0, NOT including the 2-byte length field)
+ *   PDU_INCOMPLETE if the next PDU has not fully arrived
+ *   -1 if the next PDU is empty or larger than the reader accepts
+ *
+ * Notes:
+ *   - Does NOT copy or null-terminate the data
+ *   - Call repeatedly until PDU_INCOMPLETE to drain everything buffered
+ *
+ * Example:
+ *   if (fillPDUReader(socket_fd, &reader) == 0) { ... peer closed ... }
+ *   while ((len = nextPDU(&reader, &data)) > 0) {
+ *       uint8_t flag = data[0];
+ *   }
+ *****************************************************************************/
+int nextPDU(PDUReader *reader, uint8_t **data);
+
+/*****************************************************************************
+ * initPDUView - Point a view at a received PDU
+ *
+ * Parameters:
+ *   view   - The view to initialize
+ *   data   - First data byte of the PDU (e.g. as returned by nextPDU)
+ *   length - Number of data bytes
+ *****************************************************************************/
+void initPDUView(PDUView *view, const uint8_t *data, int length);
+
+/*****************************************************************************
+ * pduFlag - Get the flag (first byte) of a PDU
+ *
+ * Returns:
+ *   The flag (0-255)
+ *   -1 if the PDU is empty
+ *****************************************************************************/
+int pduFlag(const PDUView *view);
+
+/*****************************************************************************
+ * pduByte - Read a 1-byte field
+ *
+ * Parameters:
+ *   view   - The PDU
+ *   offset - Offset of the field within the data
+ *   value  - Where to store the field
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if the field lies outside the PDU
+ *****************************************************************************/
+int pduByte(const PDUView *view, int offset, uint8_t *value);
+
+/*****************************************************************************
+ * pduUint32 - Read a 4-byte integer field sent in network byte order
+ *
+ * Parameters:
+ *   view   - The PDU
+ *   offset - Offset of the field within the data
+ *   value  - Where to store the field (in host byte order)
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if the field lies outside the PDU
+ *****************************************************************************/
+int pduUint32(const PDUView *view, int offset, uint32_t *value);
+
+/*****************************************************************************
+ * pduString - Locate a length-prefixed string without copying it
+ *
+ * The field is a 1-byte length N followed by N bytes of text (NOT
+ * null-terminated), the layout used for usernames throughout the protocol.
+ *
+ * Parameters:
+ *   view   - The PDU
+ *   offset - Offset of the length byte within the data
+ *   str    - Set to the first text byte (inside the PDU)
+ *   len    - Set to N
+ *
+ * Returns:
+ *   Offset of the first byte after the string on success
+ *   -1 if the string runs past the end of the PDU
+ *
+ * Example:
+ *   const char *name;
+ *   int name_len;
+ *   int next = pduString(&view, 1, &name, &name_len);
+ *   if (next < 0) return;  // Malformed packet
+ *****************************************************************************/
+int pduString(const PDUView *view, int offset, const char **str, int *len);
+
+/*****************************************************************************
+ * pduStringCopy - Copy a length-prefixed string out and null-terminate it
+ *
+ * For callers that must keep the string or pass it to C string functions.
+ *
+ * Parameters:
+ *   view      - The PDU
+ *   offset    - Offset of the length byte within the data
+ *   dest      - Destination buffer
+ *   dest_size - Size of dest (must hold the text plus the terminator)
+ *
+ * Returns:
+ *   Offset of the first byte after the string on success
+ *   -1 if the string runs past the end of the PDU or does not fit in dest
+ *****************************************************************************/
+int pduStringCopy(const PDUView *view, int offset, char *dest, int dest_size);
+
 #endif /* PDU_H */
@@ -0,0 +1,346 @@
+/*****************************************************************************
+ * reactor.c - Multiple event loop threads implementation
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#include "reactor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "conn.h"
+
+/* PDUs for one client, framed as [2-byte length][data] in host order */
+typedef struct ReactorMessage {
+    struct ReactorMessage *next;
+    int socket;
+    uint64_t route;       /* routes[socket] when it was sent */
+    int length;
+    uint8_t data[];
+} ReactorMessage;
+
+/* One reactor's mailbox: a lock-free stack that any thread pushes onto
+ * and only the owner takes, whole, with an atomic exchange */
+typedef struct {
+    ReactorMessage *head; /* Newest first */
+    long shed_needed;     /* Bytes another reactor needs shed, 0 = none */
+    int wake_fd;          /* Read side: eventfd, or the read end of a pipe */
+    int wake_write_fd;    /* Same eventfd, or the write end of the pipe */
+} Reactor;
+
+static Reactor *reactors = NULL;
+static int reactor_total = 0;
+
+/* Per socket: (session id << 16) | (owning reactor + 1), 0 when unowned */
+static uint64_t *routes = NULL;
+static int routes_size = 0;
+static uint64_t next_session_id = 1;
+
+/* Reactor the calling thread runs */
+static __thread int current = 0;
+
+/*****************************************************************************
+ * reactor_open_wake - Create a reactor's wake descriptor(s)
+ *****************************************************************************/
+static int reactor_open_wake(Reactor *reactor) {
+#ifdef __linux__
+    reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->wake_fd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    reactor->wake_write_fd = reactor->wake_fd;
+#else
+    int fds[2];
+
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+    reactor->wake_fd = fds[0];
+    reactor->wake_write_fd = fds[1];
+#endif
+    return 0;
+}
+
+/*****************************************************************************
+ * reactor_wake - Make a reactor's wake descriptor readable
+ *****************************************************************************/
+static void reactor_wake(Reactor *reactor) {
+    uint64_t one = 1;
+
+    /* A full pipe or eventfd counter is already readable, so EAGAIN is fine */
+    while (write(reactor->wake_write_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+/*****************************************************************************
+ * reactor_post - Send PDUs to a client owned by another reactor
+ *
+ * Installed as conn.c's remote hook, so conn_send_pdus() ends up here for
+ * every socket the calling reactor does not own.
+ *****************************************************************************/
+static int reactor_post(int socket, PDUSpan *pdus, int count) {
+    ReactorMessage *message;
+    ReactorMessage *head;
+    Reactor *owner;
+    uint64_t route;
+    uint16_t pdu_length;
+    int length = 0;
+    int offset;
+    int i;
+
+    if (socket < 0 || socket >= routes_size) {
+        return -1;
+    }
+
+    route = __atomic_load_n(&routes[socket], __ATOMIC_ACQUIRE);
+    if (route == 0 || (int)(route & 0xffff) - 1 == current) {
+        return -1;  /* Nobody owns it, or it is ours and already gone */
+    }
+    owner = &reactors[(route & 0xffff) - 1];
+
+    for (i = 0; i < count; i++) {
+        length += 2 + pdus[i].length;
+    }
+
+    message = malloc(sizeof(ReactorMessage) + length);
+    if (message == NULL) {
+        fprintf(stderr, "reactor_post: out of memory\n");
+        return -1;
+    }
+
+    message->next = NULL;
+    message->socket = socket;
+    message->route = route;
+    message->length = length;
+    offset = 0;
+    for (i = 0; i < count; i++) {
+        pdu_length = (uint16_t)pdus[i].length;
+        memcpy(message->data + offset, &pdu_length, 2);
+        memcpy(message->data + offset + 2, pdus[i].buffer, pdus[i].length);
+        offset += 2 + pdus[i].length;
+    }
+
+    /* Push; the release makes the message's contents visible to the
+     * owner's acquiring exchange in reactor_drain() */
+    head = __atomic_load_n(&owner->head, __ATOMIC_RELAXED);
+    do {
+        message->next = head;
+    } while (!__atomic_compare_exchange_n(&owner->head, &head, message, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    /* The owner takes the whole list per wakeup, so only the push that
+     * found it empty has to wake it */
+    if (head == NULL) {
+        reactor_wake(owner);
+    }
+
+    return length;
+}
+
+/*****************************************************************************
+ * reactor_request_shed - Ask every other reactor to shed stalled clients
+ *
+ * Installed as conn.c's shed hook: the server-wide output limit counts
+ * every reactor's clients, but each can only evict its own. Requests
+ * merge (the largest wins) until the owner picks them up in
+ * reactor_drain(), so a burst of sends wakes each reactor once.
+ *****************************************************************************/
+static void reactor_request_shed(long needed) {
+    long pending;
+    int i;
+
+    for (i = 0; i < reactor_total; i++) {
+        if (i == current) {
+            continue;
+        }
+
+        pending = __atomic_load_n(&reactors[i].shed_needed, __ATOMIC_RELAXED);
+        while (pending < needed &&
+               !__atomic_compare_exchange_n(&reactors[i].shed_needed, &pending, needed, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+        if (pending == 0) {
+            reactor_wake(&reactors[i]);
+        }
+    }
+}
+
+/*****************************************************************************
+ * reactor_init - Create the mailboxes for count reactors
+ *****************************************************************************/
+int reactor_init(int count, int max_sockets) {
+    int i;
+
+    routes = calloc(max_sockets, sizeof(uint64_t));
+    reactors = calloc(count, sizeof(Reactor));
+    if (routes == NULL || reactors == NULL) {
+        free(routes);
+        free(reactors);
+        routes = NULL;
+        reactors = NULL;
+        return -1;
+    }
+    routes_size = max_sockets;
+
+    for (i = 0; i < count; i++) {
+        reactors[i].wake_fd = -1;
+        reactors[i].wake_write_fd = -1;
+        reactor_total = i + 1;
+        if (count > 1 && reactor_open_wake(&reactors[i]) < 0) {
+            reactor_cleanup();
+            return -1;
+        }
+    }
+
+    if (count > 1) {
+        conn_set_remote_hook(reactor_post);
+        conn_set_shed_hook(reactor_request_shed);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * reactor_enter - Bind the calling thread to reactor index
+ *****************************************************************************/
+void reactor_enter(int index) {
+    current = index;
+}
+
+/*****************************************************************************
+ * reactor_wake_fd - Descriptor that becomes readable when mail arrives
+ *****************************************************************************/
+int reactor_wake_fd(void) {
+    return reactors[current].wake_fd;
+}
+
+/*****************************************************************************
+ * reactor_drain - Deliver everything in the calling reactor's mailbox
+ *****************************************************************************/
+void reactor_drain(void) {
+    Reactor *self = &reactors[current];
+    ReactorMessage *message;
+    ReactorMessage *next;
+    ReactorMessage *ordered = NULL;
+    uint8_t discard[64];
+    uint16_t pdu_length;
+    long needed;
+    int offset;
+
+    /* Reset the wake descriptor before taking the list: anything posted
+     * after this point wakes the reactor again */
+    while (read(self->wake_fd, discard, sizeof(discard)) > 0) {
+    }
+
+    message = __atomic_exchange_n(&self->head, NULL, __ATOMIC_ACQUIRE);
+    needed = __atomic_exchange_n(&self->shed_needed, 0, __ATOMIC_RELAXED);
+
+    /* The stack holds the newest first; reverse it so every client gets
+     * its PDUs in the order they were sent */
+    for (; message != NULL; message = next) {
+        next = message->next;
+        message->next = ordered;
+        ordered = message;
+    }
+
+    for (message = ordered; message != NULL; message = next) {
+        next = message->next;
+
+        /* Still the same client? Only this thread can change the answer */
+        if (__atomic_load_n(&routes[message->socket], __ATOMIC_ACQUIRE) == message->route) {
+            for (offset = 0; offset < message->length; offset += 2 + pdu_length) {
+                memcpy(&pdu_length, message->data + offset, 2);
+                conn_send_pdu(message->socket, message->data + offset + 2, pdu_length);
+            }
+        }
+
+        free(message);
+    }
+
+    /* Shed after delivering, so the mail counts towards what is queued */
+    if (needed > 0) {
+        conn_shed_output(needed);
+    }
+}
+
+/*****************************************************************************
+ * reactor_attach - Route sends for a new client to the calling reactor
+ *****************************************************************************/
+int reactor_attach(int socket) {
+    uint64_t id;
+
+    if (socket < 0 || socket >= routes_size) {
+        return -1;
+    }
+
+    id = __atomic_fetch_add(&next_session_id, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&routes[socket], (id << 16) | (uint64_t)(current + 1), __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*****************************************************************************
+ * reactor_detach - Stop routing sends to a client (before it is closed)
+ *****************************************************************************/
+void reactor_detach(int socket) {
+    if (socket >= 0 && socket < routes_size) {
+        __atomic_store_n(&routes[socket], 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*****************************************************************************
+ * reactor_wake_all - Wake every reactor (used at shutdown)
+ *****************************************************************************/
+void reactor_wake_all(void) {
+    int i;
+
+    for (i = 0; i < reactor_total; i++) {
+        if (reactors[i].wake_write_fd >= 0) {
+            reactor_wake(&reactors[i]);
+        }
+    }
+}
+
+/*****************************************************************************
+ * reactor_cleanup - Free the mailboxes after all reactors have stopped
+ *****************************************************************************/
+void reactor_cleanup(void) {
+    ReactorMessage *message;
+    ReactorMessage *next;
+    int i;
+
+    conn_set_remote_hook(NULL);
+    conn_set_shed_hook(NULL);
+
+    for (i = 0; i < reactor_total; i++) {
+        for (message = reactors[i].head; message != NULL; message = next) {
+            next = message->next;
+            free(message);
+        }
+        if (reactors[i].wake_write_fd >= 0 && reactors[i].wake_write_fd != reactors[i].wake_fd) {
+            close(reactors[i].wake_write_fd);
+        }
+        if (reactors[i].wake_fd >= 0) {
+            close(reactors[i].wake_fd);
+        }
+    }
+
+    free(reactors);
+    free(routes);
+    reactors = NULL;
+    routes = NULL;
+    reactor_total = 0;
+    routes_size = 0;
+}
@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * reactor.h - Multiple event loop threads ("reactors") in one server
+ *
+ * With -t N the server runs N reactors. Each one has its own listening
+ * socket on the shared port (SO_REUSEPORT lets the kernel spread new
+ * connections across them), its own event loop, and its own Connection
+ * table: a client belongs to the reactor that accepted it, and only that
+ * thread ever reads, writes or frees its Connection.
+ *
+ * Handlers still send to other players by socket. When the socket
+ * belongs to another reactor, conn_send_pdus() hands the PDUs to this
+ * module, which copies them into that reactor's mailbox and wakes it
+ * through its wake descriptor (an eventfd on Linux); the owner queues
+ * them on the Connection like any local send. Mailboxes take no lock:
+ * senders push with a compare-and-swap and the owner takes everything
+ * at once with an atomic exchange, so a busy reactor never stalls the
+ * threads sending to it. Each message carries the session id of the client
+ * it was meant for, so it is dropped if that client disconnects and the
+ * descriptor is reused before the message is delivered.
+ *
+ * The mailbox also carries requests to shed output: when the server-wide
+ * output limit is reached, the reactor that hit it asks the others to
+ * evict their own stalled clients (see conn_set_shed_hook).
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+/*****************************************************************************
+ * reactor_init - Create the mailboxes for count reactors
+ *
+ * Must be called before any reactor thread starts.
+ *
+ * Parameters:
+ *   count       - Number of reactors (1 needs no mailboxes at all)
+ *   max_sockets - One more than the highest descriptor a client can get
+ *
+ * Returns:
+ *   0 on success
+ *   -1 on failure (out of memory or descriptors)
+ *****************************************************************************/
+int reactor_init(int count, int max_sockets);
+
+/*****************************************************************************
+ * reactor_enter - Bind the calling thread to reactor index
+ *****************************************************************************/
+void reactor_enter(int index);
+
+/*****************************************************************************
+ * reactor_wake_fd - Descriptor that becomes readable when mail arrives
+ *
+ * Returns:
+ *   The calling reactor's wake descriptor, or -1 with a single reactor
+ *****************************************************************************/
+int reactor_wake_fd(void);
+
+/*****************************************************************************
+ * reactor_drain - Deliver everything in the calling reactor's mailbox
+ *
+ * Called by the backend whenever reactor_wake_fd() is readable. PDUs are
+ * queued on their connections and written at the end of the pass.
+ *****************************************************************************/
+void reactor_drain(void);
+
+/*****************************************************************************
+ * reactor_attach - Route sends for a new client to the calling reactor
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if socket is out of range
+ *****************************************************************************/
+int reactor_attach(int socket);
+
+/*****************************************************************************
+ * reactor_detach - Stop routing sends to a client (before it is closed)
+ *****************************************************************************/
+void reactor_detach(int socket);
+
+/*****************************************************************************
+ * reactor_wake_all - Wake every reactor (used at shutdown)
+ *****************************************************************************/
+void reactor_wake_all(void);
+
+/*****************************************************************************
+ * reactor_cleanup - Free the mailboxes after all reactors have stopped
+ *****************************************************************************/
+void reactor_cleanup(void);
+
+#endif /* REACTOR_H */
@@ -5,22 +5,39 @@
  * CPE 464 - Assignment 2
  *****************************************************************************/
 
+#define _GNU_SOURCE  /* pthread_setaffinity_np() */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <poll.h>
 #include <errno.h>
 #include <signal.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
 
 #include "pdu.h"
+#include "conn.h"
+#include "uring.h"
+#include "epoller.h"
+#include "reactor.h"
+#include "timer.h"
 #include "users.h"
 #include "game.h"
+#include "handoff.h"
+
+#ifndef CPU_SETSIZE
+#define CPU_SETSIZE 1024  /* -P without a Linux cpu_set_t; pinning is a no-op */
+#endif
 
 /* Packet flags - these define the protocol message types */
 #define FLAG_INITIAL_CONN      1   /* Client sends username to connect */
@@ -31,6 +48,10 @@
 #define FLAG_LIST_COUNT        11  /* Server sends player count */
 #define FLAG_LIST_USER         12  /* Server sends one player name */
 #define FLAG_LIST_DONE         13  /* Server signals end of list */
+#define FLAG_LIST_PAGE_REQ     14  /* Client requests a page of the player list */
+#define FLAG_LIST_PAGE         15  /* Server sends a page of player names */
+#define FLAG_LIST_SEARCH_REQ   16  /* Client requests names by prefix, in order */
+#define FLAG_LIST_SEARCH       17  /* Server sends a sorted page of names */
 #define FLAG_GAME_START_REQ    20  /* Client requests to start game */
 #define FLAG_GAME_STARTED      21  /* Server confirms game started */
 #define FLAG_GAME_START_ERR    22  /* Server rejects game start */
@@ -39,28 +60,200 @@
 #define FLAG_MOVE_INVALID      32  /* Server rejects move */
 #define FLAG_GAME_OVER         33  /* Server signals game end */
 
-#define MAX_CLIENTS 100
 #define BUFFER_SIZE 2048
 
+/* Default for -m: clients served at once (see conn.h for memory per client) */
+#define DEFAULT_MAX_CLIENTS 100000
+
+/* Default for -l: pending connections per listener (the kernel caps it at
+ * net.core.somaxconn) */
+#define DEFAULT_LISTEN_BACKLOG 4096
+
+/* Default for -a: connections accepted per listener wakeup */
+#define DEFAULT_ACCEPTS_PER_WAKEUP 64
+
+/* Default for -c: seconds a player has for each move */
+#define DEFAULT_MOVE_SECONDS 120
+
+/* Defaults for -o and -O: output queued for one client (KB) and for all
+ * clients together (MB) before slow readers are evicted */
+#define DEFAULT_OUTPUT_KB_PER_CLIENT 4096
+#define DEFAULT_OUTPUT_MB_TOTAL 256
+
+/* Descriptors kept free for stdio, and for each reactor's listener, wake
+ * descriptor and epoll or io_uring instance */
+#define RESERVED_FDS 16
+#define FDS_PER_REACTOR 4
+
+/* poll() loop layout: listener, wake descriptor, then the clients */
+#define FIRST_CLIENT 2
+
+/* One event loop thread (see reactor.h) */
+typedef struct {
+    int index;
+    int server_socket;            /* Its own listener on the shared port */
+    const char *backend;          /* Requested backend; the one that ran after */
+    pthread_t thread;
+    unsigned long io_syscalls;    /* Its conn_io_syscalls when it stopped */
+    unsigned long moves;          /* Its moves_handled when it stopped */
+} ReactorThread;
+
+/* Default for -b: PDUs dispatched per connection per wakeup */
+#define DEFAULT_PDUS_PER_WAKEUP 16
+
 /* Global flag for graceful shutdown */
 static volatile int keep_running = 1;
 
+/* Fairness cap: a client pipelining many PDUs yields after this many */
+static int pdus_per_wakeup = DEFAULT_PDUS_PER_WAKEUP;
+
+/* Connection limit (-m), and how many clients are connected now (all
+ * reactors together, updated atomically) */
+static int max_clients = DEFAULT_MAX_CLIENTS;
+static int client_count = 0;
+
+/* Event loop threads (-t) */
+static int reactor_threads = 1;
+
+/* Low-latency mode (-B): reactors spin instead of sleeping and replies
+ * skip Nagle's algorithm. Cores the reactors are pinned to (-P), reactor
+ * i on reactor_cpus[i % reactor_cpu_count]; none means unpinned. */
+static int busy_poll = 0;
+static int *reactor_cpus = NULL;
+static int reactor_cpu_count = 0;
+
+/* Listen queue length (-l), and how many connections one wakeup of the
+ * listener accepts before the loop serves its clients again (-a) */
+static int listen_backlog = DEFAULT_LISTEN_BACKLOG;
+static int accepts_per_wakeup = DEFAULT_ACCEPTS_PER_WAKEUP;
+
+/* Connections served and turned away (all reactors, updated atomically) */
+static unsigned long connections_accepted = 0;
+static unsigned long connections_rejected = 0;
+
+/* Time limits in milliseconds, 0 when off: per move (-c), per game (-g),
+ * and without a packet before a client is disconnected (-i) */
+static uint64_t move_time_limit = DEFAULT_MOVE_SECONDS * 1000;
+static uint64_t game_time_limit = 0;
+static uint64_t idle_time_limit = 0;
+
+/* Per game, under its lock: when the player to move forfeits, and when
+ * the whole game runs out (0 = no limit). A move only stores a new
+ * deadline; the game's clock timer finds it when it goes off. */
+static uint64_t move_deadlines[MAX_GAMES];
+static uint64_t game_deadlines[MAX_GAMES];
+
+/* A game's clock, kept by the reactor that started the game; the
+ * generation tells whether the game it was armed for still exists */
+typedef struct {
+    Timer timer;                  /* First, so the Timer is the GameClock */
+    unsigned generation;
+} GameClock;
+
+static __thread GameClock game_clocks[MAX_GAMES];
+
+/* Output limits in bytes, 0 when off: per client (-o) and for all
+ * clients together (-O) */
+static long output_limit_per_client = (long)DEFAULT_OUTPUT_KB_PER_CLIENT * 1024;
+static long output_limit_total = (long)DEFAULT_OUTPUT_MB_TOTAL * 1024 * 1024;
+
+/* Per socket, 1 while its client is in a game; read without locks when
+ * slow consumers are picked for eviction (see socket_playing) */
+static uint8_t *playing = NULL;
+static int playing_size = 0;
+
+/* Guards the users and game tables, which every reactor shares; held
+ * while a packet other than a move is handled and while a client is torn
+ * down (moves only take their game's lock, see game.h) */
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The whole reply to a list request (Flags 11, 12..., 13), framed and
+ * ready to queue, as of users generation list_generation (0 = never
+ * built); under state_lock */
+static uint8_t *list_image = NULL;
+static int list_image_length = 0;
+static int list_image_size = 0;
+static unsigned list_generation = 0;
+
+/* Why the reactors stopped (0 while running); the first to set it wins */
+#define STOP_SHUTDOWN 1
+#define STOP_HANDOFF 2
+static int stop_reason = 0;
+
+/* Handoff to a successor (-H): the control socket's path, the socket a
+ * successor connects to, and the connection of the one that did */
+static const char *handoff_path = NULL;
+static int handoff_socket = -1;
+static int handoff_channel = -1;
+static pthread_t main_thread;
+static int main_reactor_stopped = 0;
+
+/* What a predecessor handed over (listener_count 0 if there was none),
+ * and the clients collected for a successor, under outgoing_lock */
+static HandoffState inherited;
+static HandoffState outgoing;
+static pthread_mutex_t outgoing_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Lines the reactors up around a handoff: all clients are taken over
+ * before any reactor serves, and all reactors stop sending before the
+ * mailboxes are emptied for the last time */
+static pthread_barrier_t reactors_barrier;
+
+/* Moves handled by this reactor, for the -s statistics */
+static __thread unsigned long moves_handled = 0;
+
 /* Function prototypes */
 int setup_server(uint16_t port);
 void run_server(int server_socket);
-void handle_new_connection(int server_socket, struct pollfd *pfds, int *num_fds);
-void handle_client_data(int index, struct pollfd *pfds, int *num_fds);
-void handle_initial_connection(int socket, uint8_t *buffer, int len);
+int raise_fd_limit(void);
+int parse_cpu_list(const char *list);
+void pin_reactor(int index);
+long listen_overflows(void);
+void *reactor_main(void *arg);
+const char *serve_clients(int server_socket, const char *backend);
+void handle_new_connection(int server_socket, struct pollfd **pfds, int *num_fds,
+                           int *capacity);
+int add_poll_client(struct pollfd **pfds, int *num_fds, int *capacity, int socket);
+int handle_client_data(int index, struct pollfd *pfds, int *num_fds);
+void handle_client_output(int index, struct pollfd *pfds);
+int update_poll_events(struct pollfd *pfds, int *num_fds);
+void dispatch_pdu(int socket, uint8_t *buffer, int len);
+void handle_initial_connection(int socket, const PDUView *pdu);
 void handle_list_request(int socket);
-void handle_game_start_request(int socket, uint8_t *buffer, int len);
-void handle_move(int socket, uint8_t *buffer, int len);
+int build_list_image(void);
+int render_list_entry(NameId name, int socket, UserState state, void *arg);
+int export_user(NameId name, int socket, UserState state, void *arg);
+void handle_list_page_request(int socket, const PDUView *pdu);
+void handle_list_search_request(int socket, const PDUView *pdu);
+void handle_game_start_request(int socket, const PDUView *pdu);
+void handle_move(int socket, const PDUView *pdu);
 void send_game_started(int x_socket, int o_socket, int game_id);
 void send_board_update(int game_id, int position, int who_moved);
 void send_game_over(int game_id, int result);
+void release_game(int game_id, unsigned generation);
+void start_game_clock(int game_id);
+uint64_t game_clock_deadline(int game_id);
+void game_clock_expired(Timer *timer);
+void idle_timer_expired(Timer *timer);
 void handle_disconnect(int socket, struct pollfd *pfds, int *num_fds, int index);
+void end_session(int socket);
+int process_client_pdus(int socket);
 void signal_handler(int signum);
-int validate_username(const char *username);
-void send_game_start_error(int socket, uint8_t error_code, const char *opponent_username);
+int validate_username(const char *username, int len);
+int socket_playing(int socket);
+void set_playing(int socket, int value);
+int handing_off(void);
+void *handoff_main(void *arg);
+void wake_handler(int signum);
+void take_over(void);
+void adopt_sessions(int index);
+void export_sessions(void);
+void hand_off(ReactorThread *threads);
+void arm_game_clock(int game_id);
+void send_game_start_error(int socket, uint8_t error_code, const char *opponent_username,
+                           int opponent_len);
+void usage(const char *program);
+int open_session(int socket);
 
 /*****************************************************************************
  * main - Server entry point
@@ -70,38 +263,370 @@ void send_game_start_error(int socket, uint8_t error_code, const char *opponent_
  *****************************************************************************/
 int main(int argc, char *argv[]) {
     uint16_t port = 0;
-    int server_socket;
+    ReactorThread *threads;
+    const char *backend = "epoll";
+    unsigned long io_syscalls = 0;
+    unsigned long moves = 0;
+    long overflows_at_start;
+    ConnOutputStats output;
+    int print_stats = 0;
+    int opt;
+    int i;
 
-    /* Parse command line: optional port number */
-    if (argc == 2) {
-        port = (uint16_t)atoi(argv[1]);
-    } else if (argc != 1) {
-        fprintf(stderr, "Usage: %s [port]\n", argv[0]);
-        exit(1);
+    /* Parse command line: options, then an optional port number */
+    while ((opt = getopt(argc, argv, "a:b:Bc:g:H:i:l:m:o:O:pP:st:u")) != -1) {
+        switch (opt) {
+            case 'a':
+                accepts_per_wakeup = atoi(optarg);
+                if (accepts_per_wakeup < 1) usage(argv[0]);
+                break;
+            case 'b':
+                pdus_per_wakeup = atoi(optarg);
+                if (pdus_per_wakeup < 1) usage(argv[0]);
+                break;
+            case 'B':
+                busy_poll = 1;
+                break;
+            case 'c':
+                move_time_limit = (uint64_t)atoi(optarg) * 1000;
+                if (atoi(optarg) < 0) usage(argv[0]);
+                break;
+            case 'g':
+                game_time_limit = (uint64_t)atoi(optarg) * 1000;
+                if (atoi(optarg) < 0) usage(argv[0]);
+                break;
+            case 'H':
+                handoff_path = optarg;
+                break;
+            case 'i':
+                idle_time_limit = (uint64_t)atoi(optarg) * 1000;
+                if (atoi(optarg) < 0) usage(argv[0]);
+                break;
+            case 'l':
+                listen_backlog = atoi(optarg);
+                if (listen_backlog < 1) usage(argv[0]);
+                break;
+            case 'm':
+                max_clients = atoi(optarg);
+                if (max_clients < 1) usage(argv[0]);
+                break;
+            case 'o':
+                output_limit_per_client = atol(optarg) * 1024;
+                if (atol(optarg) < 0) usage(argv[0]);
+                break;
+            case 'O':
+                output_limit_total = atol(optarg) * 1024 * 1024;
+                if (atol(optarg) < 0) usage(argv[0]);
+                break;
+            case 'p':
+                backend = "poll";
+                break;
+            case 'P':
+                if (parse_cpu_list(optarg) < 0) usage(argv[0]);
+                break;
+            case 's':
+                print_stats = 1;
+                break;
+            case 't':
+                reactor_threads = atoi(optarg);
+                if (reactor_threads < 1 || reactor_threads > 1024) usage(argv[0]);
+                break;
+            case 'u':
+                backend = "io_uring";
+                break;
+            default:
+                usage(argv[0]);
+        }
     }
 
-    /* Setup signal handlers for clean shutdown */
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    if (optind == argc - 1) {
+        port = (uint16_t)atoi(argv[optind]);
+    } else if (optind != argc) {
+        usage(argv[0]);
+    }
+
+    /* Setup signal handlers for clean shutdown; no SA_RESTART, so a
+     * signal always interrupts the wait in either backend */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = wake_handler;
+    sigaction(SIGUSR1, &sa, NULL);
+    main_thread = pthread_self();
+
+    /* A client that vanishes mid-write must not kill the server */
+    signal(SIGPIPE, SIG_IGN);
 
     /* Initialize data structure modules */
     users_init();
     game_init();
 
-    /* Create and configure server socket */
-    server_socket = setup_server(port);
+    /* Make room for max_clients descriptors (or lower max_clients) and
+     * route sends between reactors for every descriptor that can exist */
+    playing_size = raise_fd_limit();
+
+    /* With -H, take over from the server already running there, if any;
+     * every listener it had gets a reactor */
+    if (handoff_path != NULL) {
+        handoff_channel = handoff_connect(handoff_path);
+        if (handoff_channel >= 0) {
+            if (handoff_receive(handoff_channel, &inherited) < 0) {
+                fprintf(stderr, "Takeover failed\n");
+                exit(1);
+            }
+            close(handoff_channel);
+            handoff_channel = -1;
+            if (reactor_threads < inherited.listener_count) {
+                reactor_threads = inherited.listener_count;
+            }
+        }
+    }
+
+    if (reactor_init(reactor_threads, playing_size) < 0) {
+        fprintf(stderr, "Failed to set up %d reactors\n", reactor_threads);
+        exit(1);
+    }
+
+    playing = calloc(playing_size, sizeof(uint8_t));
+    if (playing == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    conn_set_output_limits(output_limit_per_client, output_limit_total, socket_playing);
+    take_over();
+    pthread_barrier_init(&reactors_barrier, NULL, reactor_threads);
+
+    overflows_at_start = listen_overflows();
+
+    threads = calloc(reactor_threads, sizeof(ReactorThread));
+    if (threads == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+
+    /* Create and configure one server socket per reactor, all on the same
+     * port; if the port was auto-assigned, the rest reuse the first's.
+     * Inherited listeners are used as they are; extra reactors share them. */
+    for (i = 0; i < reactor_threads; i++) {
+        threads[i].index = i;
+        threads[i].backend = backend;
+        if (inherited.listener_count == 0) {
+            threads[i].server_socket = setup_server(port);
+        } else if (i < inherited.listener_count) {
+            threads[i].server_socket = inherited.listeners[i];
+        } else {
+            threads[i].server_socket = dup(inherited.listeners[i % inherited.listener_count]);
+        }
+        if (port == 0) {
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            getsockname(threads[i].server_socket, (struct sockaddr *)&addr, &len);
+            port = ntohs(addr.sin_port);
+        }
+    }
+
+    /* Only this thread takes SIGINT/SIGTERM; it wakes the others on exit */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    for (i = 1; i < reactor_threads; i++) {
+        if (pthread_create(&threads[i].thread, NULL, reactor_main, &threads[i]) != 0) {
+            fprintf(stderr, "Failed to start reactor %d\n", i);
+            exit(1);
+        }
+    }
 
-    /* Run main server loop until signal received */
-    run_server(server_socket);
+    /* Wait for a successor (-H), now that everything it takes is set up */
+    if (handoff_path != NULL) {
+        pthread_t handoff_thread;
+
+        if (inherited.listener_count > 0) {
+            printf("Took over %d clients and %d games on port %d\n",
+                   inherited.client_count, inherited.game_count, port);
+        }
+        handoff_socket = handoff_listen(handoff_path);
+        if (handoff_socket < 0 ||
+            pthread_create(&handoff_thread, NULL, handoff_main, NULL) != 0) {
+            fprintf(stderr, "Cannot wait for a successor on %s\n", handoff_path);
+            exit(1);
+        }
+        pthread_detach(handoff_thread);
+    }
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+
+    /* Run reactor 0 here until signal received */
+    reactor_main(&threads[0]);
+    __atomic_store_n(&main_reactor_stopped, 1, __ATOMIC_RELEASE);
+    {
+        int running = 0;  /* Too late for a successor to take over now */
+        __atomic_compare_exchange_n(&stop_reason, &running, STOP_SHUTDOWN, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    keep_running = 0;
+    reactor_wake_all();
+    for (i = 1; i < reactor_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    if (handing_off()) {
+        hand_off(threads);
+    } else if (handoff_socket >= 0) {
+        close(handoff_socket);
+        unlink(handoff_path);
+    }
+
+    if (print_stats) {
+        for (i = 0; i < reactor_threads; i++) {
+            io_syscalls += threads[i].io_syscalls;
+            moves += threads[i].moves;
+        }
+        fprintf(stderr, "%s backend, %d reactor%s: %lu I/O system calls, %lu moves",
+                threads[0].backend, reactor_threads, reactor_threads > 1 ? "s" : "",
+                io_syscalls, moves);
+        if (moves > 0) {
+            fprintf(stderr, " (%.2f per move)", (double)io_syscalls / moves);
+        }
+        fprintf(stderr, "\n");
+
+        fprintf(stderr, "%lu connections accepted, %lu rejected",
+                connections_accepted, connections_rejected);
+        if (overflows_at_start >= 0 && listen_overflows() >= 0) {
+            fprintf(stderr, ", %ld listen queue overflows (whole host)",
+                    listen_overflows() - overflows_at_start);
+        }
+        fprintf(stderr, "\n");
+
+        conn_get_output_stats(&output);
+        fprintf(stderr, "%ld output bytes buffered at exit, %ld at peak, %lu slow clients evicted\n",
+                output.buffered, output.peak, output.evicted);
+    }
 
-    /* Clean shutdown: close socket and free resources */
-    close(server_socket);
+    /* Clean shutdown: close sockets and free resources */
+    for (i = 0; i < reactor_threads; i++) {
+        close(threads[i].server_socket);
+    }
+    free(threads);
+    free(playing);
+    free(reactor_cpus);
+    handoff_free(&inherited);
+    handoff_free(&outgoing);
+    pthread_barrier_destroy(&reactors_barrier);
     users_cleanup();
+    names_cleanup();
+    free(list_image);
     game_cleanup();
+    reactor_cleanup();
 
     return 0;
 }
 
+/*****************************************************************************
+ * reactor_main - Run one reactor's event loop until shutdown
+ *
+ * Connections are per thread, so they are freed here, by their owner.
+ * Clients taken over from a predecessor are set up here too, and on a
+ * handoff each reactor packs its own clients for the successor.
+ *
+ * Parameters:
+ *   arg - The ReactorThread to run
+ *****************************************************************************/
+void *reactor_main(void *arg) {
+    ReactorThread *self = arg;
+
+    reactor_enter(self->index);
+    pin_reactor(self->index);
+    if (inherited.listener_count > 0) {
+        adopt_sessions(self->index);
+        pthread_barrier_wait(&reactors_barrier);
+    }
+
+    self->backend = serve_clients(self->server_socket, self->backend);
+
+    if (handing_off()) {
+        pthread_barrier_wait(&reactors_barrier);
+        reactor_drain();
+        export_sessions();
+    }
+
+    self->io_syscalls = conn_io_syscalls;
+    self->moves = moves_handled;
+    conn_cleanup();
+    return NULL;
+}
+
+/*****************************************************************************
+ * serve_clients - Run the requested backend, falling back if it cannot start
+ *
+ * Each Linux-only backend returns -1 before accepting anyone if it cannot
+ * start, and the next one down takes over: io_uring, then epoll, then the
+ * portable poll().
+ *
+ * Parameters:
+ *   server_socket - This reactor's listening socket
+ *   backend       - "io_uring", "epoll" or "poll"
+ *
+ * Returns:
+ *   The backend that ran
+ *****************************************************************************/
+const char *serve_clients(int server_socket, const char *backend) {
+    ServerCallbacks callbacks = {open_session, process_client_pdus, end_session,
+                                 reactor_wake_fd(), reactor_drain, accepts_per_wakeup,
+                                 busy_poll, handing_off};
+
+    if (strcmp(backend, "io_uring") == 0 &&
+        uring_run_server(server_socket, &callbacks, &keep_running) < 0) {
+        fprintf(stderr, "io_uring unavailable, using epoll\n");
+        backend = "epoll";
+    }
+    if (strcmp(backend, "epoll") == 0 &&
+        epoller_run_server(server_socket, &callbacks, &keep_running) < 0) {
+        backend = "poll";
+    }
+    if (strcmp(backend, "poll") == 0) {
+        run_server(server_socket);
+    }
+
+    return backend;
+}
+
+/*****************************************************************************
+ * usage - Print command line help and exit
+ *****************************************************************************/
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-a accepts_per_wakeup] [-b pdus_per_wakeup] [-B] [-c move_seconds] [-g game_seconds] [-H handoff_socket] [-i idle_seconds] [-l backlog] [-m max_clients] [-o client_kb] [-O total_mb] [-p | -u] [-P cpus] [-s] [-t threads] [port]\n", program);
+    fprintf(stderr, "  -a n  Accept at most n connections per wakeup (default %d)\n",
+            DEFAULT_ACCEPTS_PER_WAKEUP);
+    fprintf(stderr, "  -b n  Handle at most n packets per client per wakeup (default %d)\n",
+            DEFAULT_PDUS_PER_WAKEUP);
+    fprintf(stderr, "  -B    Busy-poll: reactors never sleep, trading a core each for latency\n");
+    fprintf(stderr, "        (also turns off Nagle's algorithm on client sockets)\n");
+    fprintf(stderr, "  -c n  A player who takes over n seconds for a move forfeits (default %d, 0 = off)\n",
+            DEFAULT_MOVE_SECONDS);
+    fprintf(stderr, "  -g n  The player to move forfeits once a game lasts n seconds (default off)\n");
+    fprintf(stderr, "  -H p  Take over from the server waiting at Unix socket p, then wait there\n");
+    fprintf(stderr, "        for a successor to hand everything to (clients stay connected)\n");
+    fprintf(stderr, "  -i n  Disconnect clients that send nothing for n seconds (default off)\n");
+    fprintf(stderr, "  -l n  Queue up to n pending connections per listener (default %d)\n",
+            DEFAULT_LISTEN_BACKLOG);
+    fprintf(stderr, "  -m n  Serve at most n clients at once (default %d)\n",
+            DEFAULT_MAX_CLIENTS);
+    fprintf(stderr, "  -o n  Evict a client with over n KB of output queued (default %d, 0 = off)\n",
+            DEFAULT_OUTPUT_KB_PER_CLIENT);
+    fprintf(stderr, "  -O n  Evict slow clients once all output queued passes n MB (default %d, 0 = off)\n",
+            DEFAULT_OUTPUT_MB_TOTAL);
+    fprintf(stderr, "  -p    Use the portable poll() loop instead of epoll\n");
+    fprintf(stderr, "  -P l  Pin reactor i to the i-th CPU in list l, e.g. 2,3 or 4-7 (wraps around)\n");
+    fprintf(stderr, "  -s    Print I/O system calls per move, connection and output counts at exit\n");
+    fprintf(stderr, "  -t n  Run n event loop threads sharing the port (default 1)\n");
+    fprintf(stderr, "  -u    Use the io_uring backend instead of epoll (Linux only)\n");
+    exit(1);
+}
+
 /*****************************************************************************
  * signal_handler - Handle SIGINT and SIGTERM for graceful shutdown
  *
@@ -110,10 +635,182 @@ int main(int argc, char *argv[]) {
  * server loop to exit gracefully.
  *****************************************************************************/
 void signal_handler(int signum) {
+    int running = 0;
+
     printf("\nReceived signal %d, shutting down gracefully...\n", signum);
+    __atomic_compare_exchange_n(&stop_reason, &running, STOP_SHUTDOWN, 0,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
     keep_running = 0;
 }
 
+/*****************************************************************************
+ * wake_handler - SIGUSR1 does nothing but interrupt the main thread's wait
+ *****************************************************************************/
+void wake_handler(int signum) {
+    (void)signum;
+}
+
+/*****************************************************************************
+ * raise_fd_limit - Make sure max_clients sockets can be open at once
+ *
+ * The default soft limit on open files (often 1024) is far below what the
+ * server is meant to hold, so the soft limit is raised, and the hard limit
+ * too if the process is allowed to. If the limit still falls short,
+ * max_clients is lowered to fit: accept() then never fails for lack of
+ * descriptors, and extra clients are turned away by open_session() instead.
+ *
+ * Returns:
+ *   An upper bound on the descriptors the server will have open, so every
+ *   client socket is below it
+ *****************************************************************************/
+int raise_fd_limit(void) {
+    struct rlimit limit;
+    int reserved = RESERVED_FDS + FDS_PER_REACTOR * reactor_threads;
+    rlim_t wanted = (rlim_t)max_clients + reserved;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0) {
+        perror("getrlimit");
+        return (int)wanted;
+    }
+
+    if (limit.rlim_cur < wanted) {
+        struct rlimit raised = limit;
+
+        raised.rlim_cur = wanted;
+        if (raised.rlim_max != RLIM_INFINITY && raised.rlim_max < wanted) {
+            raised.rlim_max = wanted;  /* Needs privileges; fine if it fails */
+        }
+        if (setrlimit(RLIMIT_NOFILE, &raised) < 0) {
+            raised.rlim_cur = limit.rlim_max;
+            raised.rlim_max = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &raised);
+        }
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    if (limit.rlim_cur < wanted) {
+        max_clients = limit.rlim_cur > (rlim_t)reserved ? (int)(limit.rlim_cur - reserved) : 1;
+        fprintf(stderr, "Open file limit is %lu, serving at most %d clients\n",
+                (unsigned long)limit.rlim_cur, max_clients);
+        return (int)limit.rlim_cur;
+    }
+
+    return (int)wanted;
+}
+
+/*****************************************************************************
+ * parse_cpu_list - Read -P: CPU numbers and ranges, comma separated
+ *
+ * Returns:
+ *   0 on success, -1 if the list is malformed
+ *****************************************************************************/
+int parse_cpu_list(const char *list) {
+    const char *p = list;
+    char *end;
+    long first, last;
+    int *grown;
+
+    reactor_cpu_count = 0;
+    while (*p != '\0') {
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE) return -1;
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= CPU_SETSIZE) return -1;
+        }
+
+        for (; first <= last; first++) {
+            grown = realloc(reactor_cpus, (reactor_cpu_count + 1) * sizeof(int));
+            if (grown == NULL) return -1;
+            reactor_cpus = grown;
+            reactor_cpus[reactor_cpu_count++] = (int)first;
+        }
+
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+
+    return reactor_cpu_count > 0 ? 0 : -1;
+}
+
+/*****************************************************************************
+ * pin_reactor - Bind the calling reactor's thread to its -P core
+ *
+ * A reactor that stays on one core keeps its connections' cache lines and
+ * never waits to be scheduled back in; with -B it should own that core.
+ * Failing to pin (a core outside the process's cpuset) is only a warning.
+ *
+ * Parameters:
+ *   index - The reactor's index
+ *****************************************************************************/
+void pin_reactor(int index) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    int cpu;
+    int err;
+
+    if (reactor_cpu_count == 0) {
+        return;
+    }
+
+    cpu = reactor_cpus[index % reactor_cpu_count];
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0) {
+        fprintf(stderr, "Cannot pin reactor %d to CPU %d: %s\n", index, cpu, strerror(err));
+    }
+#else
+    (void)index;
+#endif
+}
+
+/*****************************************************************************
+ * listen_overflows - Connections the kernel dropped for a full listen queue
+ *
+ * Linux counts these per host, not per socket (TcpExt ListenOverflows in
+ * /proc/net/netstat), so -s prints the change while the server ran.
+ *
+ * Returns:
+ *   The counter's current value, or -1 where it is not available
+ *****************************************************************************/
+long listen_overflows(void) {
+    char names[8192], values[8192];
+    char *name, *value, *name_save, *value_save;
+    long result = -1;
+    FILE *netstat = fopen("/proc/net/netstat", "r");
+
+    if (netstat == NULL) {
+        return -1;
+    }
+
+    /* Lines come in pairs: "TcpExt: Name ...", then "TcpExt: value ..." */
+    while (fgets(names, sizeof(names), netstat) != NULL &&
+           fgets(values, sizeof(values), netstat) != NULL) {
+        if (strncmp(names, "TcpExt:", 7) != 0) {
+            continue;
+        }
+
+        name = strtok_r(names, " \n", &name_save);
+        value = strtok_r(values, " \n", &value_save);
+        while (name != NULL && value != NULL) {
+            if (strcmp(name, "ListenOverflows") == 0) {
+                result = atol(value);
+                break;
+            }
+            name = strtok_r(NULL, " \n", &name_save);
+            value = strtok_r(NULL, " \n", &value_save);
+        }
+        break;
+    }
+
+    fclose(netstat);
+    return result;
+}
+
 /*****************************************************************************
  * TODO: setup_server - Create, bind, and configure the server socket
  *
@@ -124,6 +821,9 @@ void signal_handler(int signum) {
  * 2. Set SO_REUSEADDR socket option to allow quick restarts
  *    - Use setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, ...)
  *    - This prevents "Address already in use" errors
+ *    - With more than one reactor (-t), also set SO_REUSEPORT so each
+ *      reactor can bind its own socket to the port; the kernel spreads
+ *      incoming connections across them
  *
  * 3. Bind the socket to INADDR_ANY and the specified port
  *    - Create a struct sockaddr_in with:
@@ -138,7 +838,8 @@ void signal_handler(int signum) {
  *    - Print the port with: printf("Server is using port %d\n", ntohs(addr.sin_port));
  *
  * 5. Put the socket in listening mode
- *    - Call listen(socket, 10) to allow up to 10 pending connections
+ *    - Call listen(socket, listen_backlog) (-l, 4096 by default) so a
+ *      burst of reconnects queues instead of having its SYNs dropped
  *    - Check for errors and exit(1) if listen fails
  *
  * 6. Return the server socket descriptor
@@ -169,6 +870,14 @@ int setup_server(uint16_t port) {
         exit(1);
     }
 
+    /* Every reactor binds its own listener to the same port */
+    if (reactor_threads > 1 &&
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(sockfd);
+        exit(1);
+    }
+
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
@@ -190,7 +899,7 @@ int setup_server(uint16_t port) {
         printf("Server is using port %d\n", ntohs(addr.sin_port));
     }
 
-    if (listen(sockfd, 10) < 0) {
+    if (listen(sockfd, listen_backlog) < 0) {
         perror("listen");
         close(sockfd);
         exit(1);
@@ -205,33 +914,51 @@ int setup_server(uint16_t port) {
  * This function implements the core server logic using poll() for I/O multiplexing.
  *
  * Implementation steps:
- * 1. Create an array of struct pollfd[MAX_CLIENTS + 1]
+ * 1. Allocate a growable array of struct pollfd (capacity grows as
+ *    clients arrive, up to max_clients + 1 entries)
  *    - Index 0 is always the server socket
- *    - Indices 1..num_fds-1 are client sockets
- *    - Initialize with memset() to zero
+ *    - Index 1 is always the reactor's wake descriptor (-1 with a single
+ *      reactor, which poll() skips)
+ *    - Indices FIRST_CLIENT..num_fds-1 are client sockets
  *
- * 2. Setup the server socket in pfds[0]
+ * 2. Setup the server socket in pfds[0] and the wake descriptor in pfds[1]
  *    - pfds[0].fd = server_socket
  *    - pfds[0].events = POLLIN (wait for incoming data/connections)
- *    - Initialize num_fds = 1
+ *    - pfds[1].fd = reactor_wake_fd(), pfds[1].events = POLLIN
+ *    - Initialize num_fds = FIRST_CLIENT
  *
  * 3. Main loop: while (keep_running)
- *    a. Call poll(pfds, num_fds, -1)
+ *    a. Call poll(pfds, num_fds, timeout)
  *       - This blocks until activity on any socket
- *       - -1 timeout means wait indefinitely
+ *       - timeout is -1 (wait indefinitely) unless a client still has
+ *         complete packets buffered from the last pass, then it is 0
  *       - Returns number of sockets with activity
  *       - If poll() returns < 0, print error and continue
  *
  *    b. Check server socket (pfds[0]) for new connections
  *       - If pfds[0].revents & POLLIN:
- *         - Call handle_new_connection(server_socket, pfds, &num_fds)
+ *         - Call handle_new_connection(server_socket, &pfds, &num_fds, &capacity)
  *
- *    c. Check all client sockets for data
- *       - Loop: for (i = 1; i < num_fds; i++)
- *       - If pfds[i].revents & POLLIN:
+ *    c. If pfds[1] is readable, call reactor_drain() to queue the
+ *       packets other reactors sent to this reactor's clients
+ *
+ *    d. Check all client sockets for data
+ *       - Loop: for (i = FIRST_CLIENT; i < num_fds; i++)
+ *       - If pfds[i].revents & POLLOUT:
+ *         - Call handle_client_output(i, pfds)
+ *       - If pfds[i].revents & POLLIN (or POLLHUP/POLLERR), or the client
+ *         has complete packets left over from the last pass:
  *         - Call handle_client_data(i, pfds, &num_fds)
- *       - Note: handle_client_data might remove a socket from the array,
- *               which could affect num_fds but not the current loop iteration
+ *       - Note: if handle_client_data removes the client, the last entry is
+ *               moved into slot i, so slot i is examined again (i--)
+ *               rather than skipping the moved client for this pass
+ *
+ *    e. Call conn_flush_pending() so every client that got output during
+ *       this pass is written to once, with everything it was sent
+ *
+ *    f. Call update_poll_events(pfds, &num_fds) so only connections with
+ *       queued output wait for POLLOUT; it returns how many clients have
+ *       packets left over, which decides the next poll() timeout
  *
  * Parameters:
  *   server_socket - The listening socket descriptor
@@ -240,35 +967,125 @@ void run_server(int server_socket) {
     /* TODO: Implement this function */
     /* See the function header above for detailed implementation steps */
 
-    struct pollfd pfds[MAX_CLIENTS + 1];
+    int capacity = 64;
+    struct pollfd *pfds = calloc(capacity, sizeof(struct pollfd));
+    if (pfds == NULL) {
+        perror("calloc");
+        return;
+    }
 
-    memset(pfds, 0, sizeof(pfds));
+    /* handle_new_connection() accepts until the queue is empty */
+    fcntl(server_socket, F_SETFL, fcntl(server_socket, F_GETFL, 0) | O_NONBLOCK);
 
     pfds[0].fd = server_socket;
     pfds[0].events = POLLIN;
-    int num_fds = 1;
+    pfds[1].fd = reactor_wake_fd();
+    pfds[1].events = POLLIN;
+    int num_fds = FIRST_CLIENT;
+    int backlogged = 0;
+    int timeout = -1;
+
+    /* Clients taken over from another server may have input buffered
+     * already, so the first poll() does not wait */
+    Connection *conn;
+    int cursor = 0;
+    while ((conn = conn_next(&cursor)) != NULL) {
+        if (add_poll_client(&pfds, &num_fds, &capacity, conn->socket) < 0) {
+            end_session(conn->socket);
+        }
+        backlogged = 1;
+    }
 
     while (keep_running) {
-        int poll_count = poll(pfds, num_fds, -1);
+        conn_io_syscalls++;
+        int poll_count = poll(pfds, num_fds, backlogged || busy_poll ? 0 : timeout);
         if (poll_count < 0) {
             if (errno == EINTR) continue;
             perror("poll");
             break;
         }
 
-        if (pfds[0].revents & POLLIN) handle_new_connection(server_socket, pfds, &num_fds);
+        if (pfds[0].revents & POLLIN) handle_new_connection(server_socket, &pfds, &num_fds, &capacity);
+        if (pfds[1].revents & POLLIN) reactor_drain();
+
+        for (int i = FIRST_CLIENT; i < num_fds; i++) {
+            if (pfds[i].revents & POLLOUT) handle_client_output(i, pfds);
+            if ((pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) ||
+                conn_has_buffered_pdu(conn_get(pfds[i].fd))) {
+                if (handle_client_data(i, pfds, &num_fds) < 0) i--;  /* Slot i was refilled */
+            }
+        }
+
+        timeout = timer_run();
+        conn_flush_pending();
+        backlogged = update_poll_events(pfds, &num_fds);
+    }
+
+    free(pfds);
+}
+
+/*****************************************************************************
+ * handle_client_output - Resume queued output once a client is writable
+ *
+ * Called when poll() reports POLLOUT, which it only does for connections
+ * whose output did not fit in the socket when it was flushed. The write
+ * itself happens in conn_flush_pending() at the end of the pass; a failed
+ * write is cleaned up by update_poll_events().
+ *
+ * Parameters:
+ *   index   - Index in pfds array for this client
+ *   pfds    - Array of poll file descriptors
+ *****************************************************************************/
+void handle_client_output(int index, struct pollfd *pfds) {
+    conn_mark_writable(conn_get(pfds[index].fd));
+}
 
-        for (int i = 1; i < num_fds; i++) {
-            if (pfds[i].revents & POLLIN) handle_client_data(i, pfds, &num_fds);
+/*****************************************************************************
+ * update_poll_events - Recompute what poll() should wait for
+ *
+ * Every client waits for POLLIN; only clients with queued output also wait
+ * for POLLOUT, otherwise poll() would return immediately for every idle
+ * socket. Connections whose writes failed are disconnected here, after the
+ * handlers that hit the failure have returned.
+ *
+ * Parameters:
+ *   pfds    - Array of poll file descriptors
+ *   num_fds - Pointer to number of active file descriptors
+ *
+ * Returns:
+ *   Number of clients with complete packets still buffered
+ *****************************************************************************/
+int update_poll_events(struct pollfd *pfds, int *num_fds) {
+    int backlogged = 0;
+
+    for (int i = FIRST_CLIENT; i < *num_fds; i++) {
+        Connection *conn = conn_get(pfds[i].fd);
+
+        if (conn == NULL || conn->failed) {
+            handle_disconnect(pfds[i].fd, pfds, num_fds, i);
+            i--;  /* The last entry was moved into slot i */
+            continue;
         }
+
+        pfds[i].events = POLLIN | (conn_has_pending_output(conn) ? POLLOUT : 0);
+        if (conn_has_buffered_pdu(conn)) backlogged++;
     }
+
+    // the scan above already dropped every failed connection, this just
+    // empties conn.c's list of them
+    conn_next_failed();
+
+    return backlogged;
 }
 
 /*****************************************************************************
- * TODO: handle_new_connection - Accept a new client connection
+ * TODO: handle_new_connection - Accept new client connections
  *
  * This function is called when poll() detects activity on the server socket,
- * indicating a client is trying to connect.
+ * indicating clients are trying to connect. The listener is non-blocking,
+ * so it repeats steps 1-4 until the queue is empty or accepts_per_wakeup
+ * (-a) clients were taken; anything left over makes poll() return at once
+ * on the next pass, after the connected clients have had their turn.
  *
  * Implementation steps:
  * 1. Prepare for accept()
@@ -278,17 +1095,18 @@ void run_server(int server_socket) {
  * 2. Accept the connection
  *    - Call accept(server_socket, (struct sockaddr *)&client_addr, &addr_len)
  *    - This creates a new socket for communicating with this client
- *    - If accept() returns < 0, print error with perror("accept") and return
- *
- * 3. Add the new client socket to the poll array
- *    - Check if there's room: if (*num_fds < MAX_CLIENTS + 1)
- *    - If yes:
- *      - pfds[*num_fds].fd = client_socket
- *      - pfds[*num_fds].events = POLLIN
- *      - (*num_fds)++
- *    - If no room:
- *      - Print "Too many clients\n" to stderr
- *      - close(client_socket) to reject the connection
+ *    - If accept() returns < 0 with EAGAIN the queue is empty: return;
+ *      for any other error print it with perror("accept") and return
+ *
+ * 3. Set up the session with open_session(client_socket)
+ *    - It turns the client away once max_clients are connected
+ *    - If it fails, close(client_socket) to reject the connection
+ *
+ * 4. Add the new client socket to the poll array
+ *    - If the array is full, double its capacity with realloc()
+ *    - pfds[*num_fds].fd = client_socket
+ *    - pfds[*num_fds].events = POLLIN
+ *    - (*num_fds)++
  *
  * Note: At this point, we have accepted the TCP connection but the client
  * hasn't sent their username yet. That will be handled when they send
@@ -296,119 +1114,286 @@ void run_server(int server_socket) {
  *
  * Parameters:
  *   server_socket - The listening socket
- *   pfds          - Array of poll file descriptors
+ *   pfds          - Pointer to the array of poll file descriptors (may move)
  *   num_fds       - Pointer to number of active file descriptors
+ *   capacity      - Pointer to the allocated length of the array
  *****************************************************************************/
-void handle_new_connection(int server_socket, struct pollfd *pfds, int *num_fds) {
+void handle_new_connection(int server_socket, struct pollfd **pfds, int *num_fds,
+                           int *capacity) {
     /* TODO: Implement this function */
     /* See the function header above for detailed implementation steps */
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    int client_socket= accept(server_socket, (struct sockaddr *)&client_addr, &addr_len);
-    if (client_socket < 0) {
-        perror("accept");
-        return;
+    for (int accepted = 0; accepted < accepts_per_wakeup; accepted++) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        conn_io_syscalls++;
+        int client_socket= accept(server_socket, (struct sockaddr *)&client_addr, &addr_len);
+        if (client_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+
+        if (open_session(client_socket) < 0) {
+            close(client_socket);
+            continue;
+        }
+
+        if (add_poll_client(pfds, num_fds, capacity, client_socket) < 0) {
+            end_session(client_socket);
+            return;
+        }
     }
+}
 
-    if (*num_fds < MAX_CLIENTS + 1) {
-        pfds[*num_fds].fd = client_socket;
-        pfds[*num_fds].events = POLLIN;
-        (*num_fds)++;
+/*****************************************************************************
+ * add_poll_client - Append a client to the poll array, growing it if full
+ *
+ * Returns:
+ *   0 on success, -1 if out of memory (the caller ends the session)
+ *****************************************************************************/
+int add_poll_client(struct pollfd **pfds, int *num_fds, int *capacity, int socket) {
+    if (*num_fds == *capacity) {
+        struct pollfd *grown = realloc(*pfds, *capacity * 2 * sizeof(struct pollfd));
+        if (grown == NULL) {
+            fprintf(stderr, "Out of memory for new client\n");
+            return -1;
+        }
+        *pfds = grown;
+        *capacity *= 2;
     }
-    else {
+
+    (*pfds)[*num_fds].fd = socket;
+    (*pfds)[*num_fds].events = POLLIN;
+    (*pfds)[*num_fds].revents = 0;
+    (*num_fds)++;
+    return 0;
+}
+
+/*****************************************************************************
+ * open_session - Set up the per-connection state for an accepted client
+ *
+ * Shared by all I/O backends, so this is where max_clients is enforced.
+ * The client belongs to the calling reactor from now on.
+ *
+ * Parameters:
+ *   socket - The accepted client socket
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if the client cannot be served (the caller closes the socket)
+ *****************************************************************************/
+int open_session(int socket) {
+    /* Reactors accept concurrently, so claim the slot before checking */
+    if (__atomic_add_fetch(&client_count, 1, __ATOMIC_RELAXED) > max_clients) {
+        __atomic_sub_fetch(&client_count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&connections_rejected, 1, __ATOMIC_RELAXED);
         fprintf(stderr, "Too many clients\n");
-        close(client_socket);
+        return -1;
     }
+
+    if (conn_create(socket) == NULL) {
+        __atomic_sub_fetch(&client_count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&connections_rejected, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Out of memory for new client\n");
+        return -1;
+    }
+
+    if (reactor_attach(socket) < 0) {
+        conn_destroy(conn_get(socket));
+        __atomic_sub_fetch(&client_count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&connections_rejected, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Socket %d out of range\n", socket);
+        return -1;
+    }
+
+    /* Replies are single small PDUs; don't hold one back for an ACK */
+    if (busy_poll) {
+        int one = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    if (idle_time_limit > 0) {
+        Connection *conn = conn_get(socket);
+        conn->last_input = timer_now();
+        timer_init(&conn->idle_timer, idle_timer_expired);
+        timer_arm(&conn->idle_timer, conn->last_input + idle_time_limit);
+    }
+
+    __atomic_add_fetch(&connections_accepted, 1, __ATOMIC_RELAXED);
+    return 0;
 }
 
 /*****************************************************************************
- * TODO: handle_client_data - Receive and process a packet from a client
+ * TODO: handle_client_data - Receive and process packets from a client
  *
  * This function is called when poll() detects data available on a client socket.
- * It receives one complete packet and dispatches it to the appropriate handler.
+ * It reads everything the kernel has for the client into the connection's
+ * receive buffer with one recv(), then dispatches every complete packet in
+ * it, up to pdus_per_wakeup (-b) so one pipelining client cannot starve the
+ * others. It never waits for bytes that have not arrived yet, so a slow
+ * client cannot stall the loop. Leftover complete packets are picked up on
+ * the next pass (see run_server).
  *
  * Implementation steps:
- * 1. Get the socket descriptor from pfds[index].fd
+ * 1. Get the socket descriptor from pfds[index].fd and its Connection
  *
- * 2. Receive a packet using recvPDU()
- *    - Declare: uint8_t buffer[BUFFER_SIZE];
- *    - Call: int bytes_received = recvPDU(socket, buffer, BUFFER_SIZE);
- *
- * 3. Handle receive results:
- *    - If bytes_received == 0:
- *      - Client disconnected gracefully
+ * 2. If the socket is readable, pull in what has arrived
+ *    - Call: int bytes_received = fillPDUReader(socket, &conn->reader);
+ *    - If bytes_received == 0 (client disconnected) or < 0 (error):
  *      - Call handle_disconnect(socket, pfds, num_fds, index)
- *      - return
+ *      - return -1
  *
- *    - If bytes_received < 0:
- *      - Error occurred (timeout, connection reset, etc.)
- *      - Call handle_disconnect(socket, pfds, num_fds, index)
- *      - return
+ * 3. Dispatch complete packets with process_client_pdus(socket)
+ *    - It takes at most pdus_per_wakeup packets out with nextPDU() and
+ *      hands each to dispatch_pdu()
+ *    - If it returns < 0: malformed length field, disconnect the client
+ *      and return -1
+ *
+ * Parameters:
+ *   index   - Index in pfds array for this client
+ *   pfds    - Array of poll file descriptors
+ *   num_fds - Pointer to number of active file descriptors
+ *
+ * Returns:
+ *   0 if the client is still connected
+ *   -1 if it was disconnected (pfds[index] now holds what was the last entry)
+ *****************************************************************************/
+int handle_client_data(int index, struct pollfd *pfds, int *num_fds) {
+    int socket_fd = pfds[index].fd;
+    Connection *conn = conn_get(socket_fd);
+    if (conn == NULL) {
+        handle_disconnect(socket_fd, pfds, num_fds, index);
+        return -1;
+    }
+
+    if (pfds[index].revents & (POLLIN | POLLHUP | POLLERR)) {
+        conn_io_syscalls++;
+        int bytes_received = fillPDUReader(socket_fd, &conn->reader);
+        if (bytes_received == 0 || bytes_received == -1) {
+            handle_disconnect(socket_fd, pfds, num_fds, index);
+            return -1;
+        }
+    }
+
+    if (process_client_pdus(socket_fd) < 0) {
+        handle_disconnect(socket_fd, pfds, num_fds, index);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * process_client_pdus - Dispatch the complete packets a client has buffered
+ *
+ * Shared by all I/O backends: whatever filled the connection's receive
+ * buffer, at most pdus_per_wakeup packets are handed to dispatch_pdu().
+ *
+ * Parameters:
+ *   socket - The client socket
+ *
+ * Returns:
+ *   0 on success (packets may be left over for the next pass)
+ *   -1 if the client sent a malformed length field and must be disconnected
+ *****************************************************************************/
+int process_client_pdus(int socket) {
+    Connection *conn = conn_get(socket);
+    if (conn == NULL) {
+        return -1;
+    }
+
+    int dispatched;
+    for (dispatched = 0; dispatched < pdus_per_wakeup; dispatched++) {
+        uint8_t *buffer;
+        int len = nextPDU(&conn->reader, &buffer);
+        if (len == PDU_INCOMPLETE) {
+            break;
+        }
+        else if (len < 0) {
+            return -1;
+        }
+
+        dispatch_pdu(socket, buffer, len);
+    }
+
+    /* Only the time is noted; the idle timer re-arms itself when it fires */
+    if (dispatched > 0 && idle_time_limit > 0) {
+        conn->last_input = timer_now();
+    }
+
+    return 0;
+}
+
+/*****************************************************************************
+ * dispatch_pdu - Hand one complete packet to its protocol handler
  *
- * 4. Parse and dispatch the packet
- *    - Extract flag: uint8_t flag = buffer[0];
- *    - Use a switch statement on flag:
+ * Wraps the packet in a PDUView (no copy - the view points into the
+ * client's receive buffer), extracts the flag with pduFlag() and switches
+ * on it:
  *
  *      case FLAG_INITIAL_CONN (1):
- *          handle_initial_connection(socket, buffer, bytes_received);
- *          break;
+ *          handle_initial_connection(socket, &pdu);
  *
  *      case FLAG_LIST_REQ (10):
  *          handle_list_request(socket);
- *          break;
+ *
+ *      case FLAG_LIST_PAGE_REQ (14):
+ *          handle_list_page_request(socket, &pdu);
+ *
+ *      case FLAG_LIST_SEARCH_REQ (16):
+ *          handle_list_search_request(socket, &pdu);
  *
  *      case FLAG_GAME_START_REQ (20):
- *          handle_game_start_request(socket, buffer, bytes_received);
- *          break;
+ *          handle_game_start_request(socket, &pdu);
  *
  *      case FLAG_MOVE (30):
- *          handle_move(socket, buffer, bytes_received);
- *          break;
+ *          handle_move(socket, &pdu);
  *
  *      default:
  *          fprintf(stderr, "Unknown flag: %d\n", flag);
- *          break;
+ *
+ * Every handler but handle_move() runs under state_lock. Moves only take
+ * their own game's lock, so games on different reactors never wait for
+ * each other (or for logins and lists).
  *
  * Parameters:
- *   index   - Index in pfds array for this client
- *   pfds    - Array of poll file descriptors
- *   num_fds - Pointer to number of active file descriptors
+ *   socket - The client that sent the packet
+ *   buffer - The packet data (points into the client's receive buffer)
+ *   len    - Length of the packet data
  *****************************************************************************/
-void handle_client_data(int index, struct pollfd *pfds, int *num_fds) {
-    /* TODO: Implement this function */
-    /* See the function header above for detailed implementation steps */
-
-    int socket_fd = pfds[index].fd;
-    uint8_t buffer[BUFFER_SIZE];
-    int bytes_received = recvPDU(socket_fd, buffer, BUFFER_SIZE);
-    if (bytes_received == 0) {
-        handle_disconnect(socket_fd, pfds, num_fds, index);
-        return;
-    }
-    else if (bytes_received < 0) {
-        perror("recvPDU");
-        handle_disconnect(socket_fd, pfds, num_fds, index);
+void dispatch_pdu(int socket, uint8_t *buffer, int len) {
+    PDUView pdu;
+    initPDUView(&pdu, buffer, len);
+
+    int flag = pduFlag(&pdu);
+    if (flag == 30) {
+        moves_handled++;
+        handle_move(socket, &pdu);
         return;
     }
 
-    uint8_t flag = buffer[0];
+    pthread_mutex_lock(&state_lock);
     switch (flag) {
         case 1:
-            handle_initial_connection(socket_fd, buffer, bytes_received);
+            handle_initial_connection(socket, &pdu);
             break;
         case 10:
-            handle_list_request(socket_fd);
+            handle_list_request(socket);
             break;
-        case 20:
-            handle_game_start_request(socket_fd, buffer, bytes_received);
+        case 14:
+            handle_list_page_request(socket, &pdu);
             break;
-        case 30:
-            handle_move(socket_fd, buffer, bytes_received);
+        case 16:
+            handle_list_search_request(socket, &pdu);
+            break;
+        case 20:
+            handle_game_start_request(socket, &pdu);
             break;
         default:
             fprintf(stderr, "Unknown flag: %d\n", flag);
             break;
     }
+    pthread_mutex_unlock(&state_lock);
 }
 
 /*****************************************************************************
@@ -417,11 +1402,12 @@ void handle_client_data(int index, struct pollfd *pfds, int *num_fds) {
  * *** THIS IS THE MASTER EXAMPLE - STUDY IT CAREFULLY ***
  *
  * This function demonstrates EVERYTHING you need to know about protocol handling:
- * - How to parse incoming packets (extract length prefix, validate, extract data)
- * - How to use the users module (users_exists, users_add)
+ * - How to parse incoming packets with the PDUView accessors (pduString,
+ *   pduByte), which bounds-check every field and copy nothing
+ * - How to use the users module (users_add)
  * - How to build response packets with proper format
  * - Error handling and validation
- * - Using sendPDU() to send responses
+ * - Using conn_send_pdu() to send responses
  *
  * Use this as your reference when implementing the other protocol handlers!
  *
@@ -474,54 +1460,50 @@ void handle_client_data(int index, struct pollfd *pfds, int *num_fds) {
  *    |   +------ Length: 5
  *    +---------- Flag 3
  *****************************************************************************/
-void handle_initial_connection(int socket, uint8_t *buffer, int len) {
-    uint8_t response[BUFFER_SIZE];
-    uint8_t username_len;
+void handle_initial_connection(int socket, const PDUView *pdu) {
+    uint8_t response[2 + 255];
+    const char *name;
+    int username_len;
     char username[101];  /* Max 100 chars + null terminator */
     int result;
 
-    /* STEP 1: Validate minimum packet size */
-    if (len < 2) {
-        return;  /* Malformed packet - need at least flag + length */
-    }
-
-    /* STEP 2: Parse username length from packet */
-    username_len = buffer[1];
-
-    /* STEP 3: Validate packet is large enough for the claimed username */
-    if (len < 2 + username_len) {
-        return;  /* Packet too short for claimed username length */
+    /* STEP 1: Locate the username inside the packet (no copy yet)
+     *         pduString checks the length byte and that the packet is
+     *         large enough for the claimed username */
+    if (pduString(pdu, 1, &name, &username_len) < 0) {
+        return;  /* Malformed packet */
     }
 
-    /* STEP 4: Extract username and null-terminate it for C string functions */
-    memcpy(username, buffer + 2, username_len);
-    username[username_len] = '\0';
-
-    /* STEP 5: Validate username format (alphanumeric, starts with letter) */
-    if (!validate_username(username)) {
+    /* STEP 2: Validate username format (alphanumeric, starts with letter) */
+    if (!validate_username(name, username_len)) {
         /* Build and send Flag 3 (connection rejected) */
         response[0] = FLAG_CONN_REJECT;
         response[1] = username_len;
-        memcpy(response + 2, username, username_len);
-        sendPDU(socket, response, 2 + username_len);
-        printf("Username %s rejected (invalid format)\n", username);
+        memcpy(response + 2, name, username_len);
+        conn_send_pdu(socket, response, 2 + username_len);
+        printf("Username %.*s rejected (invalid format)\n", username_len, name);
         return;
     }
 
-    /* STEP 6: Try to add user to the users table */
+    /* STEP 3: The users table keeps the name, so now copy it out and
+     *         null-terminate it for C string functions */
+    memcpy(username, name, username_len);
+    username[username_len] = '\0';
+
+    /* STEP 4: Try to add user to the users table */
     result = users_add(username, socket);
 
     if (result == 0) {
         /* Success - send Flag 2 (connection accepted) */
         response[0] = FLAG_CONN_ACCEPT;
-        sendPDU(socket, response, 1);
+        conn_send_pdu(socket, response, 1);
         printf("Player %s connected\n", username);
     } else {
         /* Username already exists - send Flag 3 (connection rejected) */
         response[0] = FLAG_CONN_REJECT;
         response[1] = username_len;
         memcpy(response + 2, username, username_len);
-        sendPDU(socket, response, 2 + username_len);
+        conn_send_pdu(socket, response, 2 + username_len);
         printf("Username %s rejected (already exists)\n", username);
     }
 }
@@ -536,20 +1518,21 @@ void handle_initial_connection(int socket, uint8_t *buffer, int len) {
  * - First character: must be a letter (a-z, A-Z)
  * - Remaining characters: letters, numbers, or underscore
  *
+ * Parameters:
+ *   username - The username (need NOT be null-terminated)
+ *   len      - Number of characters in username
+ *
  * Returns:
  *   1 if valid
  *   0 if invalid
  *****************************************************************************/
-int validate_username(const char *username) {
-    int len;
+int validate_username(const char *username, int len) {
     int i;
 
     if (!username) {
         return 0;  /* Invalid: NULL username */
     }
 
-    len = strlen(username);
-
     /* Check length: 1-100 characters */
     if (len < 1 || len > 100) {
         return 0;  /* Invalid: wrong length */
@@ -643,41 +1626,17 @@ int validate_username(const char *username) {
  *    ^-- Flag 13
  *
  * IMPLEMENTATION STEPS:
- * 1. Allocate space for username strings
- *    - Declare: char *usernames[MAX_CLIENTS];
- *    - Use malloc(101) for each pointer (100 + null terminator)
- *    - Remember to free() all allocated memory before returning!
- *
- * 2. Get all usernames from the users module
- *    - Call: int count = users_get_all(usernames, MAX_CLIENTS);
- *    - This fills the usernames array and returns the count
- *
- * 3. Send Flag 11 (player count)
- *    - Convert count to network byte order: uint32_t net_count = htonl(count);
- *    - buffer[0] = FLAG_LIST_COUNT
- *    - memcpy(buffer + 1, &net_count, 4)
- *    - sendPDU(socket, buffer, 5)
- *
- * 4. Send Flag 12 for each player
- *    - Loop: for (i = 0; i < count; i++)
- *    - For each player:
- *      - uint8_t len = strlen(usernames[i])
- *      - buffer[0] = FLAG_LIST_USER
- *      - buffer[1] = len
- *      - memcpy(buffer + 2, usernames[i], len)
- *      - sendPDU(socket, buffer, 2 + len)
- *
- * 5. Send Flag 13 (end of list)
- *    - buffer[0] = FLAG_LIST_DONE
- *    - sendPDU(socket, buffer, 1)
- *
- * 6. Free all allocated memory
- *    - Loop through usernames array and free() each pointer
+ * 1. If users joined or left since the reply was last built
+ *    (users_generation() differs from list_generation), rebuild it with
+ *    build_list_image(): all count + 2 packets, framed, in one buffer
+ *
+ * 2. Queue the whole image with conn_send_framed(socket, ...)
+ *    (one copy into the output queue and one write, nothing allocated;
+ *    repeated requests between logins and logouts reuse the image)
  *
  * USERS MODULE FUNCTIONS YOU'LL NEED:
- *   int users_get_all(char **usernames, int max_users);
- *   - Fills the usernames array with all connected player names
- *   - Returns the number of players
+ *   unsigned users_generation(void);
+ *   int users_foreach(UsersVisitor visit, void *arg);
  *
  * Parameters:
  *   socket - The requesting client's socket
@@ -690,49 +1649,227 @@ void handle_list_request(int socket) {
     // checking to see if it is a valid socket
     if (socket < 0) { return;}
 
-    // creating the usernames
-    char *usernames[MAX_CLIENTS];
-    
-    // need to free these later
-    for (int i = 0; i < MAX_CLIENTS; i++ ) usernames[i] = malloc(101);
+    // only rebuilt when someone logged in or out since the last request
+    if (list_generation != users_generation() && build_list_image() < 0) {
+        fprintf(stderr, "Out of memory for player list\n");
+        return;
+    }
 
-    // fills the usernames array and returns the count
-    int count = users_get_all(usernames, MAX_CLIENTS);
-    
-    // Send Flag 11 (player count)
+    conn_send_framed(socket, list_image, list_image_length);
+}
+
+/*****************************************************************************
+ * render_list_entry - Append one user's Flag 12 packet, framed
+ *
+ * A users_foreach() visitor; arg points at the write position.
+ *****************************************************************************/
+int render_list_entry(NameId name, int socket, UserState state, void *arg) {
+    uint8_t **write = arg;
+    int len = names_length(name);
+    uint16_t net_length = htons(4 + len);
+
+    (void)socket;
+    (void)state;
+
+    memcpy(*write, &net_length, 2);
+    (*write)[2] = FLAG_LIST_USER;
+    (*write)[3] = len;
+    memcpy(*write + 4, names_string(name), len);
+    *write += 4 + len;
+    return 0;
+}
+
+/*****************************************************************************
+ * build_list_image - Render the reply to a list request into list_image
+ *
+ * The users table says how long the reply is, so it is written straight
+ * into one buffer of that size, names read in place from the table.
+ *
+ * Returns:
+ *   0 on success, -1 if out of memory (the old image is kept, still stale)
+ *****************************************************************************/
+int build_list_image(void) {
+    int count = users_count();
+    int length = 7 + 4 * count + users_name_bytes() + 3;
     uint32_t net_count = htonl(count);
-    u_int8_t buffer[101];
-    buffer[0] = FLAG_LIST_COUNT;
-    memcpy(buffer + 1, &net_count, 4);
-    sendPDU(socket, buffer, 5);
-
-    // Send Flag 12 for each player
-    for (int i = 0; i < count; i++){
-        uint8_t len = strlen(usernames[i]);
-        buffer[0] = FLAG_LIST_USER;
-        buffer[1] = len;
-        memcpy(buffer + 2, usernames[i], len);
-        sendPDU(socket, buffer, 2 + len);
-    }
-
-    // Send Flag 13 (end of list)
-    buffer[0] = FLAG_LIST_DONE;
-    sendPDU(socket, buffer, 1);
-
-    // freeing the allocated memory
-    for (int i = 0; i < MAX_CLIENTS; i++) free(usernames[i]);
+    uint16_t net_length;
+    uint8_t *write;
+
+    if (length > list_image_size) {
+        uint8_t *grown = realloc(list_image, length);
+        if (grown == NULL) return -1;
+        list_image = grown;
+        list_image_size = length;
+    }
+
+    // Flag 11 (player count)
+    write = list_image;
+    net_length = htons(7);
+    memcpy(write, &net_length, 2);
+    write[2] = FLAG_LIST_COUNT;
+    memcpy(write + 3, &net_count, 4);
+    write += 7;
+
+    // Flag 12 for each player
+    users_foreach(render_list_entry, &write);
+
+    // Flag 13 (end of list)
+    net_length = htons(3);
+    memcpy(write, &net_length, 2);
+    write[2] = FLAG_LIST_DONE;
+
+    list_image_length = length;
+    list_generation = users_generation();
+    return 0;
+}
+
+/*****************************************************************************
+ * handle_list_page_request - Process Flag 14 (paginated player list request)
+ *
+ * The bulk alternative to Flag 10: instead of one packet per player, the
+ * server answers with a single Flag 15 packet holding as many usernames as
+ * fit in one PDU (up to PDU_MAX_DATA bytes, several thousand names). The
+ * client keeps asking with the returned cursor until it gets cursor 0, so
+ * a large lobby takes a handful of round trips instead of one packet per
+ * player.
+ *
+ * INCOMING PACKET FORMAT (Flag 14):
+ * +------+--------+
+ * | Flag | Cursor |
+ * +------+--------+
+ * | 1 B  | 4 B    |
+ * +------+--------+
+ *   [0]   = FLAG_LIST_PAGE_REQ (14)
+ *   [1-4] = cursor (uint32_t in network order, 0 = start of the list)
+ *
+ * OUTGOING PACKET FORMAT (Flag 15):
+ * +------+-------+-------------+-------+---------------------------+
+ * | Flag | Total | Next Cursor | Count | Count x (Length, Username) |
+ * +------+-------+-------------+-------+---------------------------+
+ * | 1 B  | 4 B   | 4 B         | 2 B   | variable                  |
+ * +------+-------+-------------+-------+---------------------------+
+ *   [0]    = FLAG_LIST_PAGE (15)
+ *   [1-4]  = total players online (network order)
+ *   [5-8]  = cursor for the next page, 0 if this is the last page
+ *   [9-10] = number of usernames in this page (network order)
+ *   [11..] = each username as [length][name], same as in Flag 12
+ *
+ * Names come in the order players joined, and the cursor is the join
+ * serial of the first player left out (see users_pack_names()), not a
+ * position: players leaving between pages never make a name skipped or
+ * repeated, and players joining show up on the last page. Flag 16 pages
+ * by name instead, for sorted and filtered listings.
+ *
+ * Parameters:
+ *   socket - The requesting client's socket
+ *   pdu    - The received packet
+ *****************************************************************************/
+void handle_list_page_request(int socket, const PDUView *pdu) {
+    uint8_t page[PDU_MAX_DATA];
+    uint32_t cursor;
+    uint32_t next;
+    uint32_t net_total;
+    uint32_t net_next;
+    uint16_t net_count;
+    int count;
+    int used;
+
+    // ignore malformed packets
+    if (pduUint32(pdu, 1, &cursor) < 0) return;
+
+    // more names left: next points the client at the first one we could not fit
+    count = users_pack_names(cursor, page + 11, sizeof(page) - 11, &used, &next);
+
+    net_total = htonl(users_count());
+    net_next = htonl(next);
+    net_count = htons(count);
+
+    page[0] = FLAG_LIST_PAGE;
+    memcpy(page + 1, &net_total, 4);
+    memcpy(page + 5, &net_next, 4);
+    memcpy(page + 9, &net_count, 2);
+    conn_send_pdu(socket, page, 11 + used);
 }
 
-void send_game_start_error(int socket, uint8_t error_code, const char *opponent_username) {
+/*****************************************************************************
+ * handle_list_search_request - Process Flag 16 (sorted, filtered list page)
+ *
+ * Flag 14 with the names sorted and filtered: the client names a prefix
+ * ("ali" for alice, alicia, ...; empty for everyone) and the last name it
+ * has seen, and gets the names after it that start with the prefix, as
+ * many as fit in one PDU. The next request passes the last name of this
+ * page. Because the cursor is a name, players joining or leaving between
+ * pages never make one skipped or repeated. Served from the users
+ * module's sorted index, so a page costs O(log n + k) however large the
+ * lobby.
+ *
+ * INCOMING PACKET FORMAT (Flag 16):
+ * +------+--------+--------+--------+-------+
+ * | Flag | Length | Prefix | Length | After |
+ * +------+--------+--------+--------+-------+
+ * | 1 B  | 1 B    | N B    | 1 B    | M B   |
+ * +------+--------+--------+--------+-------+
+ *   [0]    = FLAG_LIST_SEARCH_REQ (16)
+ *   [1]    = prefix length (0 = all players)
+ *   [2..]  = prefix
+ *   then the cursor the same way: length (0 = first page), last name seen
+ *
+ * OUTGOING PACKET FORMAT (Flag 17):
+ * +------+-------+------+-------+---------------------------+
+ * | Flag | Total | More | Count | Count x (Length, Username) |
+ * +------+-------+------+-------+---------------------------+
+ * | 1 B  | 4 B   | 1 B  | 2 B   | variable                  |
+ * +------+-------+------+-------+---------------------------+
+ *   [0]    = FLAG_LIST_SEARCH (17)
+ *   [1-4]  = total players online (network order), matching or not
+ *   [5]    = 1 if more names match after this page, 0 if it is the last
+ *   [6-7]  = number of usernames in this page (network order)
+ *   [8..]  = each username as [length][name], in byte order
+ *
+ * Parameters:
+ *   socket - The requesting client's socket
+ *   pdu    - The received packet
+ *****************************************************************************/
+void handle_list_search_request(int socket, const PDUView *pdu) {
+    uint8_t page[PDU_MAX_DATA];
+    const char *prefix;
+    const char *after;
+    int prefix_len;
+    int after_len;
+    uint32_t net_total;
+    uint16_t net_count;
+    int offset;
+    int count;
+    int used;
+    int more;
+
+    // ignore malformed packets
+    offset = pduString(pdu, 1, &prefix, &prefix_len);
+    if (offset < 0 || pduString(pdu, offset, &after, &after_len) < 0) return;
+
+    count = users_pack_sorted(prefix, prefix_len, after, after_len,
+                              page + 8, sizeof(page) - 8, &used, &more);
+
+    net_total = htonl(users_count());
+    net_count = htons(count);
+
+    page[0] = FLAG_LIST_SEARCH;
+    memcpy(page + 1, &net_total, 4);
+    page[5] = more;
+    memcpy(page + 6, &net_count, 2);
+    conn_send_pdu(socket, page, 8 + used);
+}
+
+void send_game_start_error(int socket, uint8_t error_code, const char *opponent_username,
+                           int opponent_len) {
     uint8_t buffer[BUFFER_SIZE];
-    uint8_t opponent_len = strlen(opponent_username);
 
     buffer[0] = FLAG_GAME_START_ERR;
     buffer[1] = error_code;
     buffer[2] = opponent_len;
     memcpy(buffer + 3, opponent_username, opponent_len);
 
-    sendPDU(socket, buffer, 3 + opponent_len);
+    conn_send_pdu(socket, buffer, 3 + opponent_len);
 }
 
 /*****************************************************************************
@@ -815,105 +1952,112 @@ void send_game_start_error(int socket, uint8_t error_code, const char *opponent_
  *
  * IMPLEMENTATION STEPS:
  * 1. Parse the opponent username from the packet
- *    - Extract username_len from buffer[1]
- *    - Validate packet size (len >= 2 + username_len)
- *    - Copy username and null-terminate it
+ *    - Call: pduString(pdu, 1, &opponent_username, &opponent_len)
+ *      (a view into the packet, nothing is copied)
+ *    - If it fails (malformed packet), or opponent_len > 100 (longer than
+ *      any valid username), ignore the packet
  *
- * 2. Get the requester's username
- *    - Declare: char requester_username[101];
- *    - Call: users_get_username(socket, requester_username)
- *    - If it returns < 0, this socket isn't registered (shouldn't happen)
+ * 2. Look up both names' handles
+ *    - NameId requester = users_get_name(socket);
+ *    - If it is 0, this socket isn't registered (shouldn't happen)
+ *    - NameId opponent = names_find(opponent_username, opponent_len);
+ *      (the only time the name is hashed; 0 if nobody has that name)
  *
  * 3. Validate the request (check in this order):
  *    a. Check if trying to play self:
- *       - if (strcmp(opponent_username, requester_username) == 0)
+ *       - if (opponent == requester)
  *       - Send Flag 22 with error code 3
  *
  *    b. Check if opponent exists:
- *       - if (!users_exists(opponent_username))
+ *       - int opponent_socket = users_get_socket_by_name(opponent);
+ *       - if (opponent_socket < 0)
  *       - Send Flag 22 with error code 0
  *
  *    c. Check if requester is already in a game:
- *       - if (users_get_state(requester_username) == USER_IN_GAME)
+ *       - if (users_get_state_by_name(requester) == USER_IN_GAME)
  *       - Send Flag 22 with error code 2
  *
  *    d. Check if opponent is available:
- *       - if (users_get_state(opponent_username) == USER_IN_GAME)
+ *       - if (users_get_state_by_name(opponent) == USER_IN_GAME)
  *       - Send Flag 22 with error code 1
  *
- * 4. If all validations pass, create the game
- *    a. Get opponent socket:
- *       - int opponent_socket = users_get_socket(opponent_username);
+ *    Errors echo the name as received:
+ *       send_game_start_error(socket, code, opponent_username, opponent_len)
  *
- *    b. Create the game (requester is X, opponent is O):
+ * 4. If all validations pass, create the game
+ *    a. Create the game (requester is X, opponent is O):
  *       - int game_id = game_create(socket, opponent_socket);
  *       - Check if game_id < 0 (creation failed)
  *
- *    c. Update both players' states:
- *       - users_set_state(requester_username, USER_IN_GAME)
- *       - users_set_state(opponent_username, USER_IN_GAME)
+ *    b. Update both players' states:
+ *       - users_set_state_by_name(requester, USER_IN_GAME)
+ *       - users_set_state_by_name(opponent, USER_IN_GAME)
  *
- *    d. Send game started notification to both:
+ *    c. Send game started notification to both:
  *       - Call: send_game_started(socket, opponent_socket, game_id)
  *       - (You'll implement send_game_started separately)
  *
  * USERS MODULE FUNCTIONS YOU'LL NEED:
- *   int users_get_username(int socket, char *username);
- *   int users_exists(const char *username);
- *   UserState users_get_state(const char *username);
- *   int users_get_socket(const char *username);
- *   void users_set_state(const char *username, UserState state);
+ *   NameId users_get_name(int socket);
+ *   int users_get_socket_by_name(NameId name);
+ *   UserState users_get_state_by_name(NameId name);
+ *   int users_set_state_by_name(NameId name, UserState state);
+ *
+ * NAMES MODULE FUNCTIONS YOU'LL NEED:
+ *   NameId names_find(const char *name, int length);
  *
  * GAME MODULE FUNCTIONS YOU'LL NEED:
  *   int game_create(int x_socket, int o_socket);
  *
  * Parameters:
  *   socket - The requesting client's socket
- *   buffer - The received packet
- *   len    - Length of the received packet
+ *   pdu    - View of the received packet
  *****************************************************************************/
-void handle_game_start_request(int socket, uint8_t *buffer, int len) {
+void handle_game_start_request(int socket, const PDUView *pdu) {
     /* TODO: Implement this function */
     /* Follow the pattern from handle_initial_connection() for parsing */
     /* See the detailed packet formats and implementation steps above */
 
-    int username_len = buffer[1];
-    if (len < 2 + username_len) return;
+    // names are interned, so once the opponent's is looked up (hashed
+    // once, here) every check below compares handles
+    const char *opponent_username;
+    int opponent_len;
+    if (pduString(pdu, 1, &opponent_username, &opponent_len) < 0 || opponent_len > 100) return;
 
-    char requester_username[101];
-    if (users_get_username(socket, requester_username) < 0) return;
+    NameId requester = users_get_name(socket);
+    if (requester == 0) return;
+    NameId opponent = names_find(opponent_username, opponent_len);
 
-    char opponent_username[101];
-    memcpy(opponent_username, buffer + 2, username_len);
-    opponent_username[username_len] = '\0';
-
-    if (strcmp(opponent_username, requester_username) == 0) {
-        send_game_start_error(socket, 3, opponent_username);
+    if (opponent == requester) {
+        send_game_start_error(socket, 3, opponent_username, opponent_len);
         return;
     }
-    if (!users_exists(opponent_username)) {
-        send_game_start_error(socket, 0, opponent_username);
+    int opponent_socket = users_get_socket_by_name(opponent);
+    if (opponent_socket < 0) {
+        send_game_start_error(socket, 0, opponent_username, opponent_len);
         return;
     }
-    if (users_get_state(requester_username) == USER_IN_GAME) {
-        send_game_start_error(socket, 2, opponent_username);
+    if (users_get_state_by_name(requester) == USER_IN_GAME) {
+        send_game_start_error(socket, 2, opponent_username, opponent_len);
         return;
     }
-    if (users_get_state(opponent_username) == USER_IN_GAME) {
-        send_game_start_error(socket, 1, opponent_username);
+    if (users_get_state_by_name(opponent) == USER_IN_GAME) {
+        send_game_start_error(socket, 1, opponent_username, opponent_len);
         return;
     }
 
-    int opponent_socket = users_get_socket(opponent_username);
     int game_id = game_create(socket, opponent_socket);
     if (game_id < 0) {
         fprintf(stderr, "ERROR: Game creation failed\n");
         return;
     }
 
-    users_set_state(requester_username, USER_IN_GAME);
-    users_set_state(opponent_username, USER_IN_GAME);
+    users_set_state_by_name(requester, USER_IN_GAME);
+    users_set_state_by_name(opponent, USER_IN_GAME);
+    set_playing(socket, 1);
+    set_playing(opponent_socket, 1);
     send_game_started(socket, opponent_socket, game_id);
+    start_game_clock(game_id);
 }
 
 /*****************************************************************************
@@ -953,29 +2097,34 @@ void handle_game_start_request(int socket, uint8_t *buffer, int len) {
  *    +----------------------- Flag 21
  *
  * IMPLEMENTATION STEPS:
- * 1. Get both players' usernames
- *    - Declare: char x_username[101], o_username[101];
- *    - Call: users_get_username(x_socket, x_username)
- *    - Call: users_get_username(o_socket, o_username)
+ * 1. Get both players' name handles
+ *    - NameId x_name = users_get_name(x_socket);
+ *    - NameId o_name = users_get_name(o_socket);
+ *    - int x_len = names_length(x_name), o_len = names_length(o_name);
+ *      (interned names carry their lengths, nothing to copy or measure)
  *
  * 2. Send to X player (challenger)
  *    - buffer[0] = FLAG_GAME_STARTED
- *    - buffer[1] = strlen(o_username)
- *    - memcpy(buffer + 2, o_username, strlen(o_username))
- *    - buffer[2 + strlen(o_username)] = SYMBOL_X
- *    - buffer[3 + strlen(o_username)] = (uint8_t)game_id
- *    - sendPDU(x_socket, buffer, 4 + strlen(o_username))
+ *    - buffer[1] = o_len
+ *    - memcpy(buffer + 2, names_string(o_name), o_len)
+ *    - buffer[2 + o_len] = SYMBOL_X
+ *    - buffer[3 + o_len] = (uint8_t)game_id
+ *    - conn_send_pdu(x_socket, buffer, 4 + o_len)
  *
  * 3. Send to O player (challenged)
  *    - buffer[0] = FLAG_GAME_STARTED
- *    - buffer[1] = strlen(x_username)
- *    - memcpy(buffer + 2, x_username, strlen(x_username))
- *    - buffer[2 + strlen(x_username)] = SYMBOL_O
- *    - buffer[3 + strlen(x_username)] = (uint8_t)game_id
- *    - sendPDU(o_socket, buffer, 4 + strlen(x_username))
+ *    - buffer[1] = x_len
+ *    - memcpy(buffer + 2, names_string(x_name), x_len)
+ *    - buffer[2 + x_len] = SYMBOL_O
+ *    - buffer[3 + x_len] = (uint8_t)game_id
+ *    - conn_send_pdu(o_socket, buffer, 4 + x_len)
  *
  * USERS MODULE FUNCTIONS YOU'LL NEED:
- *   int users_get_username(int socket, char *username);
+ *   NameId users_get_name(int socket);
+ *
+ * NAMES MODULE FUNCTIONS YOU'LL NEED:
+ *   const char *names_string(NameId id);
+ *   int names_length(NameId id);
  *
  * Parameters:
  *   x_socket - Socket of player X (the challenger)
@@ -987,24 +2136,26 @@ void send_game_started(int x_socket, int o_socket, int game_id) {
     /* Follow the pattern from handle_initial_connection() for building packets */
     /* See the detailed packet format and implementation steps above */
 
-    char x_username[101], o_username[101];
-    users_get_username(x_socket, x_username);
-    users_get_username(o_socket, o_username);
+    // the interned names carry their lengths, nothing to copy or measure
+    NameId x_name = users_get_name(x_socket);
+    NameId o_name = users_get_name(o_socket);
+    int x_len = names_length(x_name);
+    int o_len = names_length(o_name);
 
     uint8_t buffer[BUFFER_SIZE];
     buffer[0] = FLAG_GAME_STARTED;
-    buffer[1] = strlen(o_username);
-    memcpy(buffer + 2, o_username, strlen(o_username));
-    buffer[2 + strlen(x_username)] = SYMBOL_X;
-    buffer[3 + strlen(o_username)] = (uint8_t)game_id;
-    sendPDU(x_socket, buffer, 4 + strlen(o_username));
+    buffer[1] = o_len;
+    memcpy(buffer + 2, names_string(o_name), o_len);
+    buffer[2 + o_len] = SYMBOL_X;
+    buffer[3 + o_len] = (uint8_t)game_id;
+    conn_send_pdu(x_socket, buffer, 4 + o_len);
 
     buffer[0] = FLAG_GAME_STARTED;
-    buffer[1] = strlen(x_username);
-    memcpy(buffer + 2, x_username, strlen(x_username));
-    buffer[2 + strlen(x_username)] = SYMBOL_O;
-    buffer[3 + strlen(x_username)] = (uint8_t)game_id;
-    sendPDU(o_socket, buffer, 4 + strlen(x_username));
+    buffer[1] = x_len;
+    memcpy(buffer + 2, names_string(x_name), x_len);
+    buffer[2 + x_len] = SYMBOL_O;
+    buffer[3 + x_len] = (uint8_t)game_id;
+    conn_send_pdu(o_socket, buffer, 4 + x_len);
 }
 
 /*****************************************************************************
@@ -1088,9 +2239,8 @@ void send_game_started(int x_socket, int o_socket, int game_id) {
  *
  * IMPLEMENTATION STEPS:
  * 1. Parse the move packet
- *    - Validate: if (len < 3) return
- *    - uint8_t game_id = buffer[1]
- *    - uint8_t position = buffer[2]
+ *    - pduByte(pdu, 1, &game_id) and pduByte(pdu, 2, &position)
+ *    - If either fails the packet is too short: return
  *
  * 2. Validate player is in this game
  *    - if (game_get_by_socket(socket) != game_id)
@@ -1118,7 +2268,7 @@ void send_game_started(int x_socket, int o_socket, int game_id) {
  *           - result == -3: buffer[1] = 2 (invalid position)
  *           - result == -4: buffer[1] = 1 (position occupied)
  *           - else: buffer[1] = 3 (generic error)
- *       - sendPDU(socket, buffer, 2)
+ *       - conn_send_pdu(socket, buffer, 2)
  *
  * GAME MODULE FUNCTIONS YOU'LL NEED:
  *   int game_get_by_socket(int socket);
@@ -1129,28 +2279,33 @@ void send_game_started(int x_socket, int o_socket, int game_id) {
  *
  * Parameters:
  *   socket - The socket of the player making the move
- *   buffer - The received packet
- *   len    - Length of the received packet
+ *   pdu    - View of the received packet
  *****************************************************************************/
-void handle_move(int socket, uint8_t *buffer, int len) {
+void handle_move(int socket, const PDUView *pdu) {
     /* TODO: Implement this function */
     /* Follow the pattern from handle_initial_connection() for parsing */
     /* Use send_board_update() and send_game_over() for notifications */
     /* See the detailed packet formats and implementation steps above */
 
-    if (len < 3) return;
-    uint8_t game_id = buffer[1];
-    uint8_t position = buffer[2];
-    if (game_get_by_socket(socket) != game_id) {
+    uint8_t game_id, position;
+    if (pduByte(pdu, 1, &game_id) < 0 || pduByte(pdu, 2, &position) < 0) return;
+
+    /* Only this game's lock: membership is checked under it, since the
+     * game can end (and its slot be reused) on another reactor */
+    int locked = game_lock(game_id) == 0;
+    if (!locked || game_get_symbol(game_id, socket) < 0) {
+        if (locked) game_unlock(game_id);
         uint8_t response[2];
         response[0] = FLAG_MOVE_INVALID;
         response[1] = 3;  
-        sendPDU(socket, response, 2);
+        conn_send_pdu(socket, response, 2);
         return;
     }
 
     int result = game_make_move(game_id, socket, position);
     if (result == 0) {
+        if (move_time_limit > 0) move_deadlines[game_id] = timer_now() + move_time_limit;
+
         int symbol = game_get_symbol(game_id, socket);
         send_board_update(game_id, position, symbol);
         
@@ -1176,8 +2331,17 @@ void handle_move(int socket, uint8_t *buffer, int len) {
                 response[1] = 3;  
                 break;
         }
-        sendPDU(socket, response, 2);
+        conn_send_pdu(socket, response, 2);
+    }
+
+    /* The users table needs state_lock, which is not taken under a game */
+    if (result == 0 && game_is_over(game_id)) {
+        unsigned generation = game_get_generation(game_id);
+        game_unlock(game_id);
+        release_game(game_id, generation);
+        return;
     }
+    game_unlock(game_id);
 }
 
 /*****************************************************************************
@@ -1232,8 +2396,8 @@ void handle_move(int socket, uint8_t *buffer, int len) {
  *    - buffer[13] = (uint8_t)current_turn
  *
  * 4. Send to both players
- *    - sendPDU(x_socket, buffer, 14)
- *    - sendPDU(o_socket, buffer, 14)
+ *    - conn_send_pdu(x_socket, buffer, 14)
+ *    - conn_send_pdu(o_socket, buffer, 14)
  *
  * GAME MODULE FUNCTIONS YOU'LL NEED:
  *   void game_get_board(int game_id, uint8_t *board);
@@ -1267,8 +2431,8 @@ void send_board_update(int game_id, int position, int who_moved) {
     memcpy(buffer + 4, board, 9);
     buffer[13] = (uint8_t)current_turn;
 
-    sendPDU(x_socket, buffer, 14);
-    sendPDU(o_socket, buffer, 14);
+    conn_send_pdu(x_socket, buffer, 14);
+    conn_send_pdu(o_socket, buffer, 14);
 }
 
 /*****************************************************************************
@@ -1308,15 +2472,12 @@ void send_board_update(int game_id, int position, int who_moved) {
  *    - Declare: uint8_t board[9];
  *    - Call: game_get_board(game_id, board)
  *
- * 2. Get both player sockets and usernames
+ * 2. Get both player sockets
  *    - int x_socket = game_get_x_socket(game_id)
  *    - int o_socket = game_get_o_socket(game_id)
  *    - If either is < 0:
  *      - game_destroy(game_id)
  *      - return
- *    - Declare: char x_username[101], o_username[101];
- *    - Call: users_get_username(x_socket, x_username)
- *    - Call: users_get_username(o_socket, o_username)
  *
  * 3. Build the packet
  *    - buffer[0] = FLAG_GAME_OVER
@@ -1325,19 +2486,19 @@ void send_board_update(int game_id, int position, int who_moved) {
  *    - memcpy(buffer + 3, board, 9)
  *
  * 4. Send to both players
- *    - sendPDU(x_socket, buffer, 12)
- *    - sendPDU(o_socket, buffer, 12)
+ *    - conn_send_pdu(x_socket, buffer, 12)
+ *    - conn_send_pdu(o_socket, buffer, 12)
  *
  * 5. Update user states back to available
- *    - users_set_state(x_username, USER_AVAILABLE)
- *    - users_set_state(o_username, USER_AVAILABLE)
+ *    - users_set_state_by_name(users_get_name(x_socket), USER_AVAILABLE)
+ *    - users_set_state_by_name(users_get_name(o_socket), USER_AVAILABLE)
  *
  * 6. Destroy the game
  *    - game_destroy(game_id)
  *
  * USERS MODULE FUNCTIONS YOU'LL NEED:
- *   int users_get_username(int socket, char *username);
- *   void users_set_state(const char *username, UserState state);
+ *   NameId users_get_name(int socket);
+ *   int users_set_state_by_name(NameId name, UserState state);
  *
  * GAME MODULE FUNCTIONS YOU'LL NEED:
  *   void game_get_board(int game_id, uint8_t *board);
@@ -1355,32 +2516,407 @@ void send_game_over(int game_id, int result) {
     /* Don't forget to clean up both user states and the game! */
     /* See the detailed packet format and implementation steps above */
 
+    /* Called with only the game's lock held (from handle_move), so the
+     * users table is not touched here: the game is marked over, and the
+     * caller hands it to release_game() for steps 5 and 6 */
     uint8_t board[9];
     game_get_board(game_id, board);
 
     int x_socket = game_get_x_socket(game_id);
     int o_socket = game_get_o_socket(game_id);
+    game_finish(game_id);
     if (x_socket < 0 || o_socket < 0) {
-        game_destroy(game_id);
         return;
     }
 
-    char x_username[101], o_username[101];
-    users_get_username(x_socket, x_username);
-    users_get_username(o_socket, o_username);
-
     uint8_t buffer[12];
     buffer[0] = FLAG_GAME_OVER;
     buffer[1] = (uint8_t)game_id;
     buffer[2] = (uint8_t)result;
     memcpy(buffer + 3, board, 9);
 
-    sendPDU(x_socket, buffer, 12);
-    sendPDU(o_socket, buffer, 12);
+    conn_send_pdu(x_socket, buffer, 12);
+    conn_send_pdu(o_socket, buffer, 12);
+}
+
+/*****************************************************************************
+ * release_game - Steps 5 and 6 of send_game_over, once the move is done
+ *
+ * Takes state_lock and then the game's lock (always in that order). The
+ * game's lock was let go in between, so the generation says whether the
+ * slot still holds the same game: a disconnect may already have
+ * destroyed it, and a new game may even have been created in its place.
+ *
+ * Parameters:
+ *   game_id    - The game that ended
+ *   generation - game_get_generation(game_id) when it ended
+ *****************************************************************************/
+void release_game(int game_id, unsigned generation) {
+    pthread_mutex_lock(&state_lock);
+    game_lock(game_id);
+
+    if (game_get_generation(game_id) == generation && game_is_over(game_id)) {
+        users_set_state_by_name(users_get_name(game_get_x_socket(game_id)), USER_AVAILABLE);
+        users_set_state_by_name(users_get_name(game_get_o_socket(game_id)), USER_AVAILABLE);
+        set_playing(game_get_x_socket(game_id), 0);
+        set_playing(game_get_o_socket(game_id), 0);
+        game_destroy(game_id);
+    }
+
+    game_unlock(game_id);
+    pthread_mutex_unlock(&state_lock);
+}
+
+/*****************************************************************************
+ * set_playing - Record whether a socket's client is in a game
+ *
+ * Written under state_lock; read without it by socket_playing().
+ *****************************************************************************/
+void set_playing(int socket, int value) {
+    if (socket >= 0 && socket < playing_size) {
+        __atomic_store_n(&playing[socket], (uint8_t)value, __ATOMIC_RELAXED);
+    }
+}
+
+/*****************************************************************************
+ * socket_playing - Output limit hook: is a socket's client in a game?
+ *
+ * Called from inside sends, where state_lock may already be held, so it
+ * reads the playing flags instead of the users table. A stale answer only
+ * changes which slow client goes first.
+ *****************************************************************************/
+int socket_playing(int socket) {
+    if (socket < 0 || socket >= playing_size) {
+        return 0;
+    }
+    return __atomic_load_n(&playing[socket], __ATOMIC_RELAXED);
+}
+
+/*****************************************************************************
+ * start_game_clock - Start the move and game clocks of a new game
+ *
+ * The clock timer lives on the calling reactor for the whole game, even
+ * when moves are handled by another: a move only stores a new deadline
+ * (see handle_move), so no timer is touched from another thread, and a
+ * game nobody moves in costs nothing until its deadline.
+ *
+ * Parameters:
+ *   game_id - The game that was just created
+ *****************************************************************************/
+void start_game_clock(int game_id) {
+    uint64_t now = timer_now();
+
+    if (move_time_limit == 0 && game_time_limit == 0) {
+        return;
+    }
+
+    game_lock(game_id);
+    move_deadlines[game_id] = move_time_limit > 0 ? now + move_time_limit : 0;
+    game_deadlines[game_id] = game_time_limit > 0 ? now + game_time_limit : 0;
+    game_unlock(game_id);
+
+    arm_game_clock(game_id);
+}
+
+/*****************************************************************************
+ * arm_game_clock - Arm a game's clock timer on the calling reactor
+ *
+ * For the deadlines the game already has: set by start_game_clock(), or
+ * taken over from a predecessor server.
+ *****************************************************************************/
+void arm_game_clock(int game_id) {
+    GameClock *clock = &game_clocks[game_id];
+    uint64_t deadline;
+
+    game_lock(game_id);
+    clock->generation = game_get_generation(game_id);
+    deadline = game_clock_deadline(game_id);
+    game_unlock(game_id);
+
+    if (deadline == 0) {
+        return;
+    }
+
+    /* Still armed if the slot's previous game was started here too */
+    if (!timer_pending(&clock->timer)) {
+        timer_init(&clock->timer, game_clock_expired);
+    }
+    timer_arm(&clock->timer, deadline);
+}
+
+/*****************************************************************************
+ * game_clock_deadline - Earlier of a game's two deadlines (game lock held)
+ *****************************************************************************/
+uint64_t game_clock_deadline(int game_id) {
+    uint64_t deadline = move_deadlines[game_id];
+
+    if (deadline == 0 || (game_deadlines[game_id] != 0 && game_deadlines[game_id] < deadline)) {
+        deadline = game_deadlines[game_id];
+    }
+    return deadline;
+}
+
+/*****************************************************************************
+ * game_clock_expired - A game's clock timer went off
+ *
+ * If a move came in since it was armed, the deadline has moved and the
+ * timer is armed again for it. Otherwise the player whose turn it is has
+ * run out of time and forfeits (result 3 or 4), exactly like a game that
+ * ended on the board.
+ *
+ * Parameters:
+ *   timer - The timer of a GameClock in this reactor's game_clocks
+ *****************************************************************************/
+void game_clock_expired(Timer *timer) {
+    GameClock *clock = (GameClock *)timer;
+    int game_id = (int)(clock - game_clocks);
+    uint64_t deadline;
+    int turn;
+
+    game_lock(game_id);
+
+    /* The game ended (or another game took the slot) since it was armed */
+    turn = game_get_current_turn(game_id);
+    if (game_get_generation(game_id) != clock->generation || turn < 0 ||
+        game_is_over(game_id)) {
+        game_unlock(game_id);
+        return;
+    }
+
+    deadline = game_clock_deadline(game_id);
+    if (timer_now() < deadline) {
+        game_unlock(game_id);
+        timer_arm(timer, deadline);
+        return;
+    }
+
+    send_game_over(game_id, turn == SYMBOL_X ? RESULT_X_FORFEIT : RESULT_O_FORFEIT);
+    game_unlock(game_id);
+    release_game(game_id, clock->generation);
+}
+
+/*****************************************************************************
+ * idle_timer_expired - A client's idle timer went off
+ *
+ * Re-armed if the client sent a packet since; otherwise the connection is
+ * marked failed, and the backend disconnects it like any other failure.
+ *
+ * Parameters:
+ *   timer - The idle_timer of a Connection owned by this reactor
+ *****************************************************************************/
+void idle_timer_expired(Timer *timer) {
+    Connection *conn = (Connection *)((char *)timer - offsetof(Connection, idle_timer));
+    uint64_t deadline = conn->last_input + idle_time_limit;
+
+    if (timer_now() < deadline) {
+        timer_arm(timer, deadline);
+        return;
+    }
+
+    conn_fail(conn);
+}
+
+/*****************************************************************************
+ * handing_off - Check whether the reactors stopped for a successor
+ *****************************************************************************/
+int handing_off(void) {
+    return __atomic_load_n(&stop_reason, __ATOMIC_SEQ_CST) == STOP_HANDOFF;
+}
+
+/*****************************************************************************
+ * handoff_main - Wait for a successor on the -H socket, then stop serving
+ *
+ * Runs on its own thread. Reactor 0 runs on the main thread, and with a
+ * single reactor it has no wake descriptor, so its wait is interrupted
+ * with SIGUSR1 until it notices (a signal can land just before the wait).
+ *****************************************************************************/
+void *handoff_main(void *arg) {
+    int running = 0;
+    int channel;
+
+    (void)arg;
+
+    do {
+        channel = accept(handoff_socket, NULL, NULL);
+    } while (channel < 0 && (errno == EINTR || errno == ECONNABORTED));
+    if (channel < 0) {
+        perror("accept");
+        return NULL;
+    }
+
+    if (!__atomic_compare_exchange_n(&stop_reason, &running, STOP_HANDOFF, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        close(channel);  /* Already shutting down */
+        return NULL;
+    }
+
+    printf("Handing off to a new server...\n");
+    handoff_channel = channel;
+    keep_running = 0;
+    reactor_wake_all();
+    while (!__atomic_load_n(&main_reactor_stopped, __ATOMIC_ACQUIRE)) {
+        pthread_kill(main_thread, SIGUSR1);
+        usleep(10000);
+    }
+    return NULL;
+}
+
+/*****************************************************************************
+ * take_over - Restore the users and games a predecessor handed over
+ *
+ * Runs before any reactor starts; the clients' connections are set up by
+ * their reactors (adopt_sessions). A user is in a game exactly when one
+ * came across for them.
+ *****************************************************************************/
+void take_over(void) {
+    HandoffGame *game;
+    int i;
+
+    for (i = 0; i < inherited.user_count; i++) {
+        users_add(inherited.users[i].username, inherited.users[i].socket);
+    }
+
+    for (i = 0; i < inherited.game_count; i++) {
+        game = &inherited.games[i];
+        if (game_restore(game->game_id, game->x_socket, game->o_socket, game->board,
+                         game->current_turn) < 0) {
+            continue;
+        }
+        move_deadlines[game->game_id] = game->move_deadline;
+        game_deadlines[game->game_id] = game->game_deadline;
+
+        users_set_state_by_name(users_get_name(game->x_socket), USER_IN_GAME);
+        users_set_state_by_name(users_get_name(game->o_socket), USER_IN_GAME);
+        set_playing(game->x_socket, 1);
+        set_playing(game->o_socket, 1);
+    }
+}
+
+/*****************************************************************************
+ * adopt_sessions - Set up this reactor's share of the inherited clients
+ *
+ * Clients are dealt out round robin. Their unread input and unsent output
+ * go back into their new Connections, where the backend finds them when
+ * it starts. Reactor 0 also keeps the clocks of the inherited games.
+ *
+ * Parameters:
+ *   index - This reactor's index
+ *****************************************************************************/
+void adopt_sessions(int index) {
+    HandoffClient *client;
+    int i;
+
+    for (i = index; i < inherited.client_count; i += reactor_threads) {
+        client = &inherited.clients[i];
+        if (open_session(client->socket) < 0) {
+            end_session(client->socket);
+            continue;
+        }
+        if (conn_restore(conn_get(client->socket), client->unread, client->unread_length,
+                         client->unsent, client->unsent_length) < 0) {
+            fprintf(stderr, "Cannot restore the client on socket %d\n", client->socket);
+            conn_fail(conn_get(client->socket));
+        }
+    }
+
+    if (index == 0) {
+        for (i = 0; i < inherited.game_count; i++) {
+            if (game_get_x_socket(inherited.games[i].game_id) >= 0) {
+                arm_game_clock(inherited.games[i].game_id);
+            }
+        }
+    }
+}
+
+/*****************************************************************************
+ * export_sessions - Pack this reactor's clients for the successor
+ *
+ * Called once the reactor stopped and its mailbox was emptied, so each
+ * Connection holds everything in flight for its client.
+ *****************************************************************************/
+void export_sessions(void) {
+    Connection *conn;
+    int cursor = 0;
+
+    pthread_mutex_lock(&outgoing_lock);
+    while ((conn = conn_next(&cursor)) != NULL) {
+        if (conn->failed) {
+            continue;  /* Given up on; the successor drops its user too */
+        }
+        if (handoff_add_client(&outgoing, conn->socket,
+                               conn->reader.buffer + conn->reader.start,
+                               conn->reader.end - conn->reader.start,
+                               conn->send_buffer + conn->send_offset,
+                               conn->send_length - conn->send_offset) < 0) {
+            fprintf(stderr, "Out of memory handing off socket %d\n", conn->socket);
+        }
+    }
+    pthread_mutex_unlock(&outgoing_lock);
+}
+
+/*****************************************************************************
+ * export_user - Add one user to the outgoing handoff state
+ *
+ * A users_foreach() visitor; arg is the HandoffState, sized for them all.
+ *****************************************************************************/
+int export_user(NameId name, int socket, UserState state, void *arg) {
+    HandoffState *state_out = arg;
+    HandoffUser *user = &state_out->users[state_out->user_count++];
+
+    memcpy(user->username, names_string(name), names_length(name) + 1);
+    user->socket = socket;
+    user->state = state;
+    return 0;
+}
+
+/*****************************************************************************
+ * hand_off - Send the listeners, clients, users and games to the successor
+ *
+ * Runs on the main thread after every reactor stopped. The clients are
+ * not told anything: from here on the successor serves them.
+ *
+ * Parameters:
+ *   threads - The reactors, for their listening sockets
+ *****************************************************************************/
+void hand_off(ReactorThread *threads) {
+    HandoffGame *game;
+    int count = users_count();
+    int i;
+
+    outgoing.listeners = malloc(reactor_threads * sizeof(int));
+    outgoing.users = calloc(count + 1, sizeof(HandoffUser));
+    outgoing.games = calloc(MAX_GAMES, sizeof(HandoffGame));
+    if (outgoing.listeners == NULL || outgoing.users == NULL || outgoing.games == NULL) {
+        fprintf(stderr, "Out of memory for the handoff\n");
+        close(handoff_channel);
+        return;
+    }
+
+    for (i = 0; i < reactor_threads; i++) {
+        outgoing.listeners[i] = threads[i].server_socket;
+    }
+    outgoing.listener_count = reactor_threads;
 
-    users_set_state(x_username, USER_AVAILABLE);
-    users_set_state(o_username, USER_AVAILABLE);
-    game_destroy(game_id);
+    users_foreach(export_user, &outgoing);
+
+    for (i = 0; i < MAX_GAMES; i++) {
+        if (game_get_x_socket(i) < 0 || game_is_over(i)) {
+            continue;
+        }
+        game = &outgoing.games[outgoing.game_count++];
+        game->game_id = i;
+        game->x_socket = game_get_x_socket(i);
+        game->o_socket = game_get_o_socket(i);
+        game_get_board(i, game->board);
+        game->current_turn = game_get_current_turn(i);
+        game->move_deadline = move_deadlines[i];
+        game->game_deadline = game_deadlines[i];
+    }
+
+    if (handoff_send(handoff_channel, &outgoing) == 0) {
+        printf("Handed off %d clients and %d games\n", outgoing.client_count, outgoing.game_count);
+    }
+    close(handoff_channel);
 }
 
 /*****************************************************************************
@@ -1396,10 +2932,8 @@ void send_game_over(int game_id, int result) {
  *
  * IMPLEMENTATION STEPS:
  * 1. Get the disconnecting user's information
- *    - Declare: char username[101];
- *    - Declare: int game_id;
- *    - Call: users_get_username(socket, username)
- *    - If successful: Print "Player %s disconnected\n"
+ *    - NameId name = users_get_name(socket);
+ *    - If it is not 0: Print "Player %s disconnected\n" with names_string(name)
  *
  * 2. Check if player is in a game
  *    - Call: game_id = game_get_by_socket(socket);
@@ -1417,35 +2951,37 @@ void send_game_over(int game_id, int result) {
  *         - buffer[1] = (uint8_t)game_id
  *         - buffer[2] = (symbol == SYMBOL_X) ? RESULT_X_DISCONN : RESULT_O_DISCONN
  *         - memcpy(buffer + 3, board, 9)
- *       - Send: sendPDU(opponent, buffer, 12)
+ *       - Send: conn_send_pdu(opponent, buffer, 12)
  *
  *    c. Set opponent back to available:
- *       - Declare: char opp_username[101];
- *       - Get opponent username: users_get_username(opponent, opp_username)
- *       - Update state: users_set_state(opp_username, USER_AVAILABLE)
+ *       - users_set_state_by_name(users_get_name(opponent), USER_AVAILABLE)
  *
  *    d. Destroy the game:
  *       - game_destroy(game_id)
  *
- * 4. Remove from users table
+ * 4. Remove from users table and drop the connection state
  *    - users_remove_by_socket(socket)
+ *    - conn_destroy(conn_get(socket))
  *
  * 5. Close the socket
  *    - close(socket)
  *
+ *    Steps 1-5 live in end_session(socket), which the epoll and io_uring
+ *    backends call directly since they have no poll array.
+ *
  * 6. Remove from poll array
  *    - Move the last element to this position: pfds[index] = pfds[*num_fds - 1]
  *    - Decrement count: (*num_fds)--
- *    - Note: This moves pfds[*num_fds-1] into pfds[index], so if you're
- *      calling this in a loop, you may need to re-check pfds[index]
+ *    - Note: This moves pfds[*num_fds-1] into pfds[index], so a loop over
+ *      pfds must examine pfds[index] again or it skips the moved client
  *
  * RESULT CODES FOR FLAG 33:
  *   RESULT_X_DISCONN = 5
  *   RESULT_O_DISCONN = 6
  *
  * USERS MODULE FUNCTIONS YOU'LL NEED:
- *   int users_get_username(int socket, char *username);
- *   void users_set_state(const char *username, UserState state);
+ *   NameId users_get_name(int socket);
+ *   int users_set_state_by_name(NameId name, UserState state);
  *   void users_remove_by_socket(int socket);
  *
  * GAME MODULE FUNCTIONS YOU'LL NEED:
@@ -1465,15 +3001,38 @@ void handle_disconnect(int socket, struct pollfd *pfds, int *num_fds, int index)
     /* TODO: Implement this function */
     /* See the function header above for detailed implementation steps */
 
-    char username[101];
+    end_session(socket);
+
+    pfds[index] = pfds[*num_fds - 1];
+    (*num_fds)--;
+}
+
+/*****************************************************************************
+ * end_session - Steps 1-5 of handle_disconnect (everything but the poll array)
+ *
+ * Shared by all I/O backends. Runs on the reactor that owns the socket;
+ * the users and game tables are updated under state_lock, and the
+ * opponent's game over goes through its own reactor if it has another.
+ *
+ * Parameters:
+ *   socket - The socket being disconnected
+ *****************************************************************************/
+void end_session(int socket) {
+    Connection *conn = conn_get(socket);
+    NameId name;
     int game_id;
-    
-    if (users_get_username(socket, username) >= 0) printf("Player %s disconnected\n", username);
+
+    pthread_mutex_lock(&state_lock);
+
+    name = users_get_name(socket);
+    if (name != 0) printf("Player %s disconnected\n", names_string(name));
     game_id = game_get_by_socket(socket);
 
     if (game_id >= 0) {
+        /* A game that is already over only waits for release_game() */
+        game_lock(game_id);
         int opponent = game_get_opponent(game_id, socket);
-        if (opponent >= 0) {
+        if (opponent >= 0 && !game_is_over(game_id)) {
             int symbol = game_get_symbol(game_id, socket);
             uint8_t board[9];
             game_get_board(game_id, board);
@@ -1481,19 +3040,29 @@ void handle_disconnect(int socket, struct pollfd *pfds, int *num_fds, int index)
             buffer[0] = FLAG_GAME_OVER;
             buffer[1] = (uint8_t)game_id;
             buffer[2] = (symbol == 1) ? 5 : 6;
+            if (conn != NULL && conn->evicted) {
+                /* Dropped for not reading: that loses the game */
+                buffer[2] = (symbol == SYMBOL_X) ? RESULT_X_FORFEIT : RESULT_O_FORFEIT;
+            }
             memcpy(buffer + 3, board, 9);
-            sendPDU(opponent, buffer, 12);
+            conn_send_pdu(opponent, buffer, 12);
         }
         
         // ask if this is right
-        char opp_username[101];
-        if (users_get_username(opponent, opp_username) >= 0) users_set_state(opp_username, USER_AVAILABLE); 
+        users_set_state_by_name(users_get_name(opponent), USER_AVAILABLE);
+        set_playing(socket, 0);
+        set_playing(opponent, 0);
         game_destroy(game_id);
+        game_unlock(game_id);
     }
 
     users_remove_by_socket(socket);
-    close(socket);
+    pthread_mutex_unlock(&state_lock);
 
-    pfds[index] = pfds[*num_fds - 1];
-    (*num_fds)--;
+    if (conn != NULL) {
+        reactor_detach(socket);
+        conn_destroy(conn);
+        __atomic_sub_fetch(&client_count, 1, __ATOMIC_RELAXED);
+    }
+    close(socket);
 }
@@ -0,0 +1,35 @@
+/*****************************************************************************
+ * server.h - Hooks between the protocol code in server.c and the I/O
+ *            backends that drive it
+ *
+ * server.c owns everything the protocol needs (users, games, handlers);
+ * a backend owns how sockets are watched and read. Every backend calls
+ * back into the same three functions, so all of them serve identical
+ * protocol behaviour.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+/* Server hooks a backend calls; each returns < 0 to drop the client.
+ * A backend also serves every Connection that already exists in its
+ * thread when it starts (clients taken over from another server). */
+typedef struct {
+    int (*open_session)(int socket);   /* A client was accepted */
+    int (*client_data)(int socket);    /* New bytes are in the client's reader */
+    void (*close_session)(int socket); /* Tear the client down and close it */
+    int wake_fd;                       /* Watch for input too; -1 if none */
+    void (*wake)(void);                /* wake_fd became readable */
+    int accept_batch;                  /* Most accept()s per listener wakeup */
+    int busy_poll;                     /* Never sleep: check for readiness
+                                        * in a loop, trading a core for
+                                        * wakeup latency */
+    int (*handing_off)(void);          /* After the loop stops: nonzero if the
+                                        * clients go to a successor server, so
+                                        * each one's state must be left in its
+                                        * Connection (see handoff.h) */
+} ServerCallbacks;
+
+#endif /* SERVER_H */
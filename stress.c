@@ -0,0 +1,555 @@
+/*****************************************************************************
+ * stress.c - Slow-client and partial-PDU stress harness for the server
+ *
+ * Measures how much hostile or broken clients hurt well-behaved players.
+ * A few healthy pairs play scripted games and time every move (move sent
+ * until the mover's board update arrives), first on their own and then
+ * while these attackers run in background threads:
+ *
+ *   split     sends one byte of a length prefix, then nothing
+ *   trickle   announces a login PDU and sends its body one byte per second
+ *   oversize  announces a 65535-byte PDU and sends junk, reconnecting
+ *             whenever the server drops it
+ *   noread    logs in and pipelines list requests without ever reading,
+ *             so its output backs up on the server
+ *
+ * Against a server that blocks in recvPDU() or sendPDU(), healthy moves
+ * stall for as long as an attacker does; an isolated event loop keeps
+ * them in the same range as the baseline. The exit status makes this a
+ * regression gate: non-zero if a healthy move fails, or if the p99 move
+ * latency under attack exceeds the -l limit.
+ *
+ * Before that, a churn phase logs users in and out while the server's
+ * name table grows and resizes, and checks that every user who left is
+ * reported as gone (see churn_names()).
+ *
+ * Usage: ttt-stress [-a attackers] [-g games] [-p pairs] [-l limit_ms] host port
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "pdu.h"
+
+#define FLAG_INITIAL_CONN      1
+#define FLAG_CONN_ACCEPT       2
+#define FLAG_LIST_REQ          10
+#define FLAG_GAME_START_REQ    20
+#define FLAG_GAME_STARTED      21
+#define FLAG_GAME_START_ERR    22
+#define FLAG_MOVE              30
+#define FLAG_BOARD_UPDATE      31
+#define FLAG_GAME_OVER         33
+
+#define DEFAULT_ATTACKERS 10
+#define DEFAULT_GAMES 50
+#define DEFAULT_PAIRS 2
+#define DEFAULT_LIMIT_MS 100
+
+/* Users logged in (and half of them out again) by churn_names() */
+#define CHURN_USERS 400
+
+/* Healthy clients give up on a response after this long */
+#define RECV_TIMEOUT_SEC 5
+
+#define BUFFER_SIZE 2048
+
+/* Kinds of attacker, one thread each */
+typedef enum {
+    ATTACK_SPLIT,
+    ATTACK_TRICKLE,
+    ATTACK_OVERSIZE,
+    ATTACK_NOREAD,
+    ATTACK_KINDS
+} AttackKind;
+
+static const char *attack_names[ATTACK_KINDS] = {"split", "trickle", "oversize", "noread"};
+
+typedef struct {
+    AttackKind kind;
+    int count;
+} AttackJob;
+
+/* One healthy player */
+typedef struct {
+    int socket;
+    char name[32];
+} Player;
+
+static const char *server_host;
+static const char *server_port;
+static volatile int attacking = 1;
+
+/* Latency samples of the current phase, in milliseconds */
+static double *samples = NULL;
+static int sample_count = 0;
+static int sample_capacity = 0;
+
+/*****************************************************************************
+ * now_ms - Monotonic clock in milliseconds
+ *****************************************************************************/
+static double now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*****************************************************************************
+ * connect_server - Open a TCP connection to the server under test
+ *****************************************************************************/
+static int connect_server(void) {
+    struct addrinfo hints;
+    struct addrinfo *result;
+    int fd;
+    int one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(server_host, server_port, &hints, &result) != 0) {
+        return -1;
+    }
+
+    fd = socket(result->ai_family, result->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (fd >= 0) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+/*****************************************************************************
+ * login - Send Flag 1 and wait for the verdict
+ *****************************************************************************/
+static int login(int socket, const char *name) {
+    uint8_t buffer[BUFFER_SIZE];
+    int len = strlen(name);
+
+    buffer[0] = FLAG_INITIAL_CONN;
+    buffer[1] = len;
+    memcpy(buffer + 2, name, len);
+    if (sendPDU(socket, buffer, 2 + len) < 0) {
+        return -1;
+    }
+
+    return (recvPDU(socket, buffer, sizeof(buffer)) > 0 && buffer[0] == FLAG_CONN_ACCEPT) ? 0 : -1;
+}
+
+/*****************************************************************************
+ * expect - Receive PDUs until one with the given flag arrives
+ *****************************************************************************/
+static int expect(int socket, uint8_t flag, uint8_t *buffer) {
+    int len;
+
+    for (;;) {
+        len = recvPDU(socket, buffer, BUFFER_SIZE);
+        if (len <= 0) {
+            return -1;  /* Disconnected or timed out */
+        }
+        if (buffer[0] == flag) {
+            return len;
+        }
+    }
+}
+
+/*****************************************************************************
+ * record - Keep one latency sample
+ *****************************************************************************/
+static void record(double ms) {
+    double *grown;
+
+    if (sample_count == sample_capacity) {
+        sample_capacity = sample_capacity ? sample_capacity * 2 : 1024;
+        grown = realloc(samples, sample_capacity * sizeof(double));
+        if (grown == NULL) {
+            return;
+        }
+        samples = grown;
+    }
+
+    samples[sample_count++] = ms;
+}
+
+/*****************************************************************************
+ * play_game - Play one scripted game; X wins on its third move
+ *****************************************************************************/
+static int play_game(Player *x, Player *o) {
+    static const int script[5] = {1, 4, 2, 5, 3};
+    uint8_t buffer[BUFFER_SIZE];
+    Player *mover;
+    Player *waiter;
+    uint8_t game_id;
+    double start;
+    int name_len = strlen(o->name);
+    int i;
+
+    /* The challenger plays X */
+    buffer[0] = FLAG_GAME_START_REQ;
+    buffer[1] = name_len;
+    memcpy(buffer + 2, o->name, name_len);
+    if (sendPDU(x->socket, buffer, 2 + name_len) < 0 ||
+        expect(o->socket, FLAG_GAME_STARTED, buffer) < 0 ||
+        expect(x->socket, FLAG_GAME_STARTED, buffer) < 0) {
+        return -1;
+    }
+    game_id = buffer[3 + name_len];
+
+    for (i = 0; i < 5; i++) {
+        mover = (i % 2 == 0) ? x : o;
+        waiter = (i % 2 == 0) ? o : x;
+
+        buffer[0] = FLAG_MOVE;
+        buffer[1] = game_id;
+        buffer[2] = script[i];
+        start = now_ms();
+        if (sendPDU(mover->socket, buffer, 3) < 0 ||
+            expect(mover->socket, FLAG_BOARD_UPDATE, buffer) < 0) {
+            return -1;
+        }
+        record(now_ms() - start);
+
+        if (expect(waiter->socket, FLAG_BOARD_UPDATE, buffer) < 0) {
+            return -1;
+        }
+    }
+
+    if (expect(x->socket, FLAG_GAME_OVER, buffer) < 0 ||
+        expect(o->socket, FLAG_GAME_OVER, buffer) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * attack - Thread body: keep job->count attackers of one kind going
+ *****************************************************************************/
+static void *attack(void *arg) {
+    AttackJob *job = arg;
+    uint8_t buffer[BUFFER_SIZE];
+    int *sockets = calloc(job->count, sizeof(int));
+    char name[32];
+    int i;
+
+    if (sockets == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < job->count; i++) {
+        sockets[i] = connect_server();
+        if (sockets[i] < 0) {
+            continue;
+        }
+
+        switch (job->kind) {
+            case ATTACK_SPLIT:
+                send(sockets[i], "\0", 1, 0);  /* Half a length prefix */
+                break;
+            case ATTACK_TRICKLE:
+                /* Length (2 + 1 + 1 + 8) and flag; the name follows slowly */
+                buffer[0] = 0;
+                buffer[1] = 12;
+                buffer[2] = FLAG_INITIAL_CONN;
+                buffer[3] = 8;
+                send(sockets[i], buffer, 4, 0);
+                break;
+            case ATTACK_NOREAD:
+                snprintf(name, sizeof(name), "noread%d", i);
+                if (login(sockets[i], name) < 0) {
+                    close(sockets[i]);
+                    sockets[i] = -1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    while (attacking) {
+        for (i = 0; i < job->count && attacking; i++) {
+            switch (job->kind) {
+                case ATTACK_TRICKLE:
+                    if (sockets[i] >= 0) {
+                        send(sockets[i], "x", 1, MSG_DONTWAIT);
+                    }
+                    break;
+                case ATTACK_OVERSIZE:
+                    if (sockets[i] < 0) {
+                        sockets[i] = connect_server();
+                    }
+                    if (sockets[i] >= 0) {
+                        memset(buffer, 0xff, sizeof(buffer));
+                        if (send(sockets[i], buffer, sizeof(buffer), MSG_DONTWAIT) < 0 &&
+                            errno != EAGAIN && errno != EWOULDBLOCK) {
+                            close(sockets[i]);  /* Dropped by the server, come back */
+                            sockets[i] = -1;
+                        }
+                    }
+                    break;
+                case ATTACK_NOREAD:
+                    if (sockets[i] >= 0) {
+                        uint8_t request[3 * 64];
+                        int j;
+                        for (j = 0; j < 64; j++) {
+                            request[3 * j] = 0;
+                            request[3 * j + 1] = 3;
+                            request[3 * j + 2] = FLAG_LIST_REQ;
+                        }
+                        send(sockets[i], request, sizeof(request), MSG_DONTWAIT);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        /* Trickle exactly one byte per second; the others just pace themselves */
+        if (job->kind == ATTACK_TRICKLE) {
+            sleep(1);
+        } else {
+            usleep(10000);
+        }
+    }
+
+    for (i = 0; i < job->count; i++) {
+        if (sockets[i] >= 0) {
+            close(sockets[i]);
+        }
+    }
+    free(sockets);
+    return NULL;
+}
+
+/*****************************************************************************
+ * churn_names - Log users in and out while the server's name table grows
+ *
+ * Each step logs a new user in, logs an older one out, and then challenges
+ * the user who left, which must be refused with Flag 22. The server's name
+ * table resizes many times on the way, and it moves a few slots to the new
+ * table per lookup, so names leave both before and after their slot has
+ * moved. A stale slot left behind shows up as a wrong answer or a server
+ * that died.
+ *
+ * Returns 0 if every challenge was refused, -1 otherwise.
+ *****************************************************************************/
+static int churn_names(Player *checker) {
+    uint8_t buffer[BUFFER_SIZE];
+    int sockets[CHURN_USERS];
+    char name[32];
+    int result = 0;
+    int len;
+    int i;
+    int j;
+
+    for (i = 0; i < CHURN_USERS; i++) {
+        snprintf(name, sizeof(name), "churn%d", i);
+        sockets[i] = connect_server();
+        if (sockets[i] < 0 || login(sockets[i], name) < 0) {
+            if (sockets[i] >= 0) close(sockets[i]);
+            printf("%-10s cannot log in %s\n", "churn", name);
+            result = -1;
+            break;
+        }
+
+        // each older user leaves once, at step 2j
+        j = i / 2;
+        if (i == 0 || i % 2 != 0) continue;
+        close(sockets[j]);
+        sockets[j] = -1;
+        usleep(2000);  /* Let the server see it go */
+
+        snprintf(name, sizeof(name), "churn%d", j);
+        len = strlen(name);
+        buffer[0] = FLAG_GAME_START_REQ;
+        buffer[1] = len;
+        memcpy(buffer + 2, name, len);
+        if (sendPDU(checker->socket, buffer, 2 + len) < 0 ||
+            expect(checker->socket, FLAG_GAME_START_ERR, buffer) < 0) {
+            printf("%-10s challenge to departed %s was not refused\n", "churn", name);
+            result = -1;
+            i++;
+            break;
+        }
+    }
+
+    while (i-- > 0) {
+        if (sockets[i] >= 0) close(sockets[i]);
+    }
+
+    if (result == 0) {
+        printf("%-10s %6d logins, %d logouts, every departed user refused\n",
+               "churn", CHURN_USERS, CHURN_USERS / 2);
+    }
+    return result;
+}
+
+/*****************************************************************************
+ * compare_doubles - qsort comparator
+ *****************************************************************************/
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*****************************************************************************
+ * run_phase - Play games on every pair and report the move latencies
+ *
+ * Returns the p99 move latency in ms, or -1 if a healthy game failed.
+ *****************************************************************************/
+static double run_phase(const char *label, Player *players, int pairs, int games) {
+    double p99;
+    int g;
+    int p;
+
+    sample_count = 0;
+    for (g = 0; g < games; g++) {
+        for (p = 0; p < pairs; p++) {
+            if (play_game(&players[2 * p], &players[2 * p + 1]) < 0) {
+                printf("%-10s healthy game failed (no response within %ds)\n",
+                       label, RECV_TIMEOUT_SEC);
+                return -1;
+            }
+        }
+    }
+
+    qsort(samples, sample_count, sizeof(double), compare_doubles);
+    p99 = samples[(int)(sample_count * 0.99)];
+    printf("%-10s %6d moves   p50 %8.2f ms   p99 %8.2f ms   max %8.2f ms\n",
+           label, sample_count, samples[sample_count / 2], p99,
+           samples[sample_count - 1]);
+    return p99;
+}
+
+/*****************************************************************************
+ * usage - Print command line help and exit
+ *****************************************************************************/
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-a attackers] [-g games] [-p pairs] [-l limit_ms] host port\n", program);
+    fprintf(stderr, "  -a n  Attackers of each kind (default %d)\n", DEFAULT_ATTACKERS);
+    fprintf(stderr, "  -g n  Games per healthy pair per phase (default %d)\n", DEFAULT_GAMES);
+    fprintf(stderr, "  -p n  Healthy pairs (default %d)\n", DEFAULT_PAIRS);
+    fprintf(stderr, "  -l n  Fail if p99 move latency under attack exceeds n ms (default %d)\n",
+            DEFAULT_LIMIT_MS);
+    exit(2);
+}
+
+/*****************************************************************************
+ * main - Churn phase, baseline phase, attack phase, verdict
+ *****************************************************************************/
+int main(int argc, char *argv[]) {
+    AttackJob jobs[ATTACK_KINDS];
+    pthread_t threads[ATTACK_KINDS];
+    struct timeval timeout = {RECV_TIMEOUT_SEC, 0};
+    Player *players;
+    int attackers = DEFAULT_ATTACKERS;
+    int games = DEFAULT_GAMES;
+    int pairs = DEFAULT_PAIRS;
+    int limit_ms = DEFAULT_LIMIT_MS;
+    double baseline;
+    double attacked;
+    int churned;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "a:g:p:l:")) != -1) {
+        switch (opt) {
+            case 'a': attackers = atoi(optarg); break;
+            case 'g': games = atoi(optarg); break;
+            case 'p': pairs = atoi(optarg); break;
+            case 'l': limit_ms = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 2 || attackers < 0 || games < 1 || pairs < 1 || limit_ms < 1) {
+        usage(argv[0]);
+    }
+    server_host = argv[optind];
+    server_port = argv[optind + 1];
+
+    /* Attackers see resets; that must not kill the harness */
+    signal(SIGPIPE, SIG_IGN);
+
+    players = calloc(2 * pairs, sizeof(Player));
+    if (players == NULL) {
+        return 2;
+    }
+    for (i = 0; i < 2 * pairs; i++) {
+        snprintf(players[i].name, sizeof(players[i].name), "healthy%d", i);
+        players[i].socket = connect_server();
+        if (players[i].socket < 0 || login(players[i].socket, players[i].name) < 0) {
+            fprintf(stderr, "Cannot log in %s at %s:%s\n", players[i].name, server_host, server_port);
+            return 2;
+        }
+        setsockopt(players[i].socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    churned = churn_names(&players[0]);
+    baseline = run_phase("baseline", players, pairs, games);
+
+    for (i = 0; i < ATTACK_KINDS; i++) {
+        jobs[i].kind = i;
+        jobs[i].count = attackers;
+        pthread_create(&threads[i], NULL, attack, &jobs[i]);
+    }
+    sleep(1);  /* Let every attacker get into position */
+
+    attacked = run_phase("attacked", players, pairs, games);
+
+    attacking = 0;
+    for (i = 0; i < ATTACK_KINDS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("attackers: %d each of", attackers);
+    for (i = 0; i < ATTACK_KINDS; i++) {
+        printf(" %s", attack_names[i]);
+    }
+    printf("\n");
+
+    for (i = 0; i < 2 * pairs; i++) {
+        close(players[i].socket);
+    }
+    free(players);
+    free(samples);
+
+    if (churned < 0) {
+        printf("FAIL: a user who logged out was still found\n");
+        return 1;
+    }
+    if (baseline < 0 || attacked < 0) {
+        printf("FAIL: a healthy game stalled\n");
+        return 1;
+    }
+    if (attacked > limit_ms) {
+        printf("FAIL: p99 under attack %.2f ms exceeds %d ms (baseline %.2f ms)\n",
+               attacked, limit_ms, baseline);
+        return 1;
+    }
+
+    printf("PASS: p99 under attack %.2f ms (baseline %.2f ms, limit %d ms)\n",
+           attacked, baseline, limit_ms);
+    return 0;
+}
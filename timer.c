@@ -0,0 +1,243 @@
+/*****************************************************************************
+ * timer.c - Hierarchical timer wheel implementation
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#include "timer.h"
+#include <limits.h>
+#include <time.h>
+
+/* Wheel geometry: level n slots are 64^n ticks wide */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+/* Furthest a timer can be from the current tick: the top level holds
+ * 63 full slots beyond the one in progress */
+#define WHEEL_RANGE (((uint64_t)WHEEL_SLOTS - 1) << (WHEEL_BITS * (WHEEL_LEVELS - 1)))
+
+/* Per thread, so every reactor runs its own wheel */
+static __thread Timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static __thread uint64_t occupied[WHEEL_LEVELS];  /* Bit n: slot n not empty */
+static __thread uint64_t next_tick;                /* First tick not run yet */
+static __thread int armed = 0;                     /* Timers in the wheel */
+
+/*****************************************************************************
+ * timer_link - Put a timer in the slot its tick falls into
+ *
+ * The lowest level whose slots still tell the timer's tick apart from the
+ * current one: the finest level holds the next 64 ticks, and a timer in
+ * a higher level moves down when the wheel reaches its slot.
+ *****************************************************************************/
+static void timer_link(Timer *timer) {
+    int shift;
+    int level = 0;
+
+    if (timer->expires < next_tick) {
+        timer->expires = next_tick;
+    }
+
+    for (;;) {
+        shift = WHEEL_BITS * level;
+        if (level == WHEEL_LEVELS - 1 ||
+            (timer->expires >> shift) - (next_tick >> shift) < WHEEL_SLOTS) {
+            break;
+        }
+        level++;
+    }
+
+    timer->level = level;
+    timer->slot = (int)((timer->expires >> shift) & WHEEL_MASK);
+    timer->next = wheel[level][timer->slot];
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    wheel[level][timer->slot] = timer;
+    timer->pprev = &wheel[level][timer->slot];
+    occupied[level] |= 1ULL << timer->slot;
+    armed++;
+}
+
+/*****************************************************************************
+ * timer_unlink - Take a timer out of its slot
+ *****************************************************************************/
+static void timer_unlink(Timer *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    if (wheel[timer->level][timer->slot] == NULL) {
+        occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+    armed--;
+}
+
+/*****************************************************************************
+ * timer_next_tick - First tick at which some slot needs work
+ *
+ * For the finest level that is the tick a slot's timers expire on; for
+ * the levels above, the tick at which a slot's timers move down.
+ *****************************************************************************/
+static uint64_t timer_next_tick(void) {
+    uint64_t best = UINT64_MAX;
+    uint64_t current;
+    uint64_t rotated;
+    uint64_t tick;
+    int shift;
+    int offset;
+    int level;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        if (occupied[level] == 0) {
+            continue;
+        }
+
+        /* Rotate so that bit 0 is the slot the wheel is in now */
+        shift = WHEEL_BITS * level;
+        current = next_tick >> shift;
+        offset = (int)(current & WHEEL_MASK);
+        rotated = offset ? (occupied[level] >> offset) | (occupied[level] << (WHEEL_SLOTS - offset))
+                         : occupied[level];
+
+        tick = (current + __builtin_ctzll(rotated)) << shift;
+        if (tick < next_tick) {
+            tick = next_tick;
+        }
+        if (tick < best) {
+            best = tick;
+        }
+    }
+
+    return best;
+}
+
+/*****************************************************************************
+ * timer_init - Set the function a timer calls when it expires
+ *****************************************************************************/
+void timer_init(Timer *timer, void (*expire)(Timer *timer)) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->expire = expire;
+}
+
+/*****************************************************************************
+ * timer_arm - Make a timer fire at a point in time (re-arms if armed)
+ *****************************************************************************/
+void timer_arm(Timer *timer, uint64_t when_ms) {
+    if (timer->pprev != NULL) {
+        timer_unlink(timer);
+    }
+
+    /* timer_run() does not track the clock while the wheel is empty, so
+     * an empty wheel restarts from the current tick */
+    if (armed == 0) {
+        next_tick = timer_now() / TIMER_TICK_MS;
+    }
+
+    timer->expires = (when_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (timer->expires > next_tick + WHEEL_RANGE - 1) {
+        timer->expires = next_tick + WHEEL_RANGE - 1;
+    }
+    timer_link(timer);
+}
+
+/*****************************************************************************
+ * timer_cancel - Disarm a timer (does nothing if it is not armed)
+ *****************************************************************************/
+void timer_cancel(Timer *timer) {
+    if (timer->pprev != NULL) {
+        timer_unlink(timer);
+    }
+}
+
+/*****************************************************************************
+ * timer_pending - Check whether a timer is armed
+ *****************************************************************************/
+int timer_pending(const Timer *timer) {
+    return timer->pprev != NULL;
+}
+
+/*****************************************************************************
+ * timer_now - Read the clock timers use
+ *****************************************************************************/
+uint64_t timer_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/*****************************************************************************
+ * timer_run - Fire every timer of the calling thread that is due
+ *****************************************************************************/
+int timer_run(void) {
+    uint64_t now_ms;
+    uint64_t now_tick;
+    uint64_t tick;
+    uint64_t wait;
+    Timer *expired;
+    Timer *timer;
+    int shift;
+    int level;
+    int slot;
+
+    if (armed == 0) {
+        return -1;
+    }
+
+    now_ms = timer_now();
+    now_tick = now_ms / TIMER_TICK_MS;
+
+    /* Visit only the ticks where a slot has work; every slot in between
+     * is empty, so skipping it loses nothing */
+    while (armed > 0 && (tick = timer_next_tick()) <= now_tick) {
+        next_tick = tick;
+
+        /* Move timers down first, top level first, so a timer landing in
+         * a slot that is also due now is handled in this same tick */
+        for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+            shift = WHEEL_BITS * level;
+            if ((tick & ((1ULL << shift) - 1)) != 0) {
+                continue;
+            }
+            slot = (int)((tick >> shift) & WHEEL_MASK);
+            while ((timer = wheel[level][slot]) != NULL) {
+                timer_unlink(timer);
+                timer_link(timer);
+            }
+        }
+
+        /* Take the due slot's list out of the wheel first: the finest
+         * level wraps every 64 ticks, so a timer armed by an expire
+         * function for 64 ticks from now goes into this same slot. The
+         * taken timers stay armed (and cancellable) until they fire. */
+        next_tick = tick + 1;
+        slot = (int)(tick & WHEEL_MASK);
+        expired = wheel[0][slot];
+        wheel[0][slot] = NULL;
+        occupied[0] &= ~(1ULL << slot);
+        if (expired != NULL) {
+            expired->pprev = &expired;
+        }
+        while ((timer = expired) != NULL) {
+            timer_unlink(timer);
+            timer->expire(timer);
+        }
+    }
+
+    if (next_tick <= now_tick) {
+        next_tick = now_tick + 1;
+    }
+
+    if (armed == 0) {
+        return -1;
+    }
+
+    wait = timer_next_tick() * TIMER_TICK_MS - now_ms;
+    return wait > INT_MAX ? INT_MAX : (int)wait;
+}
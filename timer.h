@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * timer.h - Hierarchical timer wheel for the event loops
+ *
+ * Each event loop thread has its own wheel: 4 levels of 64 slots, 10 ms
+ * per tick on the first level and 64 times coarser on each level above,
+ * so deadlines up to about 46 hours out are held without any sorting.
+ * Arming and cancelling a timer are O(1) list operations. A bitmap of
+ * occupied slots per level lets timer_run() jump straight to the next
+ * slot with work in it, so the loop only wakes up when a timer is due,
+ * however many are armed.
+ *
+ * Timers are embedded in the caller's own structures (no allocation).
+ * A timer belongs to the thread that armed it: only that thread may
+ * cancel it or arm it again, and its expire function runs there.
+ *
+ * Users whose deadline moves often (a move clock, an idle timeout) should
+ * not re-arm on every change: store the new deadline, and let the old
+ * timer fire, check it, and re-arm for what is left.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* Milliseconds per tick of the finest level */
+#define TIMER_TICK_MS 10
+
+/* One timer; zero-filled memory is a valid timer that is not armed */
+typedef struct Timer {
+    struct Timer *next;           /* Next timer in the same slot */
+    struct Timer **pprev;         /* Link pointing at this one; NULL if not armed */
+    uint64_t expires;             /* Tick it fires on */
+    void (*expire)(struct Timer *timer);
+    int level;                    /* Slot it is linked into */
+    int slot;
+} Timer;
+
+/*****************************************************************************
+ * timer_init - Set the function a timer calls when it expires
+ *
+ * Must not be called while the timer is armed.
+ *****************************************************************************/
+void timer_init(Timer *timer, void (*expire)(Timer *timer));
+
+/*****************************************************************************
+ * timer_arm - Make a timer fire at a point in time (re-arms if armed)
+ *
+ * The timer fires from the first timer_run() at or after when_ms, rounded
+ * up to the next tick. Deadlines beyond the wheel's range fire early, at
+ * the edge of the range; the expire function re-arms for the rest.
+ *
+ * Parameters:
+ *   timer   - The timer (timer_init() must have set its expire function)
+ *   when_ms - Deadline on the timer_now() clock
+ *****************************************************************************/
+void timer_arm(Timer *timer, uint64_t when_ms);
+
+/*****************************************************************************
+ * timer_cancel - Disarm a timer (does nothing if it is not armed)
+ *****************************************************************************/
+void timer_cancel(Timer *timer);
+
+/*****************************************************************************
+ * timer_pending - Check whether a timer is armed
+ *****************************************************************************/
+int timer_pending(const Timer *timer);
+
+/*****************************************************************************
+ * timer_now - Read the clock timers use
+ *
+ * Returns:
+ *   Milliseconds on a monotonic clock, comparable between threads
+ *****************************************************************************/
+uint64_t timer_now(void);
+
+/*****************************************************************************
+ * timer_run - Fire every timer of the calling thread that is due
+ *
+ * Called by the event loop once per pass; expire functions may arm and
+ * cancel timers, including the one that fired.
+ *
+ * Returns:
+ *   Milliseconds until the next timer is due (the wait timeout to use),
+ *   or -1 if no timer is armed
+ *****************************************************************************/
+int timer_run(void);
+
+#endif /* TIMER_H */
@@ -0,0 +1,1016 @@
+/*****************************************************************************
+ * uring.c - io_uring I/O backend for the server (Linux only)
+ *
+ * Talks to the kernel through the raw io_uring system calls, so there is
+ * no dependency on liburing.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include "uring.h"
+#include <stdio.h>
+
+#ifdef __linux__
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "conn.h"
+
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+
+/* Provided receive buffers (count must be a power of two) */
+#define URING_BUF_COUNT 256
+#define URING_BUF_SIZE 4096
+#define URING_BUF_GROUP 0
+
+/* Once this much waits in a client's overflow its recv is cancelled, and
+ * only re-armed when the overflow has drained: the socket buffer and the
+ * TCP window then push back on a client that pipelines faster than its
+ * dispatch limit, as with poll and epoll */
+#define URING_OVERFLOW_LIMIT (4 * CONN_RECV_SIZE)
+
+/* What a submission was for; the UringOp's address is the user_data */
+typedef enum {
+    OP_ACCEPT,
+    OP_RECV,
+    OP_SEND,
+    OP_CANCEL,
+    OP_WAKE
+} UringOpType;
+
+typedef struct {
+    UringOpType type;
+    int socket;           /* -1 once the client is gone (late completions) */
+    uint8_t *buffer;      /* OP_SEND: output taken from the connection (owned) */
+    int length;
+    int offset;           /* OP_SEND: bytes already written */
+} UringOp;
+
+/* In-flight operations of one client, indexed by socket */
+typedef struct {
+    UringOp *recv;
+    UringOp *send;
+    uint8_t *overflow;    /* Received bytes that did not fit in the reader yet */
+    int overflow_length;
+    int overflow_capacity;
+    int recv_paused;      /* Overflow full: recv cancelled, not to be re-armed */
+    int recv_idle;        /* The paused recv has ended; re-arm it to resume */
+} UringSession;
+
+/* Mapped rings and the bookkeeping to fill and drain them */
+typedef struct {
+    int fd;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_flags;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_pending;  /* Queued but not yet handed to io_uring_enter() */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    uint8_t *buf_pool;
+    unsigned buf_tail;
+} Ring;
+
+/* Per thread: every reactor has its own ring */
+static __thread Ring ring;
+static __thread const ServerCallbacks *callbacks;
+
+static __thread UringSession *sessions = NULL;
+static __thread int sessions_size = 0;
+
+/* Clients with complete PDUs left over after their dispatch limit */
+static __thread int *backlog = NULL;
+static __thread int backlog_count = 0;
+static __thread int backlog_capacity = 0;
+
+/* Stopping for a handoff: nothing is re-armed and no new send starts */
+static __thread int draining = 0;
+static __thread int accepting = 0;   /* The multishot accept is armed */
+
+static __thread UringOp accept_op = {OP_ACCEPT, -1, NULL, 0, 0};
+static __thread UringOp cancel_op = {OP_CANCEL, -1, NULL, 0, 0};
+static __thread UringOp wake_op = {OP_WAKE, -1, NULL, 0, 0};
+
+/*****************************************************************************
+ * uring_enter - Submit queued entries and optionally wait for completions
+ *
+ * A wait gives up after timeout_ms (-1 waits for as long as it takes), so
+ * timers get to run; the timeout goes in an extended argument, which every
+ * kernel with multishot accept supports. Fails with ETIME if it expired
+ * and nothing was submitted.
+ *****************************************************************************/
+static int uring_enter(unsigned wait, int timeout_ms) {
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec timeout;
+    int submitted;
+
+    conn_io_syscalls++;
+    if (wait && timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&timeout;
+        submitted = syscall(__NR_io_uring_enter, ring.fd, ring.sq_pending, wait,
+                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    } else {
+        submitted = syscall(__NR_io_uring_enter, ring.fd, ring.sq_pending, wait,
+                            wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    }
+    if (submitted < 0) {
+        return -1;
+    }
+
+    ring.sq_pending -= submitted;
+    return 0;
+}
+
+/*****************************************************************************
+ * uring_get_sqe - Claim the next submission entry, flushing if the SQ is full
+ *****************************************************************************/
+static struct io_uring_sqe *uring_get_sqe(UringOp *op) {
+    struct io_uring_sqe *sqe;
+    unsigned tail = *ring.sq_tail;
+    unsigned index;
+
+    while (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+        if (uring_enter(0, -1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring_enter");
+            return NULL;
+        }
+    }
+
+    index = tail & ring.sq_mask;
+    sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    ring.sq_array[index] = index;
+    return sqe;
+}
+
+/*****************************************************************************
+ * uring_queue_sqe - Publish a filled-in entry to the kernel
+ *****************************************************************************/
+static void uring_queue_sqe(void) {
+    __atomic_store_n(ring.sq_tail, *ring.sq_tail + 1, __ATOMIC_RELEASE);
+    ring.sq_pending++;
+}
+
+/*****************************************************************************
+ * uring_arm_accept - (Re)arm the multishot accept
+ *****************************************************************************/
+static void uring_arm_accept(void) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&accept_op);
+
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = accept_op.socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    uring_queue_sqe();
+    accepting = 1;
+}
+
+/*****************************************************************************
+ * uring_arm_wake - (Re)arm a multishot poll on the server's wake descriptor
+ *****************************************************************************/
+static void uring_arm_wake(void) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&wake_op);
+
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wake_op.socket;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    uring_queue_sqe();
+}
+
+/*****************************************************************************
+ * uring_arm_recv - (Re)arm a client's multishot recv on the buffer ring
+ *****************************************************************************/
+static void uring_arm_recv(UringOp *op) {
+    struct io_uring_sqe *sqe = uring_get_sqe(op);
+
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = op->socket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    uring_queue_sqe();
+}
+
+/*****************************************************************************
+ * uring_cancel - Ask the kernel to end an operation (it completes -ECANCELED)
+ *****************************************************************************/
+static void uring_cancel(UringOp *op) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&cancel_op);
+
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)op;
+    uring_queue_sqe();
+}
+
+/*****************************************************************************
+ * uring_submit_send - Submit the unwritten part of a send operation
+ *****************************************************************************/
+static void uring_submit_send(UringOp *op) {
+    struct io_uring_sqe *sqe = uring_get_sqe(op);
+
+    if (sqe == NULL) {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = op->socket;
+    sqe->addr = (uint64_t)(uintptr_t)(op->buffer + op->offset);
+    sqe->len = op->length - op->offset;
+    uring_queue_sqe();
+}
+
+/*****************************************************************************
+ * uring_recycle_buffer - Give a provided buffer back to the kernel
+ *****************************************************************************/
+static void uring_recycle_buffer(unsigned bid) {
+    struct io_uring_buf *buf = &ring.buf_ring->bufs[ring.buf_tail & (URING_BUF_COUNT - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(ring.buf_pool + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ring.buf_tail++;
+    __atomic_store_n(&ring.buf_ring->tail, (uint16_t)ring.buf_tail, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************
+ * uring_session - Get the session slot for a socket, growing the table
+ *****************************************************************************/
+static UringSession *uring_session(int socket) {
+    UringSession *table;
+    int new_size;
+
+    if (socket < 0) {
+        return NULL;
+    }
+
+    if (socket >= sessions_size) {
+        new_size = sessions_size ? sessions_size : 64;
+        while (new_size <= socket) {
+            new_size *= 2;
+        }
+
+        table = realloc(sessions, new_size * sizeof(UringSession));
+        if (table == NULL) {
+            return NULL;
+        }
+        memset(table + sessions_size, 0, (new_size - sessions_size) * sizeof(UringSession));
+        sessions = table;
+        sessions_size = new_size;
+    }
+
+    return &sessions[socket];
+}
+
+/*****************************************************************************
+ * uring_backlog_add - Remember a client that still has complete PDUs
+ *****************************************************************************/
+static void uring_backlog_add(int socket) {
+    int *grown;
+    int new_capacity;
+
+    if (backlog_count == backlog_capacity) {
+        new_capacity = backlog_capacity ? backlog_capacity * 2 : 64;
+        grown = realloc(backlog, new_capacity * sizeof(int));
+        if (grown == NULL) {
+            return;  /* Picked up again when the client sends more */
+        }
+        backlog = grown;
+        backlog_capacity = new_capacity;
+    }
+
+    backlog[backlog_count++] = socket;
+}
+
+/*****************************************************************************
+ * uring_overflow_append - Park received bytes the reader has no room for
+ *****************************************************************************/
+static int uring_overflow_append(UringSession *session, const uint8_t *data, int length) {
+    uint8_t *grown;
+    int new_capacity;
+
+    if (session->overflow_length + length > session->overflow_capacity) {
+        new_capacity = session->overflow_capacity ? session->overflow_capacity : URING_BUF_SIZE;
+        while (new_capacity < session->overflow_length + length) {
+            new_capacity *= 2;
+        }
+        grown = realloc(session->overflow, new_capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        session->overflow = grown;
+        session->overflow_capacity = new_capacity;
+    }
+
+    memcpy(session->overflow + session->overflow_length, data, length);
+    session->overflow_length += length;
+    return 0;
+}
+
+/*****************************************************************************
+ * uring_overflow_feed - Move parked bytes into the reader as room allows
+ *****************************************************************************/
+static void uring_overflow_feed(UringSession *session, Connection *conn) {
+    int fed;
+
+    if (session->overflow_length == 0) {
+        return;
+    }
+
+    fed = feedPDUReader(&conn->reader, session->overflow, session->overflow_length);
+    session->overflow_length -= fed;
+    if (session->overflow_length > 0) {
+        memmove(session->overflow, session->overflow + fed, session->overflow_length);
+    } else {
+        free(session->overflow);
+        session->overflow = NULL;
+        session->overflow_capacity = 0;
+    }
+}
+
+/*****************************************************************************
+ * uring_close - Drop a client: orphan its operations, then close it
+ *****************************************************************************/
+static void uring_close(int socket) {
+    UringSession *session = uring_session(socket);
+
+    if (session != NULL && session->recv != NULL && session->recv_idle) {
+        free(session->recv);  /* Paused and already ended in the kernel */
+        session->recv = NULL;
+    } else if (session != NULL && session->recv != NULL) {
+        /* Closing the descriptor does not end a multishot recv; cancel it.
+         * The op is freed by its final completion. */
+        session->recv->socket = -1;
+        uring_cancel(session->recv);
+        session->recv = NULL;
+    }
+
+    if (session != NULL && session->send != NULL) {
+        /* The kernel may still be reading its buffer; freed on completion */
+        session->send->socket = -1;
+        session->send = NULL;
+    }
+
+    if (session != NULL) {
+        free(session->overflow);
+        session->overflow = NULL;
+        session->overflow_length = 0;
+        session->overflow_capacity = 0;
+        session->recv_paused = 0;
+        session->recv_idle = 0;
+    }
+
+    callbacks->close_session(socket);
+}
+
+/*****************************************************************************
+ * uring_send - Output hook: start writing a connection's queued output
+ *****************************************************************************/
+static void uring_send(Connection *conn) {
+    UringSession *session = uring_session(conn->socket);
+    UringOp *op = malloc(sizeof(UringOp));
+
+    if (session == NULL || op == NULL) {
+        free(op);
+        conn_fail(conn);
+        return;
+    }
+
+    op->type = OP_SEND;
+    op->socket = conn->socket;
+    op->offset = 0;
+    op->buffer = conn_take_output(conn, &op->length);
+    if (op->buffer == NULL) {
+        free(op);
+        return;
+    }
+
+    /* One send in flight per connection keeps the byte stream in order */
+    conn_set_writable(conn, 0);
+    session->send = op;
+    uring_submit_send(op);
+}
+
+/*****************************************************************************
+ * uring_has_backlog - Check whether a client has input left to dispatch
+ *****************************************************************************/
+static int uring_has_backlog(UringSession *session, Connection *conn) {
+    return conn_has_buffered_pdu(conn) || session->overflow_length > 0;
+}
+
+/*****************************************************************************
+ * uring_pause_recv - Stop receiving for a client whose overflow is full
+ *
+ * Completions already on their way are still appended, so the overflow
+ * ends up at most a few buffers past the limit.
+ *****************************************************************************/
+static void uring_pause_recv(UringSession *session) {
+    if (session->recv_paused || session->recv == NULL) {
+        return;
+    }
+
+    session->recv_paused = 1;
+    uring_cancel(session->recv);
+}
+
+/*****************************************************************************
+ * uring_resume_recv - Start receiving again once the overflow has drained
+ *
+ * If the cancelled recv has not completed yet, its final completion
+ * re-arms it instead.
+ *****************************************************************************/
+static void uring_resume_recv(UringSession *session) {
+    session->recv_paused = 0;
+    if (session->recv_idle && !draining) {
+        session->recv_idle = 0;
+        uring_arm_recv(session->recv);
+    }
+}
+
+/*****************************************************************************
+ * uring_dispatch - Give a client one dispatch turn, refilling from overflow
+ *****************************************************************************/
+static void uring_dispatch(int socket) {
+    UringSession *session = uring_session(socket);
+    Connection *conn = conn_get(socket);
+
+    if (session == NULL || conn == NULL || callbacks->client_data(socket) < 0) {
+        uring_close(socket);
+        return;
+    }
+
+    /* Make room first, so a full reader never stalls the byte stream */
+    uring_overflow_feed(session, conn);
+    if (session->overflow_length > 0 && !conn_has_buffered_pdu(conn)) {
+        uring_close(socket);  /* Full reader with no complete PDU in it */
+        return;
+    }
+
+    /* Drained: let the kernel deliver again */
+    if (session->recv_paused && session->overflow_length == 0) {
+        uring_resume_recv(session);
+    }
+
+    if (uring_has_backlog(session, conn)) {
+        uring_backlog_add(socket);
+    }
+}
+
+/*****************************************************************************
+ * uring_received - Feed received bytes to a client and dispatch its PDUs
+ *
+ * Like the poll() backend, a client gets at most pdus_per_wakeup PDUs per
+ * pass. The kernel keeps delivering with a multishot recv, so whatever
+ * does not fit in the reader waits in the session's overflow and is
+ * picked up by later passes through the backlog. A full overflow pauses
+ * the recv until it drains (URING_OVERFLOW_LIMIT).
+ *****************************************************************************/
+static void uring_received(int socket, const uint8_t *data, int length) {
+    UringSession *session = uring_session(socket);
+    Connection *conn = conn_get(socket);
+    int fed;
+
+    if (session == NULL || conn == NULL) {
+        uring_close(socket);
+        return;
+    }
+
+    if (session->overflow_length > 0 || uring_has_backlog(session, conn)) {
+        /* Already waiting for its next turn; keep the bytes in order */
+        if (uring_overflow_append(session, data, length) < 0) {
+            uring_close(socket);
+            return;
+        }
+        if (session->overflow_length >= URING_OVERFLOW_LIMIT) {
+            uring_pause_recv(session);
+        }
+        return;
+    }
+
+    fed = feedPDUReader(&conn->reader, data, length);
+    if (fed < length && uring_overflow_append(session, data + fed, length - fed) < 0) {
+        uring_close(socket);
+        return;
+    }
+    if (session->overflow_length >= URING_OVERFLOW_LIMIT) {
+        uring_pause_recv(session);
+    }
+
+    uring_dispatch(socket);
+}
+
+/*****************************************************************************
+ * uring_watch - Start receiving for a client that has a Connection
+ *****************************************************************************/
+static void uring_watch(int socket) {
+    UringSession *session = uring_session(socket);
+    UringOp *op = calloc(1, sizeof(UringOp));
+
+    if (session == NULL || op == NULL) {
+        free(op);
+        fprintf(stderr, "Out of memory for new client\n");
+        callbacks->close_session(socket);
+        return;
+    }
+
+    op->type = OP_RECV;
+    op->socket = socket;
+    session->recv = op;
+    uring_arm_recv(op);
+}
+
+/*****************************************************************************
+ * uring_complete_accept - Handle a multishot accept completion
+ *****************************************************************************/
+static void uring_complete_accept(struct io_uring_cqe *cqe) {
+    if (cqe->res < 0) {
+        if (cqe->res != -EINTR && cqe->res != -EAGAIN && cqe->res != -ECANCELED) {
+            fprintf(stderr, "accept: %s\n", strerror(-cqe->res));
+        }
+    } else if (callbacks->open_session(cqe->res) < 0) {
+        close(cqe->res);
+    } else if (!draining) {
+        uring_watch(cqe->res);
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        accepting = 0;
+        if (!draining) {
+            uring_arm_accept();
+        }
+    }
+}
+
+/*****************************************************************************
+ * uring_complete_recv - Handle a multishot recv completion
+ *****************************************************************************/
+static void uring_complete_recv(UringOp *op, struct io_uring_cqe *cqe) {
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+    if (op->socket >= 0) {
+        if (cqe->res > 0) {
+            uring_received(op->socket, ring.buf_pool + (size_t)bid * URING_BUF_SIZE, cqe->res);
+        } else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+            /* 0 is an orderly shutdown; ENOBUFS only means the ring ran dry,
+             * and a live client's recv is only cancelled to pause it or
+             * for a handoff */
+            uring_close(op->socket);
+        }
+    }
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uring_recycle_buffer(bid);
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        if (op->socket >= 0 && !draining && uring_session(op->socket)->recv_paused) {
+            uring_session(op->socket)->recv_idle = 1;  /* uring_resume_recv() re-arms it */
+        } else if (op->socket >= 0 && !draining) {
+            uring_arm_recv(op);
+        } else {
+            if (op->socket >= 0) {
+                uring_session(op->socket)->recv = NULL;
+            }
+            free(op);
+        }
+    }
+}
+
+/*****************************************************************************
+ * uring_complete_send - Handle a send completion
+ *****************************************************************************/
+static void uring_complete_send(UringOp *op, struct io_uring_cqe *cqe) {
+    int socket = op->socket;
+    int cancelled = draining && cqe->res == -ECANCELED;
+    Connection *conn;
+
+    if (socket >= 0 && cqe->res > 0) {
+        conn_output_sent(conn_get(socket), cqe->res);
+        op->offset += cqe->res;
+        if (op->offset < op->length && !draining) {
+            uring_submit_send(op);  /* Short write: send the rest first */
+            return;
+        }
+    }
+
+    /* Stopping for a handoff: the unwritten rest goes back to the client's
+     * queue for the next server to write */
+    if (socket >= 0 && (cqe->res > 0 || cancelled) && op->offset < op->length) {
+        conn_return_output(conn_get(socket), op->buffer + op->offset, op->length - op->offset);
+    }
+
+    free(op->buffer);
+    free(op);
+
+    if (socket < 0) {
+        return;
+    }
+
+    uring_session(socket)->send = NULL;
+    if (cqe->res <= 0 && !cancelled) {
+        uring_close(socket);
+        return;
+    }
+
+    /* Output queued while this send was in flight goes out now */
+    conn = conn_get(socket);
+    conn_set_writable(conn, 1);
+    if (conn_has_pending_output(conn) && !draining) {
+        uring_send(conn);
+    }
+}
+
+/*****************************************************************************
+ * uring_reap - Handle every completion the kernel has posted
+ *****************************************************************************/
+static void uring_reap(void) {
+    unsigned head = *ring.cq_head;
+    struct io_uring_cqe *cqe;
+    UringOp *op;
+
+    while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+        cqe = &ring.cqes[head & ring.cq_mask];
+        op = (UringOp *)(uintptr_t)cqe->user_data;
+
+        switch (op->type) {
+            case OP_ACCEPT:
+                uring_complete_accept(cqe);
+                break;
+            case OP_RECV:
+                uring_complete_recv(op, cqe);
+                break;
+            case OP_SEND:
+                uring_complete_send(op, cqe);
+                break;
+            case OP_CANCEL:
+                break;
+            case OP_WAKE:
+                callbacks->wake();
+                if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                    uring_arm_wake();
+                }
+                break;
+        }
+
+        head++;
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/*****************************************************************************
+ * uring_process_backlog - Give clients with leftover PDUs another turn
+ *****************************************************************************/
+static void uring_process_backlog(void) {
+    int count = backlog_count;
+    int socket;
+    int i;
+
+    backlog_count = 0;
+    for (i = 0; i < count; i++) {
+        socket = backlog[i];
+        if (conn_get(socket) == NULL) {
+            continue;  /* Disconnected since it was queued */
+        }
+
+        uring_dispatch(socket);
+    }
+}
+
+/*****************************************************************************
+ * uring_quiesce - Stop all I/O for a handoff, leaving clients in place
+ *
+ * Accepting stops and every recv and send in flight is cancelled. Bytes
+ * received before a cancel lands are dispatched as usual, so a reader is
+ * left with a partial PDU at most and nothing waits in an overflow;
+ * output the kernel did not take goes back to its connection. Nothing
+ * is closed and no new operation starts.
+ *****************************************************************************/
+static void uring_quiesce(void) {
+    int socket;
+    int busy;
+    int i;
+
+    draining = 1;
+    if (accepting) {
+        uring_cancel(&accept_op);
+    }
+    for (i = 0; i < sessions_size; i++) {
+        if (sessions[i].recv != NULL && sessions[i].recv_idle) {
+            free(sessions[i].recv);  /* Paused; nothing in the kernel to cancel */
+            sessions[i].recv = NULL;
+            sessions[i].recv_idle = 0;
+        } else if (sessions[i].recv != NULL) {
+            uring_cancel(sessions[i].recv);
+        }
+        if (sessions[i].send != NULL) {
+            uring_cancel(sessions[i].send);
+        }
+    }
+
+    do {
+        if (uring_enter(1, 100) < 0 && errno != ETIME && errno != EINTR &&
+            errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring_enter");
+            break;
+        }
+
+        uring_reap();
+        while (backlog_count > 0) {
+            uring_process_backlog();
+        }
+        while ((socket = conn_next_failed()) >= 0) {
+            uring_close(socket);
+        }
+
+        busy = accepting;
+        for (i = 0; i < sessions_size && !busy; i++) {
+            busy = sessions[i].recv != NULL || sessions[i].send != NULL;
+        }
+    } while (busy);
+
+    draining = 0;
+}
+
+/*****************************************************************************
+ * uring_setup - Create the ring, map it, and register the buffer ring
+ *****************************************************************************/
+static int uring_setup(void) {
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    unsigned i;
+
+    memset(&ring, 0, sizeof(ring));
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = URING_CQ_ENTRIES;
+    ring.fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+    if (ring.fd < 0 && errno == EINVAL) {
+        /* Kernels before 6.0 lack the last two flags; they are only hints */
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_CQ_ENTRIES;
+        ring.fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+    }
+    if (ring.fd < 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring.cq_size > ring.sq_size) {
+            ring.sq_size = ring.cq_size;
+        }
+        ring.cq_size = ring.sq_size;
+    }
+
+    ring.sq_ptr = mmap(NULL, ring.sq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sq_ptr == MAP_FAILED) {
+        perror("mmap");
+        close(ring.fd);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.cq_ptr = ring.sq_ptr;
+    } else {
+        ring.cq_ptr = mmap(NULL, ring.cq_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (ring.cq_ptr == MAP_FAILED) {
+            perror("mmap");
+            munmap(ring.sq_ptr, ring.sq_size);
+            close(ring.fd);
+            return -1;
+        }
+    }
+
+    ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        perror("mmap");
+        goto fail_rings;
+    }
+
+    ring.sq_head = (unsigned *)((char *)ring.sq_ptr + params.sq_off.head);
+    ring.sq_tail = (unsigned *)((char *)ring.sq_ptr + params.sq_off.tail);
+    ring.sq_flags = (unsigned *)((char *)ring.sq_ptr + params.sq_off.flags);
+    ring.sq_mask = *(unsigned *)((char *)ring.sq_ptr + params.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)((char *)ring.sq_ptr + params.sq_off.array);
+    ring.sq_entries = params.sq_entries;
+    ring.cq_head = (unsigned *)((char *)ring.cq_ptr + params.cq_off.head);
+    ring.cq_tail = (unsigned *)((char *)ring.cq_ptr + params.cq_off.tail);
+    ring.cq_mask = *(unsigned *)((char *)ring.cq_ptr + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)((char *)ring.cq_ptr + params.cq_off.cqes);
+
+    /* Provided buffer ring (kernel 5.19+): page-aligned ring of descriptors */
+    ring.buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    ring.buf_ring = mmap(NULL, ring.buf_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring.buf_pool = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (ring.buf_ring == MAP_FAILED || ring.buf_pool == NULL) {
+        fprintf(stderr, "io_uring: out of memory for receive buffers\n");
+        goto fail_buffers;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring.buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("io_uring_register");
+        goto fail_buffers;
+    }
+
+    for (i = 0; i < URING_BUF_COUNT; i++) {
+        uring_recycle_buffer(i);
+    }
+
+    return 0;
+
+fail_buffers:
+    if (ring.buf_ring != MAP_FAILED) {
+        munmap(ring.buf_ring, ring.buf_ring_size);
+    }
+    free(ring.buf_pool);
+    munmap(ring.sqes, ring.sqes_size);
+fail_rings:
+    if (ring.cq_ptr != ring.sq_ptr) {
+        munmap(ring.cq_ptr, ring.cq_size);
+    }
+    munmap(ring.sq_ptr, ring.sq_size);
+    close(ring.fd);
+    return -1;
+}
+
+/*****************************************************************************
+ * uring_teardown - Close the ring and free everything the backend owns
+ *****************************************************************************/
+static void uring_teardown(void) {
+    int i;
+
+    /* Closing the ring cancels whatever is still in flight */
+    munmap(ring.sqes, ring.sqes_size);
+    if (ring.cq_ptr != ring.sq_ptr) {
+        munmap(ring.cq_ptr, ring.cq_size);
+    }
+    munmap(ring.sq_ptr, ring.sq_size);
+    close(ring.fd);
+    munmap(ring.buf_ring, ring.buf_ring_size);
+    free(ring.buf_pool);
+
+    for (i = 0; i < sessions_size; i++) {
+        free(sessions[i].recv);
+        free(sessions[i].overflow);
+        if (sessions[i].send != NULL) {
+            free(sessions[i].send->buffer);
+            free(sessions[i].send);
+        }
+    }
+    free(sessions);
+    sessions = NULL;
+    sessions_size = 0;
+
+    free(backlog);
+    backlog = NULL;
+    backlog_count = 0;
+    backlog_capacity = 0;
+}
+
+/*****************************************************************************
+ * uring_run_server - Serve clients with io_uring until *keep_running is 0
+ *****************************************************************************/
+int uring_run_server(int server_socket, const ServerCallbacks *server_callbacks,
+                     volatile int *keep_running) {
+    Connection *conn;
+    int timeout = -1;
+    int cursor = 0;
+    unsigned wait;
+    int wait_ms;
+    int socket;
+
+    if (uring_setup() < 0) {
+        return -1;
+    }
+
+    callbacks = server_callbacks;
+    conn_set_output_hook(uring_send);
+
+    accept_op.socket = server_socket;
+    uring_arm_accept();
+
+    /* Clients taken over from another server; buffered input gets a turn
+     * in the first pass */
+    while ((conn = conn_next(&cursor)) != NULL) {
+        uring_watch(conn->socket);
+        if (conn_has_buffered_pdu(conn)) {
+            uring_backlog_add(conn->socket);
+        }
+    }
+
+    wake_op.socket = callbacks->wake_fd;
+    if (wake_op.socket >= 0) {
+        uring_arm_wake();
+    }
+
+    while (*keep_running) {
+        /* Queue this pass's sends; they are submitted with the wait below */
+        conn_flush_pending();
+
+        wait = backlog_count > 0 ? 0 : 1;
+        wait_ms = timeout;
+        if (callbacks->busy_poll) {
+            /* Only enter the kernel to submit, or to flush completions that
+             * overflowed the ring; the rest are read straight off it */
+            wait = (__atomic_load_n(ring.sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) != 0;
+            wait_ms = 0;
+        }
+
+        /* ETIME: the wait timed out, so a timer is due; carry on to it */
+        if ((!callbacks->busy_poll || ring.sq_pending > 0 || wait) &&
+            uring_enter(wait, wait_ms) < 0 && errno != ETIME) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            perror("io_uring_enter");
+            break;
+        }
+
+        uring_reap();
+        uring_process_backlog();
+        timeout = timer_run();
+
+        while ((socket = conn_next_failed()) >= 0) {
+            uring_close(socket);
+        }
+    }
+
+    if (callbacks->handing_off()) {
+        uring_quiesce();
+    }
+
+    conn_set_output_hook(NULL);
+    uring_teardown();
+    return 0;
+}
+
+#else
+
+/*****************************************************************************
+ * uring_run_server - io_uring is Linux only
+ *****************************************************************************/
+int uring_run_server(int server_socket, const ServerCallbacks *callbacks,
+                     volatile int *keep_running) {
+    (void)server_socket;
+    (void)callbacks;
+    (void)keep_running;
+    fprintf(stderr, "io_uring backend is only available on Linux\n");
+    return -1;
+}
+
+#endif /* __linux__ */
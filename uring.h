@@ -0,0 +1,42 @@
+/*****************************************************************************
+ * uring.h - io_uring I/O backend for the server (Linux only)
+ *
+ * An alternative to the poll() loop in run_server(). It drives the same
+ * Connection state and the same protocol handlers, but moves the system
+ * calls into a single io_uring:
+ *
+ *   - one multishot accept stays armed on the listening socket
+ *   - each client has one multishot recv that picks receive buffers from
+ *     a provided buffer ring, so idle clients hold no receive memory in
+ *     the kernel; received bytes are fed into the client's PDUReader
+ *   - conn_flush_pending() submits one send per connection with output,
+ *     and all of them go to the kernel with the next io_uring_enter()
+ *
+ * In steady state a whole event loop pass (every receive, dispatch and
+ * send) costs one io_uring_enter() call.
+ *
+ * CPE 464 - Assignment 2
+ *****************************************************************************/
+
+#ifndef URING_H
+#define URING_H
+
+#include "server.h"
+
+/*****************************************************************************
+ * uring_run_server - Serve clients with io_uring until *keep_running is 0
+ *
+ * Parameters:
+ *   server_socket - The listening socket
+ *   callbacks     - Server hooks (see server.h)
+ *   keep_running  - Checked after every wakeup; signals interrupt the wait
+ *
+ * Returns:
+ *   0 after a clean shutdown
+ *   -1 if io_uring is not available (not Linux, kernel too old, or
+ *      disabled), before any client was accepted
+ *****************************************************************************/
+int uring_run_server(int server_socket, const ServerCallbacks *callbacks,
+                     volatile int *keep_running);
+
+#endif /* URING_H */
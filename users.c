@@ -37,14 +37,398 @@
 /* TODO: Define your global variables here */
 
 typedef struct UserNode {
-    char username[101];
+    NameId name;                  /* Interned, see names.h */
     int socket;
     UserState state;
     struct UserNode *next;
+    struct UserNode *prev;
+    struct UserNode *left;        /* Sorted index, see users_tree_insert() */
+    struct UserNode *right;
+    int height;
+    uint32_t serial;              /* Join order, the Flag 14 cursor */
+    int joined_index;             /* Slot in joined[] */
 } UserNode;
 
-// defining global linked list
+// defining global linked list, newest user first; it gives the order
+// users are listed in
 static UserNode* user_list = NULL;
+static int user_count = 0;
+
+/* Changes whenever a user joins or leaves (never 0), and the length of
+ * all names together, for callers that cache a rendering of the list */
+static unsigned generation = 1;
+static int name_bytes = 0;
+
+/* Users by socket descriptor and by name handle (NULL = no user), each
+ * grown to fit the highest index seen; both are small and dense */
+static UserNode** by_socket = NULL;
+static int by_socket_size = 0;
+static UserNode** by_name = NULL;
+static int by_name_size = 0;
+
+/* The same users as an AVL tree ordered by name bytes, for sorted and
+ * prefix listing (users_foreach_sorted()) */
+static UserNode* sorted_root = NULL;
+
+/* The same users again in join order, for users_pack_names(). Serials
+ * only grow, so the array stays sorted by serial: a leaving user leaves a
+ * hole (node NULL, serial kept), and the holes are squeezed out once they
+ * are half the array. */
+typedef struct {
+    uint32_t serial;
+    UserNode *node;
+} JoinedSlot;
+
+static JoinedSlot* joined = NULL;
+static int joined_count = 0;
+static int joined_capacity = 0;
+static int joined_holes = 0;
+static uint32_t next_serial = 1;
+
+/* One sorted walk: where it starts, the prefix it stops at, and whom
+ * it reports to */
+typedef struct {
+    const char *from;             /* Start at the first name >= from */
+    int from_len;
+    int skip_equal;               /* ...or > from, for a page cursor */
+    const char *prefix;
+    int prefix_len;
+    UsersVisitor visit;
+    void *arg;
+    int count;
+    int done;
+} SortedWalk;
+
+/* State for users_pack_sorted()'s visitor */
+typedef struct {
+    uint8_t *buffer;
+    int size;
+    int used;
+    int count;
+    int full;
+} SortedPack;
+
+/*****************************************************************************
+ * users_reserve_index - Make an index array long enough to hold index
+ *
+ * Returns -1 if out of memory.
+ *****************************************************************************/
+static int users_reserve_index(UserNode ***array, int *size, int index) {
+    UserNode **grown;
+    int new_size;
+
+    if (index < *size) {
+        return 0;
+    }
+
+    new_size = *size ? *size : 1024;
+    while (new_size <= index) {
+        new_size *= 2;
+    }
+    grown = realloc(*array, new_size * sizeof(UserNode *));
+    if (grown == NULL) {
+        return -1;
+    }
+    memset(grown + *size, 0, (new_size - *size) * sizeof(UserNode *));
+    *array = grown;
+    *size = new_size;
+    return 0;
+}
+
+/*****************************************************************************
+ * users_by_name - The user holding a name handle, or NULL
+ *****************************************************************************/
+static UserNode *users_by_name(NameId name) {
+    return name != 0 && (int)name < by_name_size ? by_name[name] : NULL;
+}
+
+/*****************************************************************************
+ * users_find - Look a user up by name
+ *****************************************************************************/
+static UserNode *users_find(const char *username) {
+    return users_by_name(names_find(username, strlen(username)));
+}
+
+/*****************************************************************************
+ * users_compare - Order two names
+ *
+ * Byte-wise (unsigned), and a name sorts before any longer name it is a
+ * prefix of. Returns <0, 0 or >0 like memcmp().
+ *****************************************************************************/
+static int users_compare(const char *a, int a_len, const char *b, int b_len) {
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+    return cmp != 0 ? cmp : a_len - b_len;
+}
+
+/*****************************************************************************
+ * users_height - Height of a subtree (0 when empty)
+ *****************************************************************************/
+static int users_height(const UserNode *node) {
+    return node ? node->height : 0;
+}
+
+/*****************************************************************************
+ * users_fix_height - Recompute a node's height from its children
+ *****************************************************************************/
+static void users_fix_height(UserNode *node) {
+    int left = users_height(node->left);
+    int right = users_height(node->right);
+
+    node->height = 1 + (left > right ? left : right);
+}
+
+/*****************************************************************************
+ * users_rotate - Lift a node's left (or right) child into its place
+ *
+ * Returns the subtree's new root.
+ *****************************************************************************/
+static UserNode *users_rotate(UserNode *node, int lift_left) {
+    UserNode *child;
+
+    if (lift_left) {
+        child = node->left;
+        node->left = child->right;
+        child->right = node;
+    } else {
+        child = node->right;
+        node->right = child->left;
+        child->left = node;
+    }
+
+    users_fix_height(node);
+    users_fix_height(child);
+    return child;
+}
+
+/*****************************************************************************
+ * users_rebalance - Restore the AVL invariant at a node whose subtrees
+ * changed height by at most one
+ *
+ * Returns the subtree's new root.
+ *****************************************************************************/
+static UserNode *users_rebalance(UserNode *node) {
+    int balance = users_height(node->left) - users_height(node->right);
+
+    if (balance > 1) {
+        if (users_height(node->left->left) < users_height(node->left->right)) {
+            node->left = users_rotate(node->left, 0);
+        }
+        return users_rotate(node, 1);
+    }
+    if (balance < -1) {
+        if (users_height(node->right->right) < users_height(node->right->left)) {
+            node->right = users_rotate(node->right, 1);
+        }
+        return users_rotate(node, 0);
+    }
+
+    users_fix_height(node);
+    return node;
+}
+
+/*****************************************************************************
+ * users_tree_insert - Add a node (whose name is not in the tree yet)
+ *
+ * Returns the subtree's new root. Recursion depth is the tree height,
+ * under 1.45 log2(n).
+ *****************************************************************************/
+static UserNode *users_tree_insert(UserNode *root, UserNode *node) {
+    if (root == NULL) {
+        node->left = NULL;
+        node->right = NULL;
+        node->height = 1;
+        return node;
+    }
+
+    if (users_compare(names_string(node->name), names_length(node->name),
+                      names_string(root->name), names_length(root->name)) < 0) {
+        root->left = users_tree_insert(root->left, node);
+    } else {
+        root->right = users_tree_insert(root->right, node);
+    }
+    return users_rebalance(root);
+}
+
+/*****************************************************************************
+ * users_tree_take_min - Detach the leftmost node of a non-empty subtree
+ *
+ * Returns the subtree's new root; *min is set to the detached node.
+ *****************************************************************************/
+static UserNode *users_tree_take_min(UserNode *root, UserNode **min) {
+    if (root->left == NULL) {
+        *min = root;
+        return root->right;
+    }
+
+    root->left = users_tree_take_min(root->left, min);
+    return users_rebalance(root);
+}
+
+/*****************************************************************************
+ * users_tree_remove - Take a node (which is in the tree) out of it
+ *
+ * Returns the subtree's new root.
+ *****************************************************************************/
+static UserNode *users_tree_remove(UserNode *root, UserNode *node) {
+    UserNode *successor;
+    int cmp;
+
+    if (root == node) {
+        if (node->left == NULL) return node->right;
+        if (node->right == NULL) return node->left;
+
+        // the next name up takes the node's place
+        node->right = users_tree_take_min(node->right, &successor);
+        successor->left = node->left;
+        successor->right = node->right;
+        return users_rebalance(successor);
+    }
+
+    cmp = users_compare(names_string(node->name), names_length(node->name),
+                      names_string(root->name), names_length(root->name));
+    if (cmp < 0) {
+        root->left = users_tree_remove(root->left, node);
+    } else {
+        root->right = users_tree_remove(root->right, node);
+    }
+    return users_rebalance(root);
+}
+
+/*****************************************************************************
+ * users_walk - Visit, in name order, a subtree's names from walk->from on
+ *
+ * Subtrees wholly before the start are skipped without being entered, and
+ * the walk ends at the first name without the prefix (names sharing a
+ * prefix are adjacent), so it costs O(log n + k) for k names visited.
+ *****************************************************************************/
+static void users_walk(UserNode *node, SortedWalk *walk) {
+    int cmp;
+
+    if (node == NULL || walk->done) return;
+
+    cmp = users_compare(walk->from, walk->from_len,
+                        names_string(node->name), names_length(node->name));
+    if (cmp > 0 || (cmp == 0 && walk->skip_equal)) {
+        // this name and everything left of it come before the start
+        users_walk(node->right, walk);
+        return;
+    }
+
+    users_walk(node->left, walk);
+    if (walk->done) return;
+
+    if (names_length(node->name) < walk->prefix_len ||
+        memcmp(names_string(node->name), walk->prefix, walk->prefix_len) != 0) {
+        walk->done = 1;
+        return;
+    }
+
+    walk->count++;
+    if (walk->visit(node->name, node->socket, node->state, walk->arg) != 0) {
+        walk->done = 1;
+        return;
+    }
+
+    users_walk(node->right, walk);
+}
+
+/*****************************************************************************
+ * users_pack_one - users_pack_sorted()'s visitor: append one name
+ *****************************************************************************/
+static int users_pack_one(NameId name, int socket, UserState state, void *arg) {
+    SortedPack *pack = arg;
+    int len = names_length(name);
+
+    (void)socket;
+    (void)state;
+
+    if (pack->used + 1 + len > pack->size) {
+        pack->full = 1;
+        return 1;
+    }
+
+    pack->buffer[pack->used] = len;
+    memcpy(pack->buffer + pack->used + 1, names_string(name), len);
+    pack->used += 1 + len;
+    pack->count++;
+    return 0;
+}
+
+/*****************************************************************************
+ * users_joined_compact - Squeeze the holes out of joined[]
+ *
+ * With renumber set, also gives the users serials 1, 2, ... again, for
+ * when next_serial is about to wrap; cursors handed out before then may
+ * skip or repeat names once.
+ *****************************************************************************/
+static void users_joined_compact(int renumber) {
+    int kept = 0;
+    int i;
+
+    for (i = 0; i < joined_count; i++) {
+        if (joined[i].node == NULL) continue;
+        joined[kept] = joined[i];
+        joined[kept].node->joined_index = kept;
+        if (renumber) joined[kept].serial = joined[kept].node->serial = kept + 1;
+        kept++;
+    }
+
+    joined_count = kept;
+    joined_holes = 0;
+    if (renumber) next_serial = kept + 1;
+}
+
+/*****************************************************************************
+ * users_joined_push - Give a new user the next serial and a joined[] slot
+ *
+ * Returns -1 if out of memory.
+ *****************************************************************************/
+static int users_joined_push(UserNode *node) {
+    JoinedSlot *grown;
+    int new_capacity;
+
+    if (next_serial == UINT32_MAX) users_joined_compact(1);
+
+    if (joined_count == joined_capacity) {
+        new_capacity = joined_capacity ? joined_capacity * 2 : 1024;
+        grown = realloc(joined, new_capacity * sizeof(JoinedSlot));
+        if (grown == NULL) return -1;
+        joined = grown;
+        joined_capacity = new_capacity;
+    }
+
+    node->serial = next_serial++;
+    node->joined_index = joined_count;
+    joined[joined_count].serial = node->serial;
+    joined[joined_count].node = node;
+    joined_count++;
+    return 0;
+}
+
+/*****************************************************************************
+ * users_unlink - Take a node out of the indexes and the list, and free it
+ *****************************************************************************/
+static void users_unlink(UserNode *node) {
+    sorted_root = users_tree_remove(sorted_root, node);
+    joined[node->joined_index].node = NULL;
+    if (++joined_holes * 2 > joined_count) users_joined_compact(0);
+    by_name[node->name] = NULL;
+    name_bytes -= names_length(node->name);
+    names_release(node->name);
+
+    if (node->socket >= 0 && node->socket < by_socket_size && by_socket[node->socket] == node) {
+        by_socket[node->socket] = NULL;
+    }
+
+    if (node->prev) node->prev->next = node->next;
+    else user_list = node->next;
+    if (node->next) node->next->prev = node->prev;
+
+    user_count--;
+    if (++generation == 0) generation = 1;
+    free(node);
+}
 
 /*****************************************************************************
  * users_init - Initialize the username table
@@ -62,6 +446,8 @@ void users_init(void) {
 
     // setting to the LL to NULL
     user_list = NULL;
+    sorted_root = NULL;
+    user_count = 0;
 }
 
 /*****************************************************************************
@@ -93,25 +479,46 @@ int users_add(const char *username, int socket) {
 
     if (username == NULL) return -3;
 
-    if (strlen(username) > 100) return -4;
-
-    // if the username exists, return
-    if (users_exists(username)) return -1;
+    int length = strlen(username);
+    if (length > 100) return -4;
+
+    // intern the name up front, the only time it is hashed and probed; the
+    // store keeps the only copy. A taken name comes back as its holder's
+    // handle, so by_name says whether it exists and the extra reference
+    // goes straight back
+    NameId name = names_intern(username, length);
+    if (name == 0) return -2;
+    if (users_by_name(name) != NULL) {
+        names_release(name);
+        return -1;
+    }
 
     // creating a new user variable
     UserNode* new_user = malloc(sizeof(UserNode));
 
     // if there was a memory allocation failure
-    if (new_user == NULL) {return -2;}
-
-    // copy over the name
-    strncpy(new_user->username, username, 100);
-    new_user->username[100] = '\0';
+    if (new_user == NULL ||
+        (socket >= 0 && users_reserve_index(&by_socket, &by_socket_size, socket) < 0) ||
+        users_reserve_index(&by_name, &by_name_size, name) < 0 ||
+        users_joined_push(new_user) < 0) {
+        names_release(name);
+        free(new_user);
+        return -2;
+    }
+    new_user->name = name;
+    by_name[name] = new_user;
 
     // copy over socket and new user to the LL
     new_user->socket = socket;
+    if (socket >= 0) by_socket[socket] = new_user;
+    new_user->prev = NULL;
     new_user->next = user_list;
+    if (user_list) user_list->prev = new_user;
     user_list = new_user;
+    sorted_root = users_tree_insert(sorted_root, new_user);
+    user_count++;
+    name_bytes += names_length(new_user->name);
+    if (++generation == 0) generation = 1;
 
     // assigning the user state to available
     new_user->state = USER_AVAILABLE;
@@ -141,30 +548,12 @@ int users_remove(const char *username) {
      */
 
     if (username == NULL) return -3;
-    UserNode* previous = NULL;
-    UserNode* current = user_list;
-
-    while (current){
-
-        // if the names are the same
-        if (strcmp(current->username, username) == 0){
 
-            // for unlinking the middle or tail
-            if (previous) previous->next = current->next;
-            
-            // for unlinking the head
-            else user_list = current->next;
-
-            // freeing memory and returning 0 (success)
-            free(current);
-            return 0;
-        }
-        
-        previous = current;
-        current = current->next;
-    }
+    UserNode* found = users_find(username);
+    if (found == NULL) return -1;
 
-    return -1;  /* Placeholder - remove this when implementing */
+    users_unlink(found);
+    return 0;
 }
 
 /*****************************************************************************
@@ -179,29 +568,10 @@ int users_remove_by_socket(int socket) {
     // invalid socket check
     if (socket < 0) return -2;
 
-    UserNode* previous = NULL;
-    UserNode* current = user_list;
-
-    while (current) {
-
-        if (current->socket == socket){
-
-            // unlinking anything else but head
-            if (previous) previous->next = current->next;
-
-            // unlinking the head
-            else user_list = current->next;
-
-            free(current);
-            return 0;
-        }
+    if (socket >= by_socket_size || by_socket[socket] == NULL) return -1;
 
-        previous = current;
-        current = current->next;
-
-    }
-
-    return -1;  /* Placeholder - remove this when implementing */
+    users_unlink(by_socket[socket]);
+    return 0;
 }
 
 /*****************************************************************************
@@ -218,19 +588,7 @@ int users_exists(const char *username) {
 
     if (username == NULL) return -3;
 
-    UserNode* current = user_list;
-
-    while(current){
-
-        // if they are the same
-        if (strcmp(current->username, username) == 0){
-            return 1;
-        }
-
-        current = current->next;
-    }
-
-    return 0;  /* Placeholder - remove this when implementing */
+    return users_find(username) != NULL;
 }
 
 /*****************************************************************************
@@ -246,20 +604,9 @@ int users_get_socket(const char *username) {
 
     if (username == NULL) return -3;
 
-    UserNode* current = user_list;
+    UserNode* found = users_find(username);
 
-    while (current){
-
-        if (strcmp(current->username, username) == 0){
-
-            return current->socket;
-
-        } 
-
-        current = current->next;
-    }
-
-    return -1;  /* Placeholder - remove this when implementing */
+    return found ? found->socket : -1;
 }
 
 /*****************************************************************************
@@ -277,24 +624,12 @@ int users_get_username(int socket, char *username) {
 
     if (username == NULL) return -3;
 
-    UserNode* current = user_list;
-
-    while(current){
-
-        // if there is a matching socket
-        if (current->socket == socket){
-
-            strncpy(username, current->username,100);
-            username[100] = '\0';
-            printf("The socket: %d has username: %s\n", socket, username);
-            return 0;
-
-        }
-
-        current = current->next;
-    }
+    if (socket < 0 || socket >= by_socket_size || by_socket[socket] == NULL) return -1;
 
-    return -1;  /* Placeholder - remove this when implementing */
+    strncpy(username, names_string(by_socket[socket]->name), 100);
+    username[100] = '\0';
+    printf("The socket: %d has username: %s\n", socket, username);
+    return 0;
 }
 
 /*****************************************************************************
@@ -309,21 +644,11 @@ int users_set_state(const char *username, UserState state) {
 
     if (username == NULL) {return -2;}
 
-    UserNode* current = user_list;
-    
-    while (current){
-
-        if (strcmp(current->username, username) == 0){
-
-            current->state = state;
-            return 0;
-        }
-
-        current = current->next;
+    UserNode* found = users_find(username);
+    if (found == NULL) return -1;
 
-    }
-
-    return -1;  /* Placeholder - remove this when implementing */
+    found->state = state;
+    return 0;
 }
 
 /*****************************************************************************
@@ -338,19 +663,47 @@ UserState users_get_state(const char *username) {
 
     if (username == NULL) {return -3;}
 
-    UserNode* current = user_list;
+    UserNode* found = users_find(username);
 
-    while (current){
+    return found ? found->state : USER_AVAILABLE;
+}
 
-        if (strcmp(current->username, username) == 0){
+/*****************************************************************************
+ * users_get_name - Get the name handle of the user on a socket
+ *****************************************************************************/
+NameId users_get_name(int socket) {
+    if (socket < 0 || socket >= by_socket_size || by_socket[socket] == NULL) return 0;
 
-            return current->state;
-        }
+    return by_socket[socket]->name;
+}
 
-        current = current->next;
-    }
+/*****************************************************************************
+ * users_get_socket_by_name - Get the socket for a name handle
+ *****************************************************************************/
+int users_get_socket_by_name(NameId name) {
+    UserNode* found = users_by_name(name);
+
+    return found ? found->socket : -1;
+}
+
+/*****************************************************************************
+ * users_set_state_by_name - Set the state for a name handle
+ *****************************************************************************/
+int users_set_state_by_name(NameId name, UserState state) {
+    UserNode* found = users_by_name(name);
+    if (found == NULL) return -1;
+
+    found->state = state;
+    return 0;
+}
+
+/*****************************************************************************
+ * users_get_state_by_name - Get the state for a name handle
+ *****************************************************************************/
+UserState users_get_state_by_name(NameId name) {
+    UserNode* found = users_by_name(name);
 
-    return USER_AVAILABLE;  /* Placeholder - always returns this now */
+    return found ? found->state : USER_AVAILABLE;
 }
 
 /*****************************************************************************
@@ -364,46 +717,136 @@ int users_count(void) {
      * For hash table: count entries across all buckets
      */
 
-     UserNode* current = user_list;
-     int count = 0;
-
-     while (current){
-
-        count++;
-        current = current->next;
+    return user_count;
+}
 
-     }
+/*****************************************************************************
+ * users_generation - Get a number that changes whenever users join or leave
+ *****************************************************************************/
+unsigned users_generation(void) {
+    return generation;
+}
 
-    return count;  /* Placeholder - remove this when implementing */
+/*****************************************************************************
+ * users_name_bytes - Get the length of all usernames together
+ *****************************************************************************/
+int users_name_bytes(void) {
+    return name_bytes;
 }
 
 /*****************************************************************************
- * users_get_all - Get all usernames
+ * users_foreach - Visit every user in list order, without copying
  *****************************************************************************/
-int users_get_all(char **usernames, int max_users) {
-    /* TODO: Implement this function
-     *
-     * Iterate through your data structure
-     * Copy each username into usernames array:
-     *   strcpy(usernames[i], current_user->username);
-     *
-     * Stop when you've copied max_users or reached the end
-     * Return the number of usernames copied
-     */
+int users_foreach(UsersVisitor visit, void *arg) {
+    UserNode* current = user_list;
+    UserNode* next;
+    int count = 0;
+
+    if (visit == NULL) return 0;
+
+    while (current){
+        next = current->next;
+        count++;
+        if (visit(current->name, current->socket, current->state, arg) != 0) break;
+        current = next;
+    }
 
-     if (max_users < 0 || usernames == NULL){ return -1;}
+    return count;
+}
 
+/*****************************************************************************
+ * users_pack_names - Serialize a range of usernames into a buffer
+ *****************************************************************************/
+int users_pack_names(uint32_t from, uint8_t *buffer, int size, int *used, uint32_t *next) {
+    UserNode* current;
+    int low = 0;
+    int high = joined_count;
+    int middle;
     int count = 0;
-    UserNode* current = user_list;
+    int len;
+
+    *used = 0;
+    *next = 0;
+    if (buffer == NULL) { return 0;}
+
+    // binary search for the first user who joined at or after from; the
+    // holes keep their serials, so the array is sorted throughout
+    while (low < high){
+        middle = low + (high - low) / 2;
+        if (joined[middle].serial < from) low = middle + 1;
+        else high = middle;
+    }
 
-    while (current && count < max_users){
+    for (; low < joined_count; low++){
+        current = joined[low].node;
+        if (current == NULL) continue;
 
-        strcpy(usernames[count], current->username);
+        len = names_length(current->name);
+        if (*used + 1 + len > size){
+            *next = current->serial;
+            break;
+        }
+
+        buffer[*used] = len;
+        memcpy(buffer + *used + 1, names_string(current->name), len);
+        *used += 1 + len;
         count++;
-        current = current->next;
     }
-    
-    return count;  /* Placeholder - remove this when implementing */
+
+    return count;
+}
+
+/*****************************************************************************
+ * users_foreach_sorted - Visit users in name order, by prefix and cursor
+ *****************************************************************************/
+int users_foreach_sorted(const char *prefix, int prefix_len, const char *after, int after_len,
+                         UsersVisitor visit, void *arg) {
+    SortedWalk walk;
+
+    if (visit == NULL || prefix_len < 0 || after_len < 0 ||
+        (prefix == NULL && prefix_len > 0) || (after == NULL && after_len > 0)) {
+        return 0;
+    }
+
+    memset(&walk, 0, sizeof(walk));
+    walk.prefix = prefix ? prefix : "";
+    walk.prefix_len = prefix_len;
+    walk.visit = visit;
+    walk.arg = arg;
+
+    // start just past the cursor, unless the prefix's names come later
+    if (after_len > 0 && users_compare(after, after_len, walk.prefix, prefix_len) >= 0) {
+        walk.from = after;
+        walk.from_len = after_len;
+        walk.skip_equal = 1;
+    } else {
+        walk.from = walk.prefix;
+        walk.from_len = prefix_len;
+    }
+
+    users_walk(sorted_root, &walk);
+    return walk.count;
+}
+
+/*****************************************************************************
+ * users_pack_sorted - Serialize the next names in order into a buffer
+ *****************************************************************************/
+int users_pack_sorted(const char *prefix, int prefix_len, const char *after, int after_len,
+                      uint8_t *buffer, int size, int *used, int *more) {
+    SortedPack pack;
+
+    *used = 0;
+    *more = 0;
+    if (buffer == NULL) { return 0;}
+
+    memset(&pack, 0, sizeof(pack));
+    pack.buffer = buffer;
+    pack.size = size;
+    users_foreach_sorted(prefix, prefix_len, after, after_len, users_pack_one, &pack);
+
+    *used = pack.used;
+    *more = pack.full;
+    return pack.count;
 }
 
 /*****************************************************************************
@@ -434,9 +877,27 @@ void users_cleanup(void) {
         
         temp = current;
         current = current->next;
+        names_release(temp->name);
         free(temp);
         
     }
 
-    user_list = NULL;   
+    user_list = NULL;
+    sorted_root = NULL;
+    user_count = 0;
+
+    free(joined);
+    joined = NULL;
+    joined_count = 0;
+    joined_capacity = 0;
+    joined_holes = 0;
+    next_serial = 1;
+
+    free(by_socket);
+    by_socket = NULL;
+    by_socket_size = 0;
+
+    free(by_name);
+    by_name = NULL;
+    by_name_size = 0;
 }
@@ -13,6 +13,8 @@
 
 #include <stdint.h>
 
+#include "names.h"
+
 /* User states */
 typedef enum {
     USER_AVAILABLE,   /* Can start or join games */
@@ -152,6 +154,51 @@ int users_set_state(const char *username, UserState state);
  *****************************************************************************/
 UserState users_get_state(const char *username);
 
+/*****************************************************************************
+ * users_get_name - Get the name handle of the user on a socket
+ *
+ * Cheaper than users_get_username(): nothing is copied, and the handle's
+ * text and length are at hand (names_string(), names_length()).
+ *
+ * Parameters:
+ *   socket - The socket to look up
+ *
+ * Returns:
+ *   The user's NameId, 0 if socket not found
+ *****************************************************************************/
+NameId users_get_name(int socket);
+
+/*****************************************************************************
+ * users_get_socket_by_name - Get the socket for a name handle
+ *
+ * The handle-based forms of users_get_socket(), users_set_state() and
+ * users_get_state(), for a name already looked up with names_find() or
+ * users_get_name().
+ *
+ * Returns:
+ *   Socket descriptor on success
+ *   -1 if no user has that name
+ *****************************************************************************/
+int users_get_socket_by_name(NameId name);
+
+/*****************************************************************************
+ * users_set_state_by_name - Set the state for a name handle
+ *
+ * Returns:
+ *   0 on success
+ *   -1 if no user has that name
+ *****************************************************************************/
+int users_set_state_by_name(NameId name, UserState state);
+
+/*****************************************************************************
+ * users_get_state_by_name - Get the state for a name handle
+ *
+ * Returns:
+ *   The user's state
+ *   USER_AVAILABLE if no user has that name (safe default)
+ *****************************************************************************/
+UserState users_get_state_by_name(NameId name);
+
 /*****************************************************************************
  * users_count - Get the total number of users
  *
@@ -163,20 +210,116 @@ UserState users_get_state(const char *username);
 int users_count(void);
 
 /*****************************************************************************
- * users_get_all - Get all usernames
+ * users_generation - Get a number that changes whenever users join or leave
+ *
+ * Anything rendered from the list of users (names and their order) is
+ * still current while this returns the same value. State changes do not
+ * count.
+ *
+ * Returns:
+ *   The membership generation, never 0
+ *****************************************************************************/
+unsigned users_generation(void);
+
+/*****************************************************************************
+ * users_name_bytes - Get the length of all usernames together
+ *
+ * Returns:
+ *   Sum of the users' name lengths (no terminators)
+ *****************************************************************************/
+int users_name_bytes(void);
+
+/* Called by users_foreach() for each user; nonzero stops the walk. The
+ * name is a handle (see names.h), nothing is copied. */
+typedef int (*UsersVisitor)(NameId name, int socket, UserState state, void *arg);
+
+/*****************************************************************************
+ * users_foreach - Visit every user in list order
+ *
+ * The allocation-free way to see all users: the visitor gets each user's
+ * name handle, socket and state straight from the table. For names only,
+ * already in the protocol's layout, see users_pack_names().
  *
  * Parameters:
- *   usernames - Array of string pointers (caller allocates)
- *   max_users - Maximum number of usernames to return
+ *   visit - Called once per user; must not add or remove users
+ *   arg   - Passed through to visit
  *
  * Returns:
- *   Number of usernames copied into the array
+ *   Number of users visited (including the one that stopped the walk)
+ *****************************************************************************/
+int users_foreach(UsersVisitor visit, void *arg);
+
+/*****************************************************************************
+ * users_pack_names - Serialize a range of usernames into a buffer
  *
- * Note: Caller must allocate space for each username string (101 bytes each)
+ * Writes entries in the protocol's string layout (1-byte length followed
+ * by the name, no terminator) back to back, in the order users joined,
+ * starting at serial from and stopping at the first name that does not
+ * fit: a snapshot of the names in one flat, caller-provided buffer. Used
+ * to build list pages.
  *
- * TODO: Implement this function
+ * Every user gets a serial when it joins, and serials only grow, so next
+ * is a cursor that stays valid while users join and leave: passing it
+ * back resumes with the first user who joined at or after it, whoever
+ * left in between. Users who join later come last. Finding the start
+ * costs O(log n).
+ *
+ * Parameters:
+ *   from   - Serial to start at (0 = first user)
+ *   buffer - Destination
+ *   size   - Bytes available in buffer
+ *   used   - Set to the number of bytes written
+ *   next   - Set to the serial of the first user that did not fit, or 0
+ *            if this was the last of them
+ *
+ * Returns:
+ *   Number of usernames packed
+ *****************************************************************************/
+int users_pack_names(uint32_t from, uint8_t *buffer, int size, int *used, uint32_t *next);
+
+/*****************************************************************************
+ * users_foreach_sorted - Visit users in name order, by prefix and cursor
+ *
+ * Walks a balanced tree kept over the names, so a page of k names costs
+ * O(log n + k) however many users there are. Names sort byte by byte,
+ * case-sensitively ("Bob" before "alice"), a name before the longer names
+ * it starts.
+ *
+ * Parameters:
+ *   prefix     - Only names starting with these bytes (NULL or "" = all)
+ *   prefix_len - Length of prefix
+ *   after      - Start after this name, which need not be a user's any
+ *                more, so it is a cursor that stays valid while users join
+ *                and leave (NULL or "" = from the first name)
+ *   after_len  - Length of after
+ *   visit      - Called once per user; must not add or remove users
+ *   arg        - Passed through to visit
+ *
+ * Returns:
+ *   Number of users visited (including the one that stopped the walk)
+ *****************************************************************************/
+int users_foreach_sorted(const char *prefix, int prefix_len, const char *after, int after_len,
+                         UsersVisitor visit, void *arg);
+
+/*****************************************************************************
+ * users_pack_sorted - Serialize the next names in order into a buffer
+ *
+ * users_pack_names() for users_foreach_sorted(): packs the names it would
+ * visit, in the same layout, until one does not fit. The last name packed
+ * is the cursor for the next call.
+ *
+ * Parameters:
+ *   prefix, prefix_len, after, after_len - As for users_foreach_sorted()
+ *   buffer - Destination
+ *   size   - Bytes available in buffer
+ *   used   - Set to the number of bytes written
+ *   more   - Set to 1 if names are left over, 0 if this was the last
+ *
+ * Returns:
+ *   Number of usernames packed
  *****************************************************************************/
-int users_get_all(char **usernames, int max_users);
+int users_pack_sorted(const char *prefix, int prefix_len, const char *after, int after_len,
+                      uint8_t *buffer, int size, int *used, int *more);
 
 /*****************************************************************************
  * users_cleanup - Free all memory used by the username table